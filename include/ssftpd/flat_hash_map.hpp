@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace ssftpd {
+
+/**
+ * @brief Open-addressing hash map with Robin Hood linear probing
+ *
+ * Keys and values live inline in one contiguous slot array, so lookups touch
+ * one or two cache lines instead of chasing node pointers like
+ * std::unordered_map. Erase uses backward-shift deletion, so there are no
+ * tombstones and probe sequences stay short under churn.
+ *
+ * Not thread-safe; callers provide their own locking. Key and Value must be
+ * default constructible and movable. Any insert or erase invalidates
+ * pointers returned by find().
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap {
+public:
+    /**
+     * @brief Constructor
+     * @param initial_capacity Number of entries to reserve room for
+     */
+    explicit FlatHashMap(size_t initial_capacity = 16)
+        : size_(0)
+    {
+        reserve(initial_capacity);
+    }
+
+    /**
+     * @brief Find a value
+     * @param key Key to look up
+     * @return Pointer to the value, or nullptr if absent
+     */
+    Value* find(const Key& key) {
+        size_t index = findIndex(key);
+        return index != kNotFound ? &slots_[index].value : nullptr;
+    }
+
+    const Value* find(const Key& key) const {
+        size_t index = findIndex(key);
+        return index != kNotFound ? &slots_[index].value : nullptr;
+    }
+
+    /**
+     * @brief Check if a key is present
+     * @param key Key to look up
+     * @return true if present
+     */
+    bool contains(const Key& key) const {
+        return findIndex(key) != kNotFound;
+    }
+
+    /**
+     * @brief Get the value for a key, inserting a default value if absent
+     * @param key Key to look up
+     * @return Reference to the value
+     */
+    Value& operator[](const Key& key) {
+        size_t index = findIndex(key);
+        if (index != kNotFound) {
+            return slots_[index].value;
+        }
+        return slots_[insertNew(Key(key), Value())].value;
+    }
+
+    /**
+     * @brief Insert or overwrite a value
+     * @param key Key
+     * @param value Value
+     * @return true if the key was newly inserted
+     */
+    bool insertOrAssign(const Key& key, Value value) {
+        size_t index = findIndex(key);
+        if (index != kNotFound) {
+            slots_[index].value = std::move(value);
+            return false;
+        }
+        insertNew(Key(key), std::move(value));
+        return true;
+    }
+
+    /**
+     * @brief Remove a key
+     * @param key Key to remove
+     * @return true if the key was present
+     */
+    bool erase(const Key& key) {
+        size_t index = findIndex(key);
+        if (index == kNotFound) {
+            return false;
+        }
+
+        // Backward-shift: pull later entries of the probe run into the hole
+        // so lookups never have to skip over deleted slots
+        size_t hole = index;
+        size_t next = (hole + 1) & mask_;
+        while (slots_[next].distance > 1) {
+            slots_[hole].key = std::move(slots_[next].key);
+            slots_[hole].value = std::move(slots_[next].value);
+            slots_[hole].distance = static_cast<uint32_t>(slots_[next].distance - 1);
+            hole = next;
+            next = (next + 1) & mask_;
+        }
+
+        slots_[hole].key = Key();
+        slots_[hole].value = Value();
+        slots_[hole].distance = 0;
+        size_--;
+        return true;
+    }
+
+    /**
+     * @brief Remove every entry, keeping the allocated capacity
+     */
+    void clear() {
+        for (auto& slot : slots_) {
+            if (slot.distance > 0) {
+                slot.key = Key();
+                slot.value = Value();
+                slot.distance = 0;
+            }
+        }
+        size_ = 0;
+    }
+
+    /**
+     * @brief Make room for a number of entries without rehashing
+     * @param count Number of entries
+     */
+    void reserve(size_t count) {
+        size_t capacity = 8;
+        while (capacity * kMaxLoadNumerator < count * kMaxLoadDenominator) {
+            capacity *= 2;
+        }
+        if (capacity > slots_.size()) {
+            rehash(capacity);
+        }
+    }
+
+    /**
+     * @brief Visit every entry
+     * @param fn Callable taking (const Key&, const Value&)
+     */
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& slot : slots_) {
+            if (slot.distance > 0) {
+                fn(slot.key, slot.value);
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of entries
+     * @return Entry count
+     */
+    size_t size() const { return size_; }
+
+    /**
+     * @brief Check if the map is empty
+     * @return true if empty
+     */
+    bool empty() const { return size_ == 0; }
+
+    /**
+     * @brief Get the number of slots
+     * @return Slot count
+     */
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+    static constexpr size_t kMaxLoadNumerator = 7;
+    static constexpr size_t kMaxLoadDenominator = 8;
+
+    struct Slot {
+        Key key;
+        Value value;
+        uint32_t distance = 0;  ///< Probe distance + 1; 0 marks an empty slot
+    };
+
+    size_t findIndex(const Key& key) const {
+        size_t index = Hash{}(key) & mask_;
+        uint32_t distance = 1;
+
+        // Entries in a probe run are ordered by distance (Robin Hood), so
+        // the search stops as soon as it passes where the key would be
+        while (slots_[index].distance >= distance) {
+            if (slots_[index].distance == distance && slots_[index].key == key) {
+                return index;
+            }
+            index = (index + 1) & mask_;
+            distance++;
+        }
+        return kNotFound;
+    }
+
+    size_t insertNew(Key key, Value value) {
+        if ((size_ + 1) * kMaxLoadDenominator > slots_.size() * kMaxLoadNumerator) {
+            rehash(slots_.size() * 2);
+        }
+
+        size_t index = Hash{}(key) & mask_;
+        uint32_t distance = 1;
+        size_t placed = kNotFound;
+
+        while (true) {
+            Slot& slot = slots_[index];
+            if (slot.distance == 0) {
+                slot.key = std::move(key);
+                slot.value = std::move(value);
+                slot.distance = distance;
+                size_++;
+                return placed != kNotFound ? placed : index;
+            }
+
+            // Robin Hood: take the slot from an entry closer to its home
+            if (slot.distance < distance) {
+                std::swap(slot.key, key);
+                std::swap(slot.value, value);
+                std::swap(slot.distance, distance);
+                if (placed == kNotFound) {
+                    placed = index;
+                }
+            }
+
+            index = (index + 1) & mask_;
+            distance++;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.resize(capacity);
+        mask_ = capacity - 1;
+        size_ = 0;
+
+        for (auto& slot : old) {
+            if (slot.distance > 0) {
+                insertNew(std::move(slot.key), std::move(slot.value));
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_ = 0;
+    size_t size_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ssftpd/ftp_epoch.hpp"
+#include "ssftpd/ftp_ip_key.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief CIDR allow/deny list compiled into a Patricia trie
+ *
+ * IPv4 networks are stored as their IPv4-mapped IPv6 prefix, so one trie
+ * serves both families. Nodes sit in one flat vector and single-child
+ * chains are compressed away, so a lookup visits at most one node per
+ * distinct prefix length on the path to the address, however many rules
+ * there are. Large lists also get a direct-indexed table on the first 16
+ * bits of the address (of the IPv4 part for IPv4), which skips the top of
+ * the trie so a lookup is typically a handful of cache lines.
+ *
+ * The most specific matching rule wins. An address no rule matches is
+ * allowed when the list has no allow rules and denied otherwise, so an
+ * allow list acts as a whitelist and a deny-only list as a blacklist.
+ *
+ * Rules are added while building, then compile() finalizes the list;
+ * afterwards it is only read and may be shared between threads without
+ * locking.
+ */
+class FTPAccessList {
+public:
+    /**
+     * @brief Constructor - empty list, allows everyone
+     */
+    FTPAccessList();
+
+    /**
+     * @brief Add a rule
+     * @param network Address or CIDR network, e.g. "10.0.0.0/8" or "2001:db8::/32"
+     * @param allow true to allow, false to deny
+     * @return false if the network cannot be parsed
+     */
+    bool addRule(const std::string& network, bool allow);
+
+    /**
+     * @brief Finish building and prepare the list for lookups
+     *
+     * Lookups are correct without it, only slower on large lists. Adding a
+     * rule afterwards requires another compile().
+     */
+    void compile();
+
+    /**
+     * @brief Check an address against the rules
+     * @param address Client address
+     * @return true if the address is allowed
+     */
+    bool isAllowed(const FTPIPKey& address) const;
+
+    /**
+     * @brief Get the number of rules
+     * @return Rule count
+     */
+    size_t getRuleCount() const { return rule_count_; }
+
+    /**
+     * @brief Get the number of trie nodes
+     * @return Node count
+     */
+    size_t getNodeCount() const { return nodes_.size(); }
+
+    /**
+     * @brief Parse an address or CIDR network
+     * @param network Network text
+     * @param prefix Receives the network address with host bits cleared
+     * @param length Receives the prefix length in IPv6 bits (IPv4 + 96)
+     * @return false if the text is not a valid network
+     */
+    static bool parseNetwork(const std::string& network, FTPIPKey& prefix, int& length);
+
+private:
+    enum Action : int8_t { NONE = -1, DENY = 0, ALLOW = 1 };
+
+    static constexpr uint32_t kNoChild = UINT32_MAX;
+    static constexpr int kJumpBits = 16;
+    static constexpr size_t kJumpTableMinRules = 64;
+
+    struct Node {
+        uint64_t bits[2];      // Prefix, big-endian words, host bits zero
+        uint32_t child[2];
+        uint8_t length;        // Prefix length in bits (0-128)
+        int8_t action;
+    };
+
+    struct Jump {
+        uint32_t node;         // Where to continue the walk
+        int8_t action;         // Best rule above that node
+    };
+
+    uint32_t addNode(const uint64_t bits[2], int length, int8_t action);
+    Jump buildJump(const uint64_t bits[2], int depth) const;
+
+    std::vector<Node> nodes_;
+    std::vector<Jump> ipv4_jumps_;
+    std::vector<Jump> ipv6_jumps_;
+    size_t rule_count_;
+    size_t allow_count_;
+};
+
+/**
+ * @brief Server and per-virtual-host network access control
+ *
+ * Holds the compiled lists for security.allow_networks/deny_networks and
+ * each virtual host's allow_networks/deny_networks. reload() compiles a new
+ * set and swaps it in with one atomic store; readers pin it with an epoch
+ * guard instead of a lock, so checks on the accept path never wait for a
+ * reload.
+ */
+class FTPAccessControl {
+public:
+    /**
+     * @brief Constructor
+     * @param config Server configuration
+     * @param logger Logger instance
+     */
+    FTPAccessControl(std::shared_ptr<FTPServerConfig> config,
+                     std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor
+     */
+    ~FTPAccessControl();
+
+    FTPAccessControl(const FTPAccessControl&) = delete;
+    FTPAccessControl& operator=(const FTPAccessControl&) = delete;
+
+    /**
+     * @brief Compile the rules from the configuration and publish them
+     * @return false if a rule is invalid (the previous rules stay active)
+     */
+    bool reload();
+
+    /**
+     * @brief Check a client address
+     * @param address Client address
+     * @param virtual_host Virtual host name, or empty for server rules only
+     * @return true if both the server and the virtual host allow the address
+     */
+    bool isAllowed(const FTPIPKey& address, const std::string& virtual_host = std::string()) const;
+
+    /**
+     * @brief Get the number of active rules
+     * @return Rule count across the server and all virtual hosts
+     */
+    size_t getRuleCount() const;
+
+private:
+    struct Tables {
+        FTPAccessList server;
+        std::unordered_map<std::string, FTPAccessList> virtual_hosts;
+    };
+
+    bool buildList(FTPAccessList& list, const std::vector<std::string>& allow,
+                 const std::vector<std::string>& deny, const std::string& scope);
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    FTPEpochDomain epoch_;
+    std::atomic<const Tables*> tables_;
+    std::mutex reload_mutex_;
+};
+
+} // namespace ssftpd
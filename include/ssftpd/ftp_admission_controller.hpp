@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include "ssftpd/ftp_server_config.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Overload-aware admission control for the accept path
+ *
+ * Tracks live load signals: main loop lag, scheduler queue depth and
+ * pending filesystem work. It decides whether new clients may
+ * be admitted. Overload is entered when any signal reaches its limit and
+ * left only once every signal has fallen below 80% of its limit, so the
+ * decision does not flap at the boundary.
+ *
+ * While overloaded, new clients are either answered with 421 straight away
+ * or, with overload_action = defer, left in the kernel listen backlog until
+ * load drops. Sessions that were already admitted keep their share of the
+ * server either way.
+ *
+ * Memory is not one of the signals: FTPMemoryMonitor owns max_memory_usage
+ * and refuses sessions itself when usage gets critical.
+ */
+class FTPAdmissionController {
+public:
+    /**
+     * @brief Admission metrics
+     */
+    struct Stats {
+        bool overloaded;
+        uint64_t loop_lag_us;         ///< Smoothed main loop lag
+        size_t queue_depth;
+        size_t pending_disk_io;
+        uint64_t admitted;
+        uint64_t rejected;
+        uint64_t deferred;            ///< Accept passes skipped while overloaded
+        uint64_t overload_events;     ///< Transitions into overload
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (connection.admission_* settings)
+     * @param logger Logger instance
+     */
+    FTPAdmissionController(std::shared_ptr<FTPServerConfig> config,
+                           std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Record how late the main loop ran
+     * @param lag Time beyond the loop's nominal period
+     */
+    void recordLoopLag(std::chrono::microseconds lag);
+
+    /**
+     * @brief Update the load signals and the overload state
+     *
+     * Call once per main loop iteration.
+     * @param queue_depth Tasks waiting for a scheduler worker
+     * @param pending_disk_io Filesystem tasks queued or running
+     */
+    void update(size_t queue_depth, size_t pending_disk_io);
+
+    /**
+     * @brief Check if accepting should be skipped for this pass
+     *
+     * True while overloaded in defer mode; pending clients stay queued in
+     * the listen backlog.
+     * @return true to skip accept()
+     */
+    bool shouldDefer();
+
+    /**
+     * @brief Decide whether an accepted client may be served
+     * @return false if the client should get 421 and be closed
+     */
+    bool admit();
+
+    /**
+     * @brief Check if the server is currently overloaded
+     * @return true if overloaded
+     */
+    bool isOverloaded() const { return overloaded_.load(); }
+
+    /**
+     * @brief Get admission metrics
+     * @return Snapshot of the admission metrics
+     */
+    Stats getStats() const;
+
+private:
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    bool enabled_;
+    bool defer_on_overload_;
+    std::chrono::microseconds max_loop_lag_;
+    size_t max_queue_depth_;
+    size_t max_pending_disk_io_;
+
+    std::atomic<bool> overloaded_;
+    std::atomic<uint64_t> loop_lag_us_;
+    std::atomic<size_t> queue_depth_;
+    std::atomic<size_t> pending_disk_io_;
+
+    std::atomic<uint64_t> admitted_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> deferred_;
+    std::atomic<uint64_t> overload_events_;
+};
+
+} // namespace ssftpd
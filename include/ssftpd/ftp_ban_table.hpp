@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "ssftpd/flat_hash_map.hpp"
+#include "ssftpd/ftp_ip_key.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Temporary client address bans with timer-wheel expiry
+ *
+ * Bans live in sharded open-addressing tables keyed by FTPIPKey. Each
+ * shard also keeps a timer wheel with one-second slots, so expiring bans
+ * costs work proportional to the bans due, not to the table size. Bans
+ * longer than one wheel revolution stay in their slot for extra turns.
+ *
+ * isBanned() returns without locking while nothing is banned, and is one
+ * shard lock and one probe otherwise, so it can run right after accept().
+ *
+ * Optionally every ban is mirrored into an nftables set with a matching
+ * timeout, so the kernel drops further packets without waking the server.
+ * nft runs from expire(), never from the calling thread.
+ */
+class FTPBanTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Constructor
+     * @param logger Logger instance
+     */
+    explicit FTPBanTable(std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Ban an address
+     *
+     * Banning an already banned address extends the ban if the new one
+     * ends later.
+     * @param key Client address
+     * @param duration Ban length
+     * @param now Current time
+     * @return true if the address was not banned before
+     */
+    bool ban(const FTPIPKey& key, std::chrono::seconds duration, Clock::time_point now);
+
+    /**
+     * @brief Lift a ban
+     * @param key Client address
+     * @return true if the address was banned
+     */
+    bool unban(const FTPIPKey& key);
+
+    /**
+     * @brief Check if an address is banned
+     * @param key Client address
+     * @param now Current time
+     * @return true if banned
+     */
+    bool isBanned(const FTPIPKey& key, Clock::time_point now) const;
+
+    /**
+     * @brief Drop expired bans and run queued nftables updates
+     *
+     * Call about once per second from a background thread.
+     * @param now Current time
+     * @return Number of bans expired
+     */
+    size_t expire(Clock::time_point now);
+
+    /**
+     * @brief Mirror bans into an nftables set
+     * @param set "<family> <table> <set>", e.g. "inet filter ssftpd_bans";
+     *            IPv6 addresses go to the set with "6" appended. Empty
+     *            disables mirroring.
+     */
+    void setNftablesSet(const std::string& set);
+
+    /**
+     * @brief Get the number of active bans
+     * @return Ban count
+     */
+    size_t getBanCount() const { return ban_count_.load(); }
+
+    /**
+     * @brief Get the active bans with their remaining time
+     * @return Address to remaining seconds
+     */
+    std::map<std::string, int64_t> getBans(Clock::time_point now) const;
+
+    /**
+     * @brief Lift every ban
+     */
+    void clear();
+
+private:
+    static constexpr size_t kShardCount = 16;
+    static constexpr size_t kWheelSlots = 256;
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        FlatHashMap<FTPIPKey, int64_t, FTPIPKeyHash> bans;   // Expiry tick
+        std::array<std::vector<FTPIPKey>, kWheelSlots> wheel;
+        int64_t last_tick = -1;
+    };
+
+    struct MirrorRequest {
+        FTPIPKey key;
+        int64_t seconds;
+    };
+
+    static int64_t tickOf(Clock::time_point time);
+    const Shard& shardFor(const FTPIPKey& key) const;
+    Shard& shardFor(const FTPIPKey& key);
+    size_t expireShard(Shard& shard, int64_t tick);
+    void runMirrorRequests();
+
+    std::shared_ptr<Logger> logger_;
+    std::array<Shard, kShardCount> shards_;
+    std::atomic<size_t> ban_count_;
+
+    std::mutex mirror_mutex_;
+    std::string nftables_set_;
+    std::vector<MirrorRequest> mirror_queue_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "ssftpd/ftp_server_config.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Lock-free token bucket in virtual-time (GCRA) form
+ *
+ * Instead of a token count refilled by a timer, the bucket keeps the time
+ * at which it will be empty of debt (the theoretical arrival time). Taking
+ * bytes pushes that time forward by bytes / rate. This is one CAS per
+ * operation, needs no refill thread, and stays exact at any rate because
+ * nothing is rounded to a timer tick.
+ */
+class FTPTokenBucket {
+public:
+    /**
+     * @brief Constructor
+     * @param rate Sustained rate in bytes per second (must be > 0)
+     * @param burst Bytes that may be sent back-to-back after idling
+     */
+    FTPTokenBucket(uint64_t rate, uint64_t burst);
+
+    /**
+     * @brief Get the bytes that may be taken now
+     * @param now_ns Current steady time in nanoseconds
+     * @return Available bytes
+     */
+    uint64_t available(int64_t now_ns) const;
+
+    /**
+     * @brief Take bytes from the bucket
+     * @param bytes Bytes to take
+     * @param now_ns Current steady time in nanoseconds
+     */
+    void consume(uint64_t bytes, int64_t now_ns);
+
+    /**
+     * @brief Give back bytes that were taken but not sent
+     * @param bytes Bytes to return
+     */
+    void refund(uint64_t bytes);
+
+    /**
+     * @brief Get the earliest time a number of bytes will be available
+     * @param bytes Bytes wanted
+     * @param now_ns Current steady time in nanoseconds
+     * @return Steady time in nanoseconds
+     */
+    int64_t readyAt(uint64_t bytes, int64_t now_ns) const;
+
+    /**
+     * @brief Get the sustained rate
+     * @return Rate in bytes per second
+     */
+    uint64_t getRate() const { return rate_; }
+
+private:
+    int64_t toNanoseconds(uint64_t bytes) const;
+
+    uint64_t rate_;
+    int64_t burst_ns_;
+    std::atomic<int64_t> tat_ns_;
+};
+
+/**
+ * @brief Hierarchical bandwidth shaper: global, vhost, user, session
+ *
+ * Each transfer stream draws from up to four token buckets. A send is
+ * granted the minimum of what every level allows, and the grant is taken
+ * from all of them, so a session can never exceed its own cap or the
+ * shared budget of its user, virtual host or the whole server. Levels
+ * without a configured rate are skipped.
+ *
+ * Nothing here sleeps. A stream that is out of budget gets the time at
+ * which it may send again; the connection keeps the data buffered and is
+ * simply skipped by the event loop until then.
+ */
+class FTPBandwidthShaper : public std::enable_shared_from_this<FTPBandwidthShaper> {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Result of a send request
+     */
+    struct Grant {
+        size_t bytes;                ///< Bytes that may be sent now (0 = wait)
+        Clock::time_point ready_at;  ///< When to try again if bytes is 0
+    };
+
+    /**
+     * @brief Shaping state of one transfer stream (one session)
+     *
+     * Used by one thread at a time, like the session that owns it.
+     */
+    class Stream {
+    public:
+        /**
+         * @brief Ask to send bytes
+         * @param wanted Bytes the caller would like to send
+         * @param now Current time
+         * @return Grant
+         */
+        Grant request(size_t wanted, Clock::time_point now);
+
+        /**
+         * @brief Return bytes that were granted but not sent
+         * @param bytes Unsent bytes
+         */
+        void refund(size_t bytes);
+
+        /**
+         * @brief Attach the user level after login
+         * @param username Logged-in user
+         */
+        void setUser(const std::string& username);
+
+    private:
+        friend class FTPBandwidthShaper;
+
+        enum Level { SESSION = 0, USER, VIRTUAL_HOST, GLOBAL, LEVEL_COUNT };
+
+        explicit Stream(std::shared_ptr<FTPBandwidthShaper> shaper) : shaper_(std::move(shaper)) {}
+
+        std::shared_ptr<FTPBandwidthShaper> shaper_;
+        std::array<std::shared_ptr<FTPTokenBucket>, LEVEL_COUNT> buckets_;
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (transfer.max_transfer_rate is the
+     *               global cap; rate_limit.max_transfer_rate the per-session
+     *               cap when rate limiting is enabled)
+     * @param logger Logger instance
+     */
+    FTPBandwidthShaper(std::shared_ptr<FTPServerConfig> config,
+                       std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Create the shaping state for a new session
+     * @param virtual_host Virtual host name
+     * @param virtual_host_rate Virtual host cap in bytes/s (0 = unlimited)
+     * @return Stream (the shaper must be owned by a shared_ptr)
+     */
+    std::shared_ptr<Stream> createStream(const std::string& virtual_host, uint64_t virtual_host_rate);
+
+    /**
+     * @brief Set how user caps are looked up
+     * @param resolver Returns a user's cap in bytes/s (0 = unlimited)
+     */
+    void setUserRateResolver(std::function<uint64_t(const std::string&)> resolver);
+
+    /**
+     * @brief Get the number of requests that had to wait
+     * @return Throttled request count
+     */
+    uint64_t getThrottledCount() const { return throttled_.load(); }
+
+    /**
+     * @brief Get the total bytes granted
+     * @return Granted bytes
+     */
+    uint64_t getGrantedBytes() const { return granted_bytes_.load(); }
+
+private:
+    using BucketMap = std::unordered_map<std::string, std::weak_ptr<FTPTokenBucket>>;
+
+    static uint64_t burstFor(uint64_t rate);
+    std::shared_ptr<FTPTokenBucket> userBucket(const std::string& username);
+    std::shared_ptr<FTPTokenBucket> sharedBucket(BucketMap& buckets, const std::string& name, uint64_t rate);
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    uint64_t session_rate_;
+    std::shared_ptr<FTPTokenBucket> global_bucket_;
+
+    std::mutex buckets_mutex_;
+    BucketMap virtual_host_buckets_;
+    BucketMap user_buckets_;
+    std::function<uint64_t(const std::string&)> user_rate_resolver_;
+
+    std::atomic<uint64_t> throttled_;
+    std::atomic<uint64_t> granted_bytes_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include "ssftpd/flat_hash_map.hpp"
+#include "ssftpd/ftp_ip_key.hpp"
+
+namespace ssftpd {
+
+/**
+ * @brief Live session counts per user, client IP and virtual host
+ *
+ * Counts are adjusted when a session connects, logs in and disconnects, so
+ * admin queries cost O(result size) instead of a walk over every session.
+ * Each dimension has its own lock. Those locks are only taken on
+ * connect/login/disconnect and by queries, never on the session I/O path.
+ *
+ * Sessions that have not logged in are counted under an empty username.
+ */
+class FTPConnectionAggregates {
+public:
+    /**
+     * @brief Count a new session
+     * @param client_key Client address
+     * @param virtual_host Virtual host name (may be empty)
+     */
+    void onConnect(const FTPIPKey& client_key, const std::string& virtual_host);
+
+    /**
+     * @brief Move a session from one username to another
+     * @param previous Username before the change (empty = not logged in)
+     * @param username Username after the change (empty = logged out)
+     */
+    void onLogin(const std::string& previous, const std::string& username);
+
+    /**
+     * @brief Stop counting a session
+     * @param client_key Client address
+     * @param virtual_host Virtual host name
+     * @param username Username at disconnect (empty = not logged in)
+     */
+    void onDisconnect(const FTPIPKey& client_key, const std::string& virtual_host,
+                      const std::string& username);
+
+    /**
+     * @brief Get session counts by username
+     * @return Username to session count
+     */
+    std::map<std::string, size_t> getUserCounts() const;
+
+    /**
+     * @brief Get session counts by client IP
+     * @return Client IP to session count
+     */
+    std::map<std::string, size_t> getIPCounts() const;
+
+    /**
+     * @brief Get session counts by virtual host
+     * @return Virtual host name to session count
+     */
+    std::map<std::string, size_t> getVirtualHostCounts() const;
+
+    /**
+     * @brief Get the session count for one user
+     * @param username Username
+     * @return Session count
+     */
+    size_t getUserCount(const std::string& username) const;
+
+    /**
+     * @brief Get the session count for one client IP
+     * @param client_key Client address
+     * @return Session count
+     */
+    size_t getIPCount(const FTPIPKey& client_key) const;
+
+    /**
+     * @brief Reset every count
+     */
+    void clear();
+
+private:
+    template <typename Key, typename Hash = std::hash<Key>>
+    struct Counter {
+        mutable std::mutex mutex;
+        FlatHashMap<Key, size_t, Hash> counts;
+    };
+
+    template <typename Key, typename Hash>
+    static void increment(Counter<Key, Hash>& counter, const Key& key);
+    template <typename Key, typename Hash>
+    static void decrement(Counter<Key, Hash>& counter, const Key& key);
+    template <typename Key, typename Hash>
+    static std::map<std::string, size_t> collect(const Counter<Key, Hash>& counter);
+    template <typename Key, typename Hash>
+    static size_t lookup(const Counter<Key, Hash>& counter, const Key& key);
+
+    Counter<std::string> users_;
+    Counter<FTPIPKey, FTPIPKeyHash> ips_;
+    Counter<std::string> virtual_hosts_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ssftpd/ftp_connection_aggregates.hpp"
+#include "ssftpd/ftp_ip_key.hpp"
+
+namespace ssftpd {
+
+class FTPConnection;
+
+/**
+ * @brief Sharded registry of live FTP sessions
+ *
+ * Sessions are keyed by a server-assigned session id and spread over
+ * independently locked shards, so add, remove and lookup are O(1) and never
+ * take a global lock. Secondary indexes by client IP and by username (also
+ * sharded) let IP and user based operations touch only matching sessions.
+ *
+ * The primary shards and the indexes are updated under separate locks, so an
+ * index may briefly name a session that has just been removed; lookups
+ * through an index skip such ids. Per-user, per-IP and per-vhost counts are
+ * adjusted under the session's shard lock and always match the registry.
+ */
+class FTPConnectionRegistry {
+public:
+    using SessionId = uint64_t;
+
+    /// Returned by add() when the session could not be registered
+    static constexpr SessionId kInvalidSessionId = 0;
+
+    /**
+     * @brief Registered session as seen by iteration
+     */
+    struct Entry {
+        SessionId session_id;
+        std::shared_ptr<FTPConnection> connection;
+    };
+
+    /**
+     * @brief Constructor
+     */
+    FTPConnectionRegistry();
+
+    /**
+     * @brief Destructor
+     */
+    ~FTPConnectionRegistry();
+
+    FTPConnectionRegistry(const FTPConnectionRegistry&) = delete;
+    FTPConnectionRegistry& operator=(const FTPConnectionRegistry&) = delete;
+
+    /**
+     * @brief Register a session
+     * @param connection Connection to register
+     * @param client_key Client address used for the IP index
+     * @param virtual_host Virtual host name for the per-vhost counts
+     * @param limit Maximum number of sessions (0 = unlimited)
+     * @return New session id, or kInvalidSessionId if null or at the limit
+     */
+    SessionId add(std::shared_ptr<FTPConnection> connection,
+                  const FTPIPKey& client_key, const std::string& virtual_host,
+                  size_t limit = 0);
+
+    /**
+     * @brief Unregister a session
+     * @param session_id Session to remove
+     * @return The removed connection, or nullptr if it was not registered
+     */
+    std::shared_ptr<FTPConnection> remove(SessionId session_id);
+
+    /**
+     * @brief Look up a session
+     * @param session_id Session id
+     * @return Connection, or nullptr if not registered
+     */
+    std::shared_ptr<FTPConnection> find(SessionId session_id) const;
+
+    /**
+     * @brief Move a session to a new username in the user index
+     * @param session_id Session id
+     * @param username New username (empty = not logged in)
+     */
+    void updateUsername(SessionId session_id, const std::string& username);
+
+    /**
+     * @brief Get all sessions from one client IP
+     * @param client_key Client address
+     * @return Matching sessions
+     */
+    std::vector<Entry> findByIP(const FTPIPKey& client_key) const;
+
+    /**
+     * @brief Get all sessions logged in as one user
+     * @param username Username
+     * @return Matching sessions
+     */
+    std::vector<Entry> findByUser(const std::string& username) const;
+
+    /**
+     * @brief Copy one shard's sessions
+     * @param shard Shard index, less than shardCount()
+     * @param out Receives the shard's sessions (cleared first)
+     */
+    void snapshotShard(size_t shard, std::vector<Entry>& out) const;
+
+    /**
+     * @brief Visit one shard's sessions under the shard lock
+     *
+     * Lets callers read session metadata without copying shared_ptrs. The
+     * callback must be short and must not call back into the registry.
+     * @param shard Shard index, less than shardCount()
+     * @param fn Callable taking (SessionId, const FTPConnection&,
+     *           const FTPIPKey& client_key, const std::string& virtual_host,
+     *           const std::string& username)
+     */
+    template <typename Fn>
+    void forEachInShard(size_t shard, Fn&& fn) const {
+        const Shard& s = shards_[shard & (kShardCount - 1)];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (const auto& pair : s.sessions) {
+            const Session& session = pair.second;
+            fn(pair.first, *session.connection, session.client_key, session.virtual_host, session.username);
+        }
+    }
+
+    /**
+     * @brief Copy every session
+     * @return All registered sessions
+     */
+    std::vector<Entry> snapshot() const;
+
+    /**
+     * @brief Remove every session
+     * @return The removed sessions
+     */
+    std::vector<Entry> clear();
+
+    /**
+     * @brief Get the number of registered sessions
+     * @return Session count
+     */
+    size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get the live per-user, per-IP and per-vhost session counts
+     * @return Aggregate counts
+     */
+    const FTPConnectionAggregates& aggregates() const { return aggregates_; }
+
+    /**
+     * @brief Get the number of primary shards
+     * @return Shard count
+     */
+    static constexpr size_t shardCount() { return kShardCount; }
+
+private:
+    static constexpr size_t kShardCount = 64;
+
+    struct Session {
+        std::shared_ptr<FTPConnection> connection;
+        FTPIPKey client_key;
+        std::string virtual_host;
+        std::string username;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<SessionId, Session> sessions;
+    };
+
+    template <typename Key, typename Hash>
+    struct alignas(64) IndexShard {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, std::unordered_set<SessionId>, Hash> sessions;
+    };
+
+    template <typename Key, typename Hash = std::hash<Key>>
+    using Index = std::array<IndexShard<Key, Hash>, kShardCount>;
+
+    Shard& shardFor(SessionId session_id) { return shards_[session_id & (kShardCount - 1)]; }
+    const Shard& shardFor(SessionId session_id) const { return shards_[session_id & (kShardCount - 1)]; }
+
+    template <typename Key, typename Hash>
+    static void indexAdd(Index<Key, Hash>& index, const Key& key, SessionId session_id);
+    template <typename Key, typename Hash>
+    static void indexRemove(Index<Key, Hash>& index, const Key& key, SessionId session_id);
+    template <typename Key, typename Hash>
+    std::vector<Entry> indexLookup(const Index<Key, Hash>& index, const Key& key) const;
+
+    std::array<Shard, kShardCount> shards_;
+    Index<FTPIPKey, FTPIPKeyHash> ip_index_;
+    Index<std::string> user_index_;
+    FTPConnectionAggregates aggregates_;
+
+    std::atomic<SessionId> next_session_id_;
+    std::atomic<size_t> size_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace ssftpd {
+
+/**
+ * @brief Epoch-based reclamation for read-mostly shared data
+ *
+ * Readers pin the current epoch for the duration of a read with a Guard.
+ * This is a couple of atomic stores into a reader slot, with no locks and no
+ * reference counts on the data itself. Writers swap in a new version and
+ * retire() the old one. A retired object is destroyed once every reader
+ * that might still see it has left its guard.
+ *
+ * The number of concurrent readers is bounded by kMaxReaders. A reader that
+ * finds every slot busy spins until one frees up.
+ */
+class FTPEpochDomain {
+public:
+    static constexpr size_t kMaxReaders = 64;
+
+    /**
+     * @brief RAII read-side critical section
+     */
+    class Guard {
+    public:
+        explicit Guard(const FTPEpochDomain& domain);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        const FTPEpochDomain& domain_;
+        size_t slot_;
+    };
+
+    /**
+     * @brief Constructor
+     */
+    FTPEpochDomain();
+
+    /**
+     * @brief Destructor - runs every pending deleter
+     */
+    ~FTPEpochDomain();
+
+    FTPEpochDomain(const FTPEpochDomain&) = delete;
+    FTPEpochDomain& operator=(const FTPEpochDomain&) = delete;
+
+    /**
+     * @brief Schedule destruction of data that readers may still hold
+     *
+     * Call after the data has been unpublished.
+     * @param deleter Destroys the data
+     */
+    void retire(std::function<void()> deleter);
+
+    /**
+     * @brief Run the deleters whose readers have all left
+     * @return Number of objects reclaimed
+     */
+    size_t reclaim();
+
+    /**
+     * @brief Get the number of retired objects not yet reclaimed
+     * @return Pending count
+     */
+    size_t pendingCount() const;
+
+private:
+    static constexpr uint64_t kIdle = 0;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{kIdle};
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> deleter;
+    };
+
+    size_t enter() const;
+    void exit(size_t slot) const;
+    uint64_t oldestActiveEpoch() const;
+
+    std::atomic<uint64_t> global_epoch_;
+    mutable std::array<ReaderSlot, kMaxReaders> readers_;
+
+    mutable std::mutex retired_mutex_;
+    std::vector<Retired> retired_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+struct sockaddr;
+
+namespace ssftpd {
+
+/**
+ * @brief Fixed-size binary client address
+ *
+ * Stores IPv4 and IPv6 addresses in one 16-byte form (IPv4 as
+ * ::ffff:a.b.c.d), so addresses compare and hash as two 64-bit words
+ * without string parsing or allocation. Use toString() only for logs and
+ * admin output.
+ */
+struct FTPIPKey {
+    std::array<uint8_t, 16> bytes{};
+
+    /**
+     * @brief Parse a textual IPv4 or IPv6 address
+     * @param address Address text
+     * @param key Receives the parsed key
+     * @return false if the text is not a valid address
+     */
+    static bool parse(const std::string& address, FTPIPKey& key);
+
+    /**
+     * @brief Build a key from a socket address
+     * @param address AF_INET or AF_INET6 socket address
+     * @param key Receives the key
+     * @return false for other address families
+     */
+    static bool fromSockaddr(const struct sockaddr* address, FTPIPKey& key);
+
+    /**
+     * @brief Build a key from an IPv4 address
+     * @param address IPv4 address in network byte order
+     * @return Key in IPv4-mapped form
+     */
+    static FTPIPKey fromIPv4(uint32_t address);
+
+    /**
+     * @brief Check if this is an IPv4(-mapped) address
+     * @return true for IPv4
+     */
+    bool isIPv4() const;
+
+    /**
+     * @brief Format the address for display
+     * @return Dotted quad for IPv4, RFC 5952 text for IPv6
+     */
+    std::string toString() const;
+
+    /**
+     * @brief Get the high and low 64-bit halves
+     */
+    uint64_t high() const { uint64_t v; std::memcpy(&v, bytes.data(), 8); return v; }
+    uint64_t low() const { uint64_t v; std::memcpy(&v, bytes.data() + 8, 8); return v; }
+
+    bool operator==(const FTPIPKey& other) const { return bytes == other.bytes; }
+    bool operator!=(const FTPIPKey& other) const { return bytes != other.bytes; }
+};
+
+/**
+ * @brief Hash for FTPIPKey (64-bit mix of both halves)
+ */
+struct FTPIPKeyHash {
+    size_t operator()(const FTPIPKey& key) const {
+        uint64_t h = key.high() * 0x9E3779B97F4A7C15ULL ^ key.low();
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return static_cast<size_t>(h);
+    }
+};
+
+} // namespace ssftpd
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ssftpd {
+
+/**
+ * @brief Log-linear (HDR-style) histogram with per-thread recording
+ *
+ * Values below 32 get one bucket each; above that every power of two is
+ * split into 16 linear sub-buckets, so any recorded value is reported
+ * within 1/16 (about 6%) of its true value over the whole range. Values
+ * beyond kMaxValue land in the last bucket.
+ *
+ * record() is a bucket index computation and one relaxed add on a shard
+ * picked per thread, so recording threads do not share cache lines.
+ * snapshot() merges the shards; percentiles are then computed from the
+ * merged counts.
+ */
+class FTPLatencyHistogram {
+public:
+    static constexpr uint64_t kMaxValue = (uint64_t(1) << 36) - 1;
+
+    /**
+     * @brief Merged view of a histogram
+     */
+    struct Snapshot {
+        std::vector<uint64_t> counts;   // Per bucket
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        /**
+         * @brief Get a percentile
+         * @param percentile Percentile in [0, 100]
+         * @return Highest value equivalent to the percentile's bucket
+         */
+        uint64_t percentile(double percentile) const;
+
+        /**
+         * @brief Get the mean of the recorded values
+         * @return Mean, 0 when empty
+         */
+        double mean() const { return count > 0 ? static_cast<double>(sum) / count : 0.0; }
+
+        /**
+         * @brief Add another snapshot's samples to this one
+         * @param other Snapshot to add
+         */
+        void merge(const Snapshot& other);
+    };
+
+    FTPLatencyHistogram();
+
+    FTPLatencyHistogram(const FTPLatencyHistogram&) = delete;
+    FTPLatencyHistogram& operator=(const FTPLatencyHistogram&) = delete;
+
+    /**
+     * @brief Record one value
+     * @param value Value, e.g. microseconds
+     */
+    void record(uint64_t value) {
+        Shard& shard = shards_[threadShard()];
+        shard.counts[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+        uint64_t max = shard.max.load(std::memory_order_relaxed);
+        while (value > max && !shard.max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Merge the shards
+     * @return Snapshot of all values recorded so far
+     */
+    Snapshot snapshot() const;
+
+    /**
+     * @brief Forget every value
+     */
+    void reset();
+
+    /**
+     * @brief Get the bucket of a value
+     * @param value Value
+     * @return Bucket index
+     */
+    static size_t bucketFor(uint64_t value) {
+        if (value > kMaxValue) {
+            value = kMaxValue;
+        }
+        if (value < kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+        return static_cast<size_t>(shift) * (kSubBuckets / 2) + static_cast<size_t>(value >> shift);
+    }
+
+    /**
+     * @brief Get the highest value that lands in a bucket
+     * @param bucket Bucket index
+     * @return Highest equivalent value
+     */
+    static uint64_t bucketUpperBound(size_t bucket);
+
+    static constexpr int kSubBucketBits = 5;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr size_t kBucketCount = (36 - kSubBucketBits + 1) * (kSubBuckets / 2) + kSubBuckets / 2;
+
+private:
+    static constexpr size_t kShardCount = 8;
+
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, kBucketCount> counts{};
+        std::atomic<uint64_t> sum{0};
+        std::atomic<uint64_t> max{0};
+    };
+
+    static size_t threadShard() {
+        static std::atomic<size_t> next_shard{0};
+        thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+        return shard;
+    }
+
+    std::array<Shard, kShardCount> shards_;
+};
+
+/**
+ * @brief Session phases timed next to the per-command latencies
+ */
+enum class FTPTransferPhase {
+    AUTH,               // PASS received to login decided
+    DATA_CONNECT,       // Data connection requested to established
+    FIRST_BYTE,         // Command received to first payload byte sent
+    THROUGHPUT,         // Transfer rate in KiB/s, not a duration
+    COUNT
+};
+
+} // namespace ssftpd
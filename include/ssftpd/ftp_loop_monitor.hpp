@@ -0,0 +1,185 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ssftpd/ftp_latency_histogram.hpp"
+
+namespace ssftpd {
+
+class FTPServerConfig;
+class Logger;
+
+/**
+ * @brief Health of the server's event loops
+ *
+ * Each reactor (the main loop and every scheduler worker) reports how long
+ * its iterations take, how long each handler blocks it, how many ready
+ * events it handles per iteration and how deep its queue is. A watchdog
+ * thread looks at the handlers currently running and logs a warning when
+ * one exceeds handler_budget, naming the reactor and the handler's tag
+ * stack (e.g. "session_task > command RETR"), so blocking code shows up
+ * before it turns into an outage.
+ *
+ * Reactor threads call attachThread() once; HandlerScope and TagScope then
+ * find their reactor through a thread-local pointer and do nothing on other
+ * threads.
+ */
+class FTPLoopMonitor {
+public:
+    static constexpr size_t kMaxTags = 4;
+    static constexpr size_t kMaxReactors = 256;
+
+    /**
+     * @brief Health figures of one reactor
+     */
+    struct ReactorStats {
+        std::string name;
+        FTPLatencyHistogram::Snapshot iteration_us;  ///< Busy time per iteration
+        FTPLatencyHistogram::Snapshot handler_us;    ///< Time per handler
+        FTPLatencyHistogram::Snapshot batch_size;    ///< Ready events per iteration
+        size_t queue_depth;
+        uint64_t stalls;                              ///< Handlers over budget
+    };
+
+    /**
+     * @brief Times one handler on the current reactor
+     *
+     * Nested scopes only add a tag; the outermost one is the handler.
+     */
+    class HandlerScope {
+    public:
+        explicit HandlerScope(const char* tag);
+        ~HandlerScope();
+
+        HandlerScope(const HandlerScope&) = delete;
+        HandlerScope& operator=(const HandlerScope&) = delete;
+
+    private:
+        void* reactor_;
+        bool outermost_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    /**
+     * @brief Adds a tag to the running handler's stack
+     */
+    class TagScope {
+    public:
+        /**
+         * @param tag Tag; must outlive the scope (a string literal)
+         * @param detail Up to 8 characters shown after the tag, e.g. a verb
+         */
+        explicit TagScope(const char* tag, const std::string& detail = std::string());
+        ~TagScope();
+
+        TagScope(const TagScope&) = delete;
+        TagScope& operator=(const TagScope&) = delete;
+
+    private:
+        void* reactor_;
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (handler_budget)
+     * @param logger Logger instance
+     */
+    FTPLoopMonitor(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - stops the watchdog
+     */
+    ~FTPLoopMonitor();
+
+    FTPLoopMonitor(const FTPLoopMonitor&) = delete;
+    FTPLoopMonitor& operator=(const FTPLoopMonitor&) = delete;
+
+    /**
+     * @brief Register a reactor; call before its thread attaches
+     * @param name Name used in metrics and warnings
+     * @return Reactor id; kMaxReactors if the table is full, which the
+     *         other calls ignore
+     */
+    size_t addReactor(const std::string& name);
+
+    /**
+     * @brief Bind the calling thread to a reactor
+     * @param reactor Reactor id
+     */
+    void attachThread(size_t reactor);
+
+    /**
+     * @brief Unbind the calling thread
+     */
+    static void detachThread();
+
+    /**
+     * @brief Record one loop iteration
+     * @param reactor Reactor id
+     * @param busy Time spent handling events, excluding waiting
+     * @param batch_size Ready events handled
+     */
+    void recordIteration(size_t reactor, std::chrono::steady_clock::duration busy, size_t batch_size);
+
+    /**
+     * @brief Record the reactor's current queue depth
+     * @param reactor Reactor id
+     * @param depth Queued events
+     */
+    void setQueueDepth(size_t reactor, size_t depth);
+
+    /**
+     * @brief Start the watchdog thread
+     * @return true on success
+     */
+    bool start();
+
+    /**
+     * @brief Stop the watchdog thread
+     */
+    void stop();
+
+    /**
+     * @brief Get the health figures of every reactor
+     * @return One entry per reactor, in registration order
+     */
+    std::vector<ReactorStats> getStats() const;
+
+    /**
+     * @brief Get the number of handlers that exceeded the budget
+     * @return Stall count over all reactors
+     */
+    uint64_t getStallCount() const;
+
+private:
+    struct Reactor;
+
+    Reactor* getReactor(size_t reactor) const;
+    void watchdogLoop();
+    void checkHandlers(std::chrono::steady_clock::time_point now);
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+    std::chrono::milliseconds budget_;
+
+    // Filled in order and never shrunk, so ids resolve without a lock
+    std::mutex reactors_mutex_;
+    std::array<std::unique_ptr<Reactor>, kMaxReactors> reactors_;
+    std::atomic<size_t> reactor_count_;
+
+    std::mutex watchdog_mutex_;
+    std::condition_variable watchdog_condition_;
+    std::thread watchdog_thread_;
+    bool running_;
+};
+
+} // namespace ssftpd
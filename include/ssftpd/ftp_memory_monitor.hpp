@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ssftpd {
+
+class FTPServerConfig;
+class Logger;
+
+/**
+ * @brief Process memory accounting and max_memory_usage enforcement
+ *
+ * Samples the process once per second from /proc/self/statm and, where
+ * the kernel provides it, /proc/self/smaps_rollup. The charged size is
+ * resident plus swapped memory, which is what the OOM killer weighs.
+ * Subsystems (session buffers, caches) register how much they hold and
+ * how to give memory back.
+ *
+ * Relative to max_memory_usage:
+ * - at 80% every subsystem is asked to reclaim (caches shrink, idle
+ *   buffers are dropped) and freed heap is returned to the kernel
+ * - at 95% new sessions are refused until usage is back under 80%
+ */
+class FTPMemoryMonitor {
+public:
+    enum class Pressure {
+        NORMAL,
+        RECLAIM,   ///< Subsystems are shedding memory
+        CRITICAL   ///< New sessions are refused as well
+    };
+
+    /**
+     * @brief Memory figures of the whole process, in bytes
+     *
+     * Fields read from smaps_rollup are 0 where it is not available.
+     */
+    struct ProcessMemory {
+        size_t virtual_size;
+        size_t resident;
+        size_t shared;           ///< Resident pages backed by files
+        size_t proportional;     ///< Pss: shared pages split between sharers
+        size_t private_dirty;
+        size_t anonymous;
+        size_t swap;
+    };
+
+    /**
+     * @brief Monitor metrics
+     */
+    struct Stats {
+        ProcessMemory process;
+        size_t limit;            ///< max_memory_usage; 0 = not enforced
+        Pressure pressure;
+        std::vector<std::pair<std::string, size_t>> subsystems;
+        uint64_t reclaims;       ///< Samples that triggered reclaim
+        uint64_t refused;        ///< Sessions refused for memory
+    };
+
+    using UsageFunction = std::function<size_t()>;
+    using ReclaimFunction = std::function<void()>;
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (max_memory_usage)
+     * @param logger Logger instance
+     */
+    FTPMemoryMonitor(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - stops the sampler
+     */
+    ~FTPMemoryMonitor();
+
+    FTPMemoryMonitor(const FTPMemoryMonitor&) = delete;
+    FTPMemoryMonitor& operator=(const FTPMemoryMonitor&) = delete;
+
+    /**
+     * @brief Read the process memory figures
+     * @return Current figures; all 0 if /proc is not available
+     */
+    static ProcessMemory readProcessMemory();
+
+    /**
+     * @brief Register a memory consumer; call before start()
+     * @param name Name used in metrics and log messages
+     * @param usage Returns the bytes the subsystem holds
+     * @param reclaim Gives memory back under pressure; may be empty
+     */
+    void addSubsystem(const std::string& name, UsageFunction usage, ReclaimFunction reclaim = ReclaimFunction());
+
+    /**
+     * @brief Start sampling once per second
+     * @return true on success
+     */
+    bool start();
+
+    /**
+     * @brief Stop sampling
+     */
+    void stop();
+
+    /**
+     * @brief Take one sample and act on it; called by the sampler thread
+     */
+    void update();
+
+    /**
+     * @brief Decide whether a new session may be created
+     * @return false while memory is critical
+     */
+    bool admit();
+
+    /**
+     * @brief Get the current pressure level
+     * @return Pressure level of the last sample
+     */
+    Pressure getPressure() const { return pressure_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Get monitor metrics
+     * @return Last sample and per-subsystem usage
+     */
+    Stats getStats() const;
+
+private:
+    struct Subsystem {
+        std::string name;
+        UsageFunction usage;
+        ReclaimFunction reclaim;
+    };
+
+    void samplerLoop();
+    void reclaim(size_t charged);
+    std::string describeSubsystems() const;
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+    size_t limit_;
+
+    // Registered before start(), read-only afterwards
+    std::vector<Subsystem> subsystems_;
+
+    mutable std::mutex sample_mutex_;
+    ProcessMemory process_;
+    std::atomic<Pressure> pressure_;
+    std::atomic<uint64_t> reclaims_;
+    std::atomic<uint64_t> refused_;
+
+    std::mutex sampler_mutex_;
+    std::condition_variable sampler_condition_;
+    std::thread sampler_thread_;
+    bool running_;
+};
+
+} // namespace ssftpd
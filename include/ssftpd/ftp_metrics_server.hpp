@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ssftpd/ftp_latency_histogram.hpp"
+
+namespace ssftpd {
+
+class FTPServerConfig;
+class Logger;
+
+/**
+ * @brief Appends OpenMetrics text to a fixed buffer
+ *
+ * Writes never grow the buffer. Output that does not fit is dropped and
+ * the writer is flagged as truncated.
+ */
+class FTPMetricsWriter {
+public:
+    /**
+     * @brief Constructor
+     * @param buffer Output buffer
+     * @param capacity Buffer size in bytes
+     */
+    FTPMetricsWriter(char* buffer, size_t capacity);
+
+    /**
+     * @brief Start a metric family
+     * @param name Family name, e.g. "ssftpd_connections"
+     * @param type "counter", "gauge" or "summary"
+     * @param help One-line description
+     */
+    void family(const char* name, const char* type, const char* help);
+
+    /**
+     * @brief Write a sample
+     * @param name Sample name (family name plus any suffix)
+     * @param value Value
+     * @param label Optional label name
+     * @param label_value Label value, escaped as needed
+     */
+    void sample(const char* name, uint64_t value, const char* label = nullptr,
+                const std::string& label_value = std::string());
+    void sample(const char* name, double value, const char* label = nullptr,
+                const std::string& label_value = std::string());
+
+    /**
+     * @brief Write a counter family with one sample
+     * @param name Family name; the sample gets the "_total" suffix
+     * @param help One-line description
+     * @param value Value
+     */
+    void counter(const char* name, const char* help, uint64_t value);
+
+    /**
+     * @brief Write a gauge family with one sample
+     * @param name Family name
+     * @param help One-line description
+     * @param value Value
+     */
+    void gauge(const char* name, const char* help, double value);
+
+    /**
+     * @brief Write the quantiles, sum and count of a histogram snapshot
+     *
+     * Call family(name, "summary", ...) first.
+     * @param name Family name
+     * @param snapshot Histogram snapshot
+     * @param label Optional label name
+     * @param label_value Label value
+     */
+    void summary(const char* name, const FTPLatencyHistogram::Snapshot& snapshot,
+                 const char* label = nullptr, const std::string& label_value = std::string());
+
+    /**
+     * @brief Terminate the exposition with "# EOF"
+     */
+    void finish();
+
+    size_t size() const { return length_; }
+    bool isTruncated() const { return truncated_; }
+
+private:
+    void append(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void appendLabels(const char* label, const std::string& label_value, const char* quantile);
+
+    char* buffer_;
+    size_t capacity_;
+    size_t length_;
+    bool truncated_;
+};
+
+/**
+ * @brief Minimal HTTP endpoint serving OpenMetrics text
+ *
+ * Listens on metrics_port and answers GET metrics_endpoint. It runs on the
+ * server's main loop: poll() does non-blocking accept, read and write
+ * work and never waits. Subsystems register collectors that write their
+ * metrics when a scrape arrives.
+ *
+ * One scrape is served at a time, from a render buffer allocated once at
+ * start(), so a scrape costs the same however many sessions are open.
+ * Further scrapers wait in the listen backlog; a client that stalls is
+ * dropped after a few seconds.
+ */
+class FTPMetricsServer {
+public:
+    using Collector = std::function<void(FTPMetricsWriter&)>;
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (metrics_* settings)
+     * @param logger Logger instance
+     */
+    FTPMetricsServer(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor
+     */
+    ~FTPMetricsServer();
+
+    FTPMetricsServer(const FTPMetricsServer&) = delete;
+    FTPMetricsServer& operator=(const FTPMetricsServer&) = delete;
+
+    /**
+     * @brief Open the listening socket
+     * @return true on success
+     */
+    bool start();
+
+    /**
+     * @brief Close the listening socket and any client
+     */
+    void stop();
+
+    /**
+     * @brief Add a metrics collector; call before start()
+     * @param collector Called for every scrape, on the main loop
+     */
+    void addCollector(Collector collector);
+
+    /**
+     * @brief Make progress on the current scrape, or accept the next one
+     *
+     * Call once per main loop iteration.
+     */
+    void poll();
+
+    /**
+     * @brief Get the number of scrapes served
+     * @return Scrape count
+     */
+    uint64_t getScrapeCount() const { return scrapes_.load(); }
+
+private:
+    enum class ClientState { IDLE, READING, WRITING };
+
+    static constexpr size_t kRequestBufferSize = 4096;
+    static constexpr size_t kHeaderReserve = 256;
+    static constexpr size_t kRenderBufferSize = 512 * 1024;
+
+    bool openListenSocket();
+    void acceptClient();
+    void readRequest();
+    void writeResponse();
+    void closeClient();
+    void respond(int status, const char* reason, const char* content_type, size_t body_length);
+    size_t render();
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+    std::vector<Collector> collectors_;
+
+    int listen_socket_;
+    int client_socket_;
+    ClientState state_;
+    std::chrono::steady_clock::time_point deadline_;
+
+    std::array<char, kRequestBufferSize> request_;
+    size_t request_length_;
+    std::vector<char> response_;       // Header is placed right before the body
+    size_t response_offset_;
+    size_t response_end_;
+
+    std::atomic<uint64_t> scrapes_;
+    std::chrono::microseconds last_render_time_;
+};
+
+} // namespace ssftpd
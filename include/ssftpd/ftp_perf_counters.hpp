@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace ssftpd {
+
+/**
+ * @brief Hardware and scheduler counters per FTP operation
+ *
+ * Each thread that enters an FTPPerfScope opens its own perf_event group
+ * the first time: CPU cycles, instructions, cache references and cache
+ * misses, counted in user space for that thread only. Context switches
+ * come from getrusage(RUSAGE_THREAD). The scope reads both when it starts
+ * and ends and adds the difference to its operation (an FTP verb or a
+ * transfer type and mode). Counts are scaled when the kernel multiplexes
+ * the group with other users.
+ *
+ * Where perf events are not available or not permitted (virtual machines,
+ * perf_event_paranoid, seccomp) only context switches are counted. A
+ * disabled scope costs one relaxed load.
+ */
+class FTPPerfCounters {
+public:
+    enum class Mode {
+        OFF,        ///< Disabled
+        SOFTWARE,   ///< Context switches only; perf events unavailable
+        HARDWARE    ///< Every counter
+    };
+
+    enum Counter {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_REFERENCES,
+        CACHE_MISSES,
+        CONTEXT_SWITCHES,
+        COUNTER_COUNT
+    };
+
+    /**
+     * @brief Counter totals of one operation
+     */
+    struct Totals {
+        uint64_t scopes;                   ///< Times the operation ran
+        uint64_t values[COUNTER_COUNT];
+    };
+
+    /**
+     * @brief Turn counting on or off
+     *
+     * Turning it on probes perf_event_open on the calling thread to find
+     * out whether the kernel permits hardware counters.
+     * @param enabled true to count
+     * @return Mode in effect
+     */
+    static Mode setEnabled(bool enabled);
+
+    /**
+     * @brief Check whether scopes count
+     * @return true if counting
+     */
+    static bool isEnabled() {
+        return mode_.load(std::memory_order_relaxed) != Mode::OFF;
+    }
+
+    /**
+     * @brief Get the mode in effect
+     * @return Counting mode
+     */
+    static Mode getMode() { return mode_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Merge every thread's totals
+     * @return Totals by operation name
+     */
+    static std::map<std::string, Totals> getTotals();
+
+    /**
+     * @brief Forget the totals collected so far
+     */
+    static void clear();
+
+    /**
+     * @brief Get the name of a counter
+     * @param counter Counter
+     * @return Name as used in metric names, e.g. "cache_misses"
+     */
+    static const char* counterName(Counter counter);
+
+private:
+    friend class FTPPerfScope;
+
+    // Reads the calling thread's group; false if the thread has none
+    static bool read(uint64_t values[COUNTER_COUNT]);
+    static void add(const std::string& operation, const uint64_t start[COUNTER_COUNT],
+                    const uint64_t end[COUNTER_COUNT]);
+
+    static std::atomic<Mode> mode_;
+};
+
+/**
+ * @brief Attributes the counters of its lifetime to an operation
+ *
+ * Nested scopes each get the full delta of their own lifetime, so a
+ * command's totals include the transfers it made.
+ */
+class FTPPerfScope {
+public:
+    explicit FTPPerfScope(const std::string& operation)
+        : active_(FTPPerfCounters::isEnabled())
+    {
+        if (active_ && FTPPerfCounters::read(start_)) {
+            operation_ = operation;
+        } else {
+            active_ = false;
+        }
+    }
+
+    ~FTPPerfScope() {
+        uint64_t end[FTPPerfCounters::COUNTER_COUNT];
+        if (active_ && FTPPerfCounters::read(end)) {
+            FTPPerfCounters::add(operation_, start_, end);
+        }
+    }
+
+    FTPPerfScope(const FTPPerfScope&) = delete;
+    FTPPerfScope& operator=(const FTPPerfScope&) = delete;
+
+private:
+    bool active_;
+    std::string operation_;
+    uint64_t start_[FTPPerfCounters::COUNTER_COUNT];
+};
+
+} // namespace ssftpd
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ssftpd {
+
+/**
+ * @brief Per-second, per-minute and per-hour history of one counter
+ *
+ * Fed with the counter's running total once per second; the difference
+ * to the previous total becomes the newest one-second bucket. Every 60
+ * seconds roll up into a minute bucket and every 60 minutes into an hour
+ * bucket, so the series keeps the last minute at one-second resolution,
+ * the last hour per minute and the last day per hour in fixed memory.
+ *
+ * advance() is O(1) per elapsed second; reads are O(window). Not
+ * thread-safe; callers provide their own locking.
+ */
+class FTPRateSeries {
+public:
+    enum class Resolution { SECOND, MINUTE, HOUR };
+
+    static constexpr size_t kSeconds = 60;
+    static constexpr size_t kMinutes = 60;
+    static constexpr size_t kHours = 24;
+
+    FTPRateSeries();
+
+    /**
+     * @brief Record the counter's total at a second boundary
+     * @param total Running total of the counter
+     * @param second Seconds since the series started; seconds skipped
+     *               since the last call get empty buckets
+     */
+    void advance(uint64_t total, int64_t second);
+
+    /**
+     * @brief Get the average rate over a recent window
+     *
+     * Windows up to a minute use the one-second buckets, up to an hour
+     * the minute buckets, and longer ones the hour buckets. Windows longer
+     * than the history kept so far are averaged over what exists.
+     * @param window Window length
+     * @return Events per second
+     */
+    double getRate(std::chrono::seconds window) const;
+
+    /**
+     * @brief Get the completed buckets of one resolution
+     * @param resolution Bucket size
+     * @return Bucket totals, oldest first
+     */
+    std::vector<uint64_t> getBuckets(Resolution resolution) const;
+
+    /**
+     * @brief Forget the history and start over from a total
+     * @param total Running total of the counter now
+     */
+    void reset(uint64_t total = 0);
+
+private:
+    template <size_t N>
+    struct Ring {
+        std::array<uint64_t, N> values{};
+        size_t head = 0;     // Next slot to write
+        size_t filled = 0;
+
+        void push(uint64_t value) {
+            values[head] = value;
+            head = (head + 1) % N;
+            filled = filled < N ? filled + 1 : N;
+        }
+
+        uint64_t sumLast(size_t count) const {
+            uint64_t sum = 0;
+            for (size_t i = 1; i <= count && i <= filled; ++i) {
+                sum += values[(head + N - i) % N];
+            }
+            return sum;
+        }
+
+        std::vector<uint64_t> ordered() const {
+            std::vector<uint64_t> result;
+            result.reserve(filled);
+            for (size_t i = filled; i > 0; --i) {
+                result.push_back(values[(head + N - i) % N]);
+            }
+            return result;
+        }
+    };
+
+    void pushSecond(uint64_t count);
+
+    Ring<kSeconds> seconds_;
+    Ring<kMinutes> minutes_;
+    Ring<kHours> hours_;
+
+    uint64_t last_total_;
+    int64_t last_second_;
+    uint64_t minute_sum_;
+    size_t seconds_in_minute_;
+    uint64_t hour_sum_;
+    size_t minutes_in_hour_;
+};
+
+} // namespace ssftpd
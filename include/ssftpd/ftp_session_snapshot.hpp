@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ssftpd/ftp_epoch.hpp"
+#include "ssftpd/ftp_ip_key.hpp"
+
+namespace ssftpd {
+
+/**
+ * @brief Plain copy of one session's metadata
+ */
+struct FTPSessionInfo {
+    uint64_t session_id;
+    FTPIPKey client_key;
+    std::string username;
+    std::string virtual_host;
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point last_activity;
+    uint64_t bytes_transferred;
+    uint64_t commands_executed;
+};
+
+/**
+ * @brief Immutable view of every session at one point in time
+ */
+struct FTPSessionSnapshot {
+    uint64_t version;
+    std::chrono::steady_clock::time_point published_at;
+    std::vector<FTPSessionInfo> sessions;
+};
+
+/**
+ * @brief Publishes session snapshots for lock-free readers
+ *
+ * A writer builds a complete snapshot off to the side and swaps it in with
+ * one atomic store. Readers iterate the current snapshot inside a
+ * ReadHandle, which pins an epoch instead of taking a lock or touching any
+ * session refcount. Superseded snapshots are freed once no reader can still
+ * see them.
+ */
+class FTPSessionSnapshotPublisher {
+public:
+    /**
+     * @brief Read access to the current snapshot
+     *
+     * The snapshot stays valid for the lifetime of the handle. Keep handles
+     * short-lived; a long-lived handle delays reclamation of old snapshots.
+     */
+    class ReadHandle {
+    public:
+        explicit ReadHandle(const FTPSessionSnapshotPublisher& publisher);
+
+        const FTPSessionSnapshot& operator*() const { return *snapshot_; }
+        const FTPSessionSnapshot* operator->() const { return snapshot_; }
+
+    private:
+        FTPEpochDomain::Guard guard_;
+        const FTPSessionSnapshot* snapshot_;
+    };
+
+    /**
+     * @brief Constructor - publishes an empty snapshot
+     */
+    FTPSessionSnapshotPublisher();
+
+    /**
+     * @brief Destructor
+     */
+    ~FTPSessionSnapshotPublisher();
+
+    FTPSessionSnapshotPublisher(const FTPSessionSnapshotPublisher&) = delete;
+    FTPSessionSnapshotPublisher& operator=(const FTPSessionSnapshotPublisher&) = delete;
+
+    /**
+     * @brief Replace the current snapshot
+     *
+     * Assigns the version and publish time. Single writer.
+     * @param sessions Session metadata for the new snapshot
+     */
+    void publish(std::vector<FTPSessionInfo> sessions);
+
+    /**
+     * @brief Get read access to the current snapshot
+     * @return Read handle
+     */
+    ReadHandle read() const { return ReadHandle(*this); }
+
+    /**
+     * @brief Get the version of the current snapshot
+     * @return Snapshot version
+     */
+    uint64_t version() const;
+
+private:
+    FTPEpochDomain epoch_;
+    std::atomic<const FTPSessionSnapshot*> current_;
+    uint64_t next_version_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ssftpd {
+
+/**
+ * @brief Group of monotonic counters split into per-thread shards
+ *
+ * Each thread is assigned one cache-line-aligned shard on first use and
+ * only ever adds to that shard, so increments from different threads never
+ * touch the same cache line. Reads sum every shard, which makes them
+ * slower but keeps the increment path free of contention. With more threads
+ * than shards, threads share shards round-robin; the counts stay exact.
+ *
+ * @tparam N Number of counters in the group
+ * @tparam ShardCount Number of shards; fewer shards save memory for
+ *                    groups that exist many times over
+ */
+template <size_t N, size_t ShardCount = 64>
+class FTPShardedCounters {
+public:
+    static constexpr size_t kShardCount = ShardCount;
+
+    /**
+     * @brief Add to a counter
+     * @param counter Counter index, below N
+     * @param value Amount to add
+     */
+    void add(size_t counter, uint64_t value = 1) {
+        shards_[threadShard()].values[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Sum a counter over every shard
+     * @param counter Counter index, below N
+     * @return Counter value
+     */
+    uint64_t get(size_t counter) const {
+        uint64_t total = 0;
+        for (const auto& shard : shards_) {
+            total += shard.values[counter].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    /**
+     * @brief Sum every counter in one pass over the shards
+     * @return Counter values
+     */
+    std::array<uint64_t, N> getAll() const {
+        std::array<uint64_t, N> totals{};
+        for (const auto& shard : shards_) {
+            for (size_t i = 0; i < N; ++i) {
+                totals[i] += shard.values[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+    /**
+     * @brief Zero every counter
+     *
+     * Increments racing the reset may survive it.
+     */
+    void reset() {
+        for (auto& shard : shards_) {
+            for (auto& value : shard.values) {
+                value.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, N> values{};
+    };
+
+    static size_t threadShard() {
+        static std::atomic<size_t> next_shard{0};
+        thread_local size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % kShardCount;
+        return shard;
+    }
+
+    std::array<Shard, kShardCount> shards_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "ssftpd/ftp_ip_key.hpp"
+#include "ssftpd/ftp_sliding_window.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Rate-limit and ban state shared by every ssftpd process on a host
+ *
+ * Lives in a named POSIX shared memory object, so workers started
+ * independently (e.g. several processes on one port with SO_REUSEPORT)
+ * enforce one per-IP budget and see each other's bans, with no IPC round
+ * trips. The table is open addressing with linear probing over fixed
+ * 128-byte slots; every field is a lock-free atomic, so a process that dies
+ * mid-update cannot leave a lock held.
+ *
+ * Slots are keyed by a 64-bit SipHash of the address under a random key
+ * that the creating process stores in the table. Clients choose their
+ * addresses (a /64 holds 2^64 of them), so an unkeyed hash would let one
+ * compute an address sharing a victim's budget and bans. Slots are never
+ * emptied; an idle, unbanned slot is taken over by a new address whose
+ * probe finds no free slot. A takeover racing an update of the old address
+ * can misattribute that one event.
+ *
+ * The steady clock is system-wide on Linux, so all processes agree on the
+ * window boundaries and ban expiry times.
+ */
+class FTPSharedRateTable {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Per-address counters; all processes update the same slot
+     */
+    struct alignas(64) Slot {
+        std::atomic<uint64_t> fingerprint;     // 0 = empty
+        std::atomic<int64_t> banned_until;     // Steady-clock nanoseconds
+        std::atomic<int64_t> last_used;        // Steady-clock nanoseconds
+        FTPAtomicSlidingWindow connections;
+        FTPAtomicSlidingWindow requests;
+        FTPAtomicSlidingWindow failed_logins;
+
+        /**
+         * @brief Check if the address is banned
+         * @param now Current time
+         * @return true if banned
+         */
+        bool isBanned(Clock::time_point now) const {
+            return banned_until.load(std::memory_order_relaxed) > now.time_since_epoch().count();
+        }
+    };
+
+    /**
+     * @brief Constructor
+     * @param logger Logger instance
+     */
+    explicit FTPSharedRateTable(std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - unmaps the table (the object itself stays)
+     */
+    ~FTPSharedRateTable();
+
+    FTPSharedRateTable(const FTPSharedRateTable&) = delete;
+    FTPSharedRateTable& operator=(const FTPSharedRateTable&) = delete;
+
+    /**
+     * @brief Create or attach to the shared table
+     *
+     * The first process creates the object with slot_count slots; later
+     * ones attach to it and use its size.
+     * @param name Shared memory name, e.g. "/ssftpd-ratelimit"
+     * @param slot_count Slots to create (rounded up to a power of two)
+     * @return false if the table cannot be created or has another layout
+     */
+    bool open(const std::string& name, size_t slot_count);
+
+    /**
+     * @brief Check if the table is attached
+     * @return true after a successful open()
+     */
+    bool isOpen() const { return header_ != nullptr; }
+
+    /**
+     * @brief Find the slot of an address, claiming one if needed
+     * @param key Client address
+     * @param now Current time
+     * @param idle_after A slot with no events for this long may be reused
+     * @return Slot, or nullptr if the probe window is full
+     */
+    Slot* acquire(const FTPIPKey& key, Clock::time_point now, Clock::duration idle_after);
+
+    /**
+     * @brief Find the slot of an address without claiming one
+     * @param key Client address
+     * @return Slot, or nullptr if the address has none
+     */
+    Slot* find(const FTPIPKey& key) const;
+
+    /**
+     * @brief Get the connection counter shared by all addresses
+     * @return Global connection window
+     */
+    FTPAtomicSlidingWindow& globalConnections();
+
+    /**
+     * @brief Get the number of slots
+     * @return Slot count
+     */
+    size_t getSlotCount() const;
+
+private:
+    struct Header;
+
+    static constexpr size_t kMaxProbe = 32;
+
+    uint64_t fingerprintOf(const FTPIPKey& key) const;
+    static bool isIdle(const Slot& slot, Clock::time_point now, Clock::duration idle_after);
+    void close();
+
+    std::shared_ptr<Logger> logger_;
+    Header* header_;
+    Slot* slots_;
+    size_t mapped_size_;
+    size_t slot_mask_;
+};
+
+} // namespace ssftpd
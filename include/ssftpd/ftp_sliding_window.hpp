@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ssftpd {
+
+/**
+ * @brief Fixed-size sliding-window event counter
+ *
+ * Keeps the event count of the current and the previous fixed window. The
+ * sliding count is the current count plus the previous count weighted by
+ * how much of the previous window still overlaps the sliding window. This
+ * takes constant memory and time per key regardless of the event rate.
+ * The estimate assumes events were evenly spread over the previous window.
+ */
+struct FTPSlidingWindow {
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point window_start{};
+    uint64_t current = 0;
+    uint64_t previous = 0;
+
+    /**
+     * @brief Count events in the sliding window ending now
+     * @param now Current time
+     * @param window Window length
+     * @return Estimated number of events
+     */
+    uint64_t count(Clock::time_point now, Clock::duration window) const {
+        auto elapsed = now - window_start;
+        if (elapsed >= 2 * window) {
+            return 0;
+        }
+        if (elapsed >= window) {
+            // The current bucket has become the previous one
+            return weighted(current, elapsed - window, window);
+        }
+        return current + weighted(previous, elapsed, window);
+    }
+
+    /**
+     * @brief Record one event
+     * @param now Current time
+     * @param window Window length
+     */
+    void add(Clock::time_point now, Clock::duration window) {
+        advance(now, window);
+        current++;
+    }
+
+    /**
+     * @brief Check if no event is left in the sliding window
+     * @param now Current time
+     * @param window Window length
+     * @return true if the counter can be discarded
+     */
+    bool expired(Clock::time_point now, Clock::duration window) const {
+        return now - window_start >= 2 * window;
+    }
+
+private:
+    void advance(Clock::time_point now, Clock::duration window) {
+        auto elapsed = now - window_start;
+        if (elapsed < window) {
+            return;
+        }
+
+        if (elapsed < 2 * window) {
+            previous = current;
+            window_start += window;
+        } else {
+            previous = 0;
+            window_start = now;
+        }
+        current = 0;
+    }
+
+    static uint64_t weighted(uint64_t events, Clock::duration into_window, Clock::duration window) {
+        // Share of the older bucket still inside the sliding window
+        auto remaining = window - into_window;
+        return static_cast<uint64_t>(
+            static_cast<double>(events) * remaining.count() / window.count());
+    }
+};
+
+/**
+ * @brief Lock-free sliding-window counter for one shared key
+ *
+ * Same two-bucket estimate as FTPSlidingWindow, with windows aligned to
+ * multiples of the window length so any thread can rotate the buckets with
+ * one CAS. Events racing a rotation may land in either bucket, which only
+ * shifts the estimate by those few events.
+ */
+class FTPAtomicSlidingWindow {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Record an event unless the limit is already reached
+     * @param now Current time
+     * @param window Window length
+     * @param limit Maximum events per sliding window
+     * @return true if the event was recorded
+     */
+    bool tryAdd(Clock::time_point now, Clock::duration window, uint64_t limit) {
+        int64_t index = windowIndex(now, window);
+        rotate(index);
+
+        // Reserve first, then back out, so concurrent callers cannot all
+        // slip in under the limit
+        current_.fetch_add(1);
+        if (count(now, window) > limit) {
+            uint64_t value = current_.load();
+            while (value > 0 && !current_.compare_exchange_weak(value, value - 1)) {
+            }
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Count events in the sliding window ending now
+     * @param now Current time
+     * @param window Window length
+     * @return Estimated number of events
+     */
+    uint64_t count(Clock::time_point now, Clock::duration window) const {
+        int64_t index = windowIndex(now, window);
+        int64_t seen = index_.load();
+        auto into_window = now.time_since_epoch() - index * window;
+        double remaining = 1.0 - static_cast<double>(into_window.count()) / window.count();
+
+        if (index == seen) {
+            return current_.load() + static_cast<uint64_t>(previous_.load() * remaining);
+        }
+        if (index == seen + 1) {
+            return static_cast<uint64_t>(current_.load() * remaining);
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Forget every event
+     */
+    void reset() {
+        current_.store(0);
+        previous_.store(0);
+    }
+
+private:
+    static int64_t windowIndex(Clock::time_point now, Clock::duration window) {
+        return static_cast<int64_t>(now.time_since_epoch() / window);
+    }
+
+    void rotate(int64_t index) {
+        int64_t seen = index_.load();
+        while (seen < index) {
+            if (index_.compare_exchange_weak(seen, index)) {
+                uint64_t events = current_.exchange(0);
+                previous_.store(index == seen + 1 ? events : 0);
+                return;
+            }
+        }
+    }
+
+    std::atomic<int64_t> index_{0};
+    std::atomic<uint64_t> current_{0};
+    std::atomic<uint64_t> previous_{0};
+};
+
+} // namespace ssftpd
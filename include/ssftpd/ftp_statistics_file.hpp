@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ssftpd {
+
+/**
+ * @brief Memory-mapped file holding the latest statistics snapshot
+ *
+ * The server publishes its counters into the mapping and reloads them from
+ * it on the next start, so lifetime totals survive restarts and upgrades.
+ * Monitoring tools can map the same file read-only and poll it without
+ * talking to the server.
+ *
+ * Layout, version 1 (host byte order):
+ *
+ *   header, 64 bytes:  char magic[8] = "SSFTPDST", u32 version,
+ *                      u32 header size, u32 slot size, u32 value count,
+ *                      i64 creation time (unix), 32 reserved bytes
+ *   slot[2], each:     u64 generation, i64 update time (unix),
+ *                      u64 values[kMaxValues], u64 FNV-1a checksum
+ *
+ * Each publish writes the older slot: it clears the slot's generation,
+ * writes the values and checksum, then stores a generation one higher than
+ * the other slot's. The newest slot whose generation is unchanged across
+ * the read and whose checksum matches is the current snapshot. A crash or
+ * power loss part-way through a publish therefore leaves the previous
+ * snapshot intact.
+ */
+class FTPStatisticsFile {
+public:
+    static constexpr size_t kMaxValues = 32;
+
+    using Values = std::array<uint64_t, kMaxValues>;
+
+    FTPStatisticsFile();
+    ~FTPStatisticsFile();
+
+    FTPStatisticsFile(const FTPStatisticsFile&) = delete;
+    FTPStatisticsFile& operator=(const FTPStatisticsFile&) = delete;
+
+    /**
+     * @brief Map the file, creating or reinitializing it if needed
+     *
+     * A writer replaces a file with a foreign or incompatible layout.
+     * @param path File path
+     * @param read_only Map for reading only; the file must already exist
+     * @return true on success; see getError() otherwise
+     */
+    bool open(const std::string& path, bool read_only = false);
+
+    /**
+     * @brief Unmap the file
+     */
+    void close();
+
+    /**
+     * @brief Read the latest consistent snapshot
+     * @param values Receives the values
+     * @param updated Receives the snapshot's unix time, if not null
+     * @return false if no snapshot has been published yet
+     */
+    bool load(Values& values, int64_t* updated = nullptr) const;
+
+    /**
+     * @brief Publish a snapshot; not safe against concurrent publishers
+     * @param values Values to store
+     */
+    void publish(const Values& values);
+
+    /**
+     * @brief Flush the mapping to disk
+     * @param wait Block until written (MS_SYNC) instead of scheduling it
+     * @return true on success
+     */
+    bool sync(bool wait);
+
+    bool isOpen() const { return header_ != nullptr; }
+    const std::string& getError() const { return error_; }
+
+private:
+    struct Header;
+    struct Slot;
+
+    bool readSlot(const Slot& slot, Values& values, uint64_t& generation, int64_t& updated) const;
+    bool fail(const std::string& message);
+
+    Header* header_;
+    Slot* slots_;
+    size_t mapped_size_;
+    bool read_only_;
+    uint64_t generation_;
+    std::string error_;
+};
+
+} // namespace ssftpd
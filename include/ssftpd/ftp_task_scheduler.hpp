@@ -0,0 +1,176 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/work_stealing_deque.hpp"
+
+namespace ssftpd {
+
+class FTPLoopMonitor;
+class Logger;
+
+/**
+ * @brief Work-stealing scheduler sized by thread_pool_size
+ *
+ * Each worker owns a Chase-Lev deque. Tasks submitted from a worker go to
+ * its own deque. Tasks submitted from other threads (the main loop) go to a
+ * global injection queue. An idle worker drains its own deque first, then
+ * the injection queue, then steals from the other workers. Busy workers
+ * therefore shed work to idle ones without a central lock on the hot path.
+ */
+class FTPTaskScheduler {
+public:
+    /**
+     * @brief Kind of work, used for accounting
+     */
+    enum class TaskClass {
+        SESSION,     ///< Control connection events
+        FILESYSTEM,  ///< Directory listings, file I/O
+        HASHING      ///< Checksums and other CPU-bound work
+    };
+
+    static constexpr size_t kTaskClassCount = 3;
+
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Scheduler metrics
+     */
+    struct Stats {
+        size_t workers;
+        size_t queued;                                ///< Tasks not yet started
+        uint64_t submitted;
+        uint64_t executed;
+        uint64_t stolen;                              ///< Tasks taken from another worker
+        uint64_t injected;                            ///< Tasks taken from the injection queue
+        uint64_t dropped;                             ///< Tasks discarded at stop
+        uint64_t executed_by_class[kTaskClassCount];
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (thread_pool_size)
+     * @param logger Logger instance
+     */
+    FTPTaskScheduler(std::shared_ptr<FTPServerConfig> config,
+                     std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - stops the workers
+     */
+    ~FTPTaskScheduler();
+
+    FTPTaskScheduler(const FTPTaskScheduler&) = delete;
+    FTPTaskScheduler& operator=(const FTPTaskScheduler&) = delete;
+
+    /**
+     * @brief Report worker health to a loop monitor; call before start()
+     * @param monitor Loop monitor; each worker registers as "worker-N"
+     */
+    void setLoopMonitor(std::shared_ptr<FTPLoopMonitor> monitor);
+
+    /**
+     * @brief Start the worker threads
+     * @return true if started successfully
+     */
+    bool start();
+
+    /**
+     * @brief Stop the workers; queued tasks that have not started are dropped
+     */
+    void stop();
+
+    /**
+     * @brief Queue a task
+     * @param task Task to run
+     * @param task_class Kind of work
+     * @return false if the scheduler is not running
+     */
+    bool submit(Task task, TaskClass task_class = TaskClass::SESSION);
+
+    /**
+     * @brief Get scheduler metrics
+     * @return Snapshot of the scheduler metrics
+     */
+    Stats getStats() const;
+
+    /**
+     * @brief Get the number of tasks queued but not yet started
+     * @return Queued task count
+     */
+    size_t getQueuedCount() const;
+
+    /**
+     * @brief Get the number of tasks of one class queued or running
+     * @param task_class Kind of work
+     * @return Unfinished task count
+     */
+    size_t getInFlight(TaskClass task_class) const;
+
+    /**
+     * @brief Get the number of workers
+     * @return Worker count
+     */
+    size_t getWorkerCount() const { return worker_count_; }
+
+    /**
+     * @brief Check if the scheduler is running
+     * @return true if running
+     */
+    bool isRunning() const { return running_.load(); }
+
+private:
+    struct Job {
+        Task task;
+        TaskClass task_class;
+    };
+
+    struct alignas(64) Worker {
+        WorkStealingDeque<Job*> deque;
+        std::thread thread;
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> injected{0};
+        uint64_t rng_state = 0;
+    };
+
+    void workerLoop(size_t index);
+    Job* findWork(Worker& worker, size_t index);
+    Job* popInjected();
+    void run(Worker& worker, Job* job);
+    void wakeWorker();
+    size_t drain();
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    std::atomic<bool> running_;
+    size_t worker_count_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::shared_ptr<FTPLoopMonitor> loop_monitor_;
+    std::vector<size_t> reactor_ids_;  ///< Loop monitor reactor per worker
+
+    mutable std::mutex injection_mutex_;
+    std::deque<Job*> injection_queue_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_condition_;
+    std::atomic<size_t> sleeping_;
+    std::atomic<int64_t> pending_;  ///< May dip below zero briefly: a job can run before submit counts it
+
+    std::atomic<uint64_t> submitted_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<uint64_t> executed_by_class_[kTaskClassCount];
+    std::atomic<int64_t> in_flight_by_class_[kTaskClassCount];
+};
+
+} // namespace ssftpd
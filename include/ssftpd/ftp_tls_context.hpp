@@ -0,0 +1,85 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/ftp_tls_session_cache.hpp"
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Server TLS context for FTPS control and data channels
+ *
+ * Owns the OpenSSL server context built from the [ssl] configuration and
+ * the session cache attached to it. A single context is shared by every
+ * control and data connection so that data channels can resume the
+ * control channel's session.
+ */
+class FTPTLSContext {
+public:
+    /**
+     * @brief Constructor
+     * @param config Server configuration
+     * @param logger Logger instance
+     */
+    FTPTLSContext(std::shared_ptr<FTPServerConfig> config,
+                  std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor
+     */
+    ~FTPTLSContext();
+
+    FTPTLSContext(const FTPTLSContext&) = delete;
+    FTPTLSContext& operator=(const FTPTLSContext&) = delete;
+
+    /**
+     * @brief Create the SSL context and load certificates
+     * @return true if initialized successfully
+     */
+    bool initialize();
+
+    /**
+     * @brief Create a server-side TLS connection bound to a socket
+     * @param socket Connected socket
+     * @return New TLS connection, or nullptr on failure (caller owns it)
+     */
+    ssl_st* createConnection(int socket) const;
+
+    /**
+     * @brief Check that a data channel resumed the control channel session
+     * @param control Control channel TLS connection
+     * @param data Data channel TLS connection
+     * @return true if the data channel may be used
+     */
+    bool verifyDataChannel(ssl_st* control, ssl_st* data);
+
+    /**
+     * @brief Periodic maintenance (ticket key rotation, session expiry)
+     */
+    void tick();
+
+    /**
+     * @brief Get the underlying OpenSSL context
+     * @return SSL context, or nullptr if not initialized
+     */
+    ssl_ctx_st* getContext() const { return ctx_; }
+
+    /**
+     * @brief Get the shared session cache
+     * @return Session cache
+     */
+    std::shared_ptr<FTPTLSSessionCache> getSessionCache() const { return session_cache_; }
+
+private:
+    std::string getOpenSSLError() const;
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+    ssl_ctx_st* ctx_;
+    std::shared_ptr<FTPTLSSessionCache> session_cache_;
+};
+
+} // namespace ssftpd
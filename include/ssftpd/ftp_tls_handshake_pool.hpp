@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ssftpd/ftp_server_config.hpp"
+
+struct ssl_st;
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Bounded worker pool that runs TLS handshakes off the reactor
+ *
+ * RSA/ECDHE handshakes are expensive enough that running them inline would
+ * stall every other session on the reactor thread during a login burst.
+ * Connections hand their TLS object to this pool and stay parked (the
+ * reactor does not touch them) until the completion callback fires.
+ *
+ * Handshake steps run on the crypto workers. When OpenSSL needs more data
+ * the job is parked on a poller thread instead of blocking a worker, so a
+ * small number of workers can carry many slow clients.
+ */
+class FTPTLSHandshakePool {
+public:
+    /**
+     * @brief Handshake outcome reported to the completion callback
+     */
+    enum class Result {
+        COMPLETED,  ///< Handshake finished successfully
+        FAILED,     ///< Protocol or I/O error
+        TIMED_OUT,  ///< Client did not finish within the handshake timeout
+        CANCELLED   ///< Pool stopped before the handshake finished
+    };
+
+    /**
+     * @brief Completion callback, invoked once per submitted handshake
+     *
+     * Runs on a pool thread; it must only flag the connection for the
+     * reactor, not perform I/O itself.
+     */
+    using Completion = std::function<void(ssl_st* ssl, Result result)>;
+
+    /**
+     * @brief Pool metrics
+     */
+    struct Stats {
+        size_t queue_depth;          ///< Jobs waiting for a worker
+        size_t parked;               ///< Jobs waiting for socket readiness
+        size_t in_flight;            ///< All admitted, unfinished handshakes
+        uint64_t completed;
+        uint64_t failed;
+        uint64_t timed_out;
+        uint64_t cancelled;          ///< Unfinished when the pool stopped
+        uint64_t rejected;           ///< Refused because the pool was full
+        uint64_t latency_count;
+        uint64_t latency_total_us;   ///< Sum of submit-to-completion times
+        uint64_t latency_max_us;
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (ssl.handshake_* settings)
+     * @param logger Logger instance
+     */
+    FTPTLSHandshakePool(std::shared_ptr<FTPServerConfig> config,
+                        std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - stops the pool
+     */
+    ~FTPTLSHandshakePool();
+
+    FTPTLSHandshakePool(const FTPTLSHandshakePool&) = delete;
+    FTPTLSHandshakePool& operator=(const FTPTLSHandshakePool&) = delete;
+
+    /**
+     * @brief Start the worker and poller threads
+     * @return true if started successfully
+     */
+    bool start();
+
+    /**
+     * @brief Stop the pool; unfinished handshakes complete as CANCELLED
+     */
+    void stop();
+
+    /**
+     * @brief Queue a server-side handshake
+     *
+     * The socket is switched to non-blocking mode if it is not already:
+     * handshake steps must return WANT_READ/WANT_WRITE so the job can be
+     * parked instead of holding a crypto worker while the client is slow.
+     * @param ssl TLS connection in accept state (ownership stays with caller)
+     * @param socket Socket the TLS connection is bound to
+     * @param done Completion callback
+     * @return false if the pool is full or not running (caller should
+     *         answer the client and close)
+     */
+    bool submit(ssl_st* ssl, int socket, Completion done);
+
+    /**
+     * @brief Get pool metrics
+     * @return Snapshot of the pool metrics
+     */
+    Stats getStats() const;
+
+    /**
+     * @brief Check if the pool is running
+     * @return true if running
+     */
+    bool isRunning() const { return running_.load(); }
+
+private:
+    struct Job {
+        ssl_st* ssl;
+        int socket;
+        Completion done;
+        std::chrono::steady_clock::time_point submitted;
+        std::chrono::steady_clock::time_point deadline;
+        short wait_events;
+    };
+
+    void workerLoop();
+    void pollerLoop();
+    void runStep(std::unique_ptr<Job> job);
+    void park(std::unique_ptr<Job> job, short events);
+    void enqueue(std::unique_ptr<Job> job);
+    void finish(std::unique_ptr<Job> job, Result result);
+    void wakePoller();
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    std::atomic<bool> running_;
+    size_t worker_count_;
+    size_t max_in_flight_;
+    std::chrono::milliseconds handshake_timeout_;
+
+    std::vector<std::thread> workers_;
+    std::thread poller_;
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_condition_;
+    std::deque<std::unique_ptr<Job>> run_queue_;
+
+    std::mutex park_mutex_;
+    std::vector<std::unique_ptr<Job>> incoming_parked_;
+    int wake_pipe_[2];
+
+    std::atomic<size_t> in_flight_;
+    std::atomic<size_t> parked_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> timed_out_;
+    std::atomic<uint64_t> cancelled_;
+    std::atomic<uint64_t> rejected_;
+    std::atomic<uint64_t> latency_count_;
+    std::atomic<uint64_t> latency_total_us_;
+    std::atomic<uint64_t> latency_max_us_;
+};
+
+} // namespace ssftpd
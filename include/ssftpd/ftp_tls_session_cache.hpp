@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "ssftpd/ftp_server_config.hpp"
+
+// Forward declarations of the OpenSSL types so callers do not need the
+// OpenSSL headers just to hold a cache pointer.
+struct ssl_st;
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+namespace ssftpd {
+
+class Logger;
+
+/**
+ * @brief Server-wide TLS session cache shared by control and data channels
+ *
+ * FTPS clients open a new data connection for every transfer and listing.
+ * This cache lets those connections resume the control channel's session
+ * instead of paying for a full handshake each time. Sessions are kept in
+ * lock-striped shards keyed by session id so reactor threads rarely contend,
+ * and stateless session tickets are encrypted with keys that are rotated on
+ * a fixed interval (the previous key is kept so outstanding tickets still
+ * decrypt).
+ *
+ * Every ticket carries a random nonce of the control connection that
+ * issued it (tickets from a resumed connection inherit the nonce they
+ * resumed with). verifyDataChannel() compares it under TLS 1.3, where a
+ * resumed session no longer shares key material with the original one, so
+ * a ticket from another user's control connection is refused.
+ */
+class FTPTLSSessionCache {
+public:
+    /**
+     * @brief Cache counters
+     */
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stores;
+        uint64_t evictions;
+        uint64_t expirations;
+        uint64_t ticket_rotations;
+        uint64_t data_channel_rejections;
+        size_t entries;
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (ssl section)
+     * @param logger Logger instance
+     */
+    FTPTLSSessionCache(std::shared_ptr<FTPServerConfig> config,
+                       std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor - releases every cached session
+     */
+    ~FTPTLSSessionCache();
+
+    FTPTLSSessionCache(const FTPTLSSessionCache&) = delete;
+    FTPTLSSessionCache& operator=(const FTPTLSSessionCache&) = delete;
+
+    /**
+     * @brief Install the cache and ticket key callbacks on an SSL context
+     * @param ctx Server SSL context
+     * @return true if the callbacks were installed
+     */
+    bool attach(ssl_ctx_st* ctx);
+
+    /**
+     * @brief Periodic maintenance: rotate ticket keys and expire sessions
+     *
+     * Cheap enough to call from every main loop iteration; it only does
+     * work once per second. Must be called from a single thread.
+     */
+    void tick();
+
+    /**
+     * @brief Generate a new ticket key and demote the current one
+     * @return true if a new key was generated
+     */
+    bool rotateTicketKeys();
+
+    /**
+     * @brief Check that a data channel resumed the control channel session
+     * @param control Control channel TLS connection
+     * @param data Data channel TLS connection (handshake completed)
+     * @return true if the data channel may be used
+     */
+    bool verifyDataChannel(ssl_st* control, ssl_st* data);
+
+    /**
+     * @brief Remove every cached session
+     */
+    void clear();
+
+    /**
+     * @brief Evict least recently used sessions to free memory
+     * @param keep_percent Share of each shard's sessions to keep
+     * @return Number of sessions evicted
+     */
+    size_t trim(size_t keep_percent);
+
+    /**
+     * @brief Estimate the memory held by cached sessions
+     * @return Approximate bytes, kEstimatedEntryBytes per session
+     */
+    size_t getMemoryUsage() const;
+
+    /**
+     * @brief Get the number of cached sessions
+     * @return Number of sessions across all shards
+     */
+    size_t size() const;
+
+    /**
+     * @brief Get cache counters
+     * @return Snapshot of the cache counters
+     */
+    Stats getStats() const;
+
+private:
+    static constexpr size_t kShardCount = 16;
+    static constexpr size_t kMaxSessionIdLength = 32;
+    // An SSL_SESSION without a peer certificate plus its index entries
+    static constexpr size_t kEstimatedEntryBytes = 1024;
+
+    struct Entry {
+        ssl_session_st* session;
+        std::chrono::steady_clock::time_point expires;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, Entry> sessions;
+        std::list<std::string> lru; // front = most recently used
+    };
+
+    // Per-connection ex_data, freed with the SSL object
+    struct SessionBinding {
+        unsigned char nonce[16];
+    };
+
+    struct TicketKey {
+        unsigned char name[16];
+        unsigned char aes_key[32];
+        unsigned char hmac_key[32];
+    };
+
+    // OpenSSL callbacks
+    static int newSessionCallback(ssl_st* ssl, ssl_session_st* session);
+    static ssl_session_st* getSessionCallback(ssl_st* ssl, const unsigned char* id,
+                                              int id_length, int* copy);
+    static void removeSessionCallback(ssl_ctx_st* ctx, ssl_session_st* session);
+    static int generateTicketCallback(ssl_st* ssl, void* arg);
+    static FTPTLSSessionCache* fromContext(ssl_ctx_st* ctx);
+    static int contextIndex();
+    static int bindingIndex();
+
+    bool storeSession(ssl_session_st* session);
+    ssl_session_st* lookupSession(const unsigned char* id, size_t id_length);
+    void removeSession(const unsigned char* id, size_t id_length);
+    void expireSessions();
+
+    Shard& shardFor(const std::string& key);
+
+    // Selects the ticket key for a handshake; returns 0 for an unknown key,
+    // 1 to use the key, 2 to use it and re-issue the ticket with the
+    // current key (ticket was encrypted with the previous one).
+    int selectTicketKey(unsigned char key_name[16], TicketKey& key, bool encrypt);
+
+    // OpenSSL-version specific ticket callback trampolines
+    friend struct TicketKeyCallbacks;
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    std::array<Shard, kShardCount> shards_;
+    size_t max_entries_per_shard_;
+    std::chrono::seconds session_timeout_;
+
+    std::mutex ticket_mutex_;
+    TicketKey current_ticket_key_;
+    TicketKey previous_ticket_key_;
+    bool has_previous_ticket_key_;
+    std::chrono::seconds ticket_rotation_interval_;
+    std::chrono::steady_clock::time_point last_rotation_;
+    std::chrono::steady_clock::time_point last_tick_;
+
+    bool require_reuse_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> stores_;
+    std::atomic<uint64_t> evictions_;
+    std::atomic<uint64_t> expirations_;
+    std::atomic<uint64_t> ticket_rotations_;
+    std::atomic<uint64_t> data_channel_rejections_;
+};
+
+} // namespace ssftpd
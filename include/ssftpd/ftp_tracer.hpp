@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ssftpd {
+
+/**
+ * @brief In-process span recorder with Chrome trace export
+ *
+ * Spans are written to a ring buffer owned by the recording thread, so
+ * recording takes no lock and never allocates after a thread's first span.
+ * Each ring keeps the most recent kRingSize spans. dump() merges every
+ * thread's ring into Chrome trace event JSON, which chrome://tracing and
+ * Perfetto open directly.
+ *
+ * Recording is switched on per category. A disabled category costs one
+ * relaxed load per span.
+ */
+class FTPTracer {
+public:
+    enum Category : uint32_t {
+        ACCEPT = 1u << 0,      ///< Accepting and admitting clients
+        COMMAND = 1u << 1,     ///< Control command dispatch
+        FILESYSTEM = 1u << 2,  ///< Scheduled tasks, by task class
+        TLS = 1u << 3,         ///< Handshake steps
+        TRANSFER = 1u << 4,    ///< Data sends
+        ALL = 0x1f
+    };
+
+    static constexpr size_t kRingSize = 8192;
+
+    /**
+     * @brief Choose the categories to record
+     * @param categories Bitwise OR of Category values; 0 stops recording
+     */
+    static void setCategories(uint32_t categories);
+
+    /**
+     * @brief Check whether a category is being recorded
+     * @param category Category
+     * @return true if spans of this category are kept
+     */
+    static bool isEnabled(Category category) {
+        return (categories_.load(std::memory_order_relaxed) & category) != 0;
+    }
+
+    /**
+     * @brief Record a finished span
+     * @param category Category
+     * @param name Span name; must outlive the tracer (a string literal)
+     * @param start Start time
+     * @param end End time
+     * @param label Optional detail of up to 8 characters, e.g. an FTP verb
+     * @param value Optional number shown with the span, e.g. a byte count
+     */
+    static void record(Category category, const char* name,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end,
+                       const std::string& label = std::string(), uint64_t value = 0);
+
+    /**
+     * @brief Render every thread's spans as Chrome trace JSON
+     * @return JSON document
+     */
+    static std::string dump();
+
+    /**
+     * @brief Write dump() to a file
+     * @param path Output path
+     * @return true on success
+     */
+    static bool writeTrace(const std::string& path);
+
+    /**
+     * @brief Forget recorded spans; threads keep their rings
+     */
+    static void clear();
+
+private:
+    static std::atomic<uint32_t> categories_;
+};
+
+/**
+ * @brief Records a span covering its own lifetime
+ *
+ * Reads the clock only if the category is enabled when the span starts.
+ */
+class FTPTraceSpan {
+public:
+    FTPTraceSpan(FTPTracer::Category category, const char* name)
+        : category_(category)
+        , name_(name)
+        , active_(FTPTracer::isEnabled(category))
+        , value_(0)
+    {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~FTPTraceSpan() {
+        if (active_) {
+            FTPTracer::record(category_, name_, start_, std::chrono::steady_clock::now(), label_, value_);
+        }
+    }
+
+    FTPTraceSpan(const FTPTraceSpan&) = delete;
+    FTPTraceSpan& operator=(const FTPTraceSpan&) = delete;
+
+    void setLabel(const std::string& label) {
+        if (active_) {
+            label_ = label;
+        }
+    }
+
+    void setValue(uint64_t value) { value_ = value; }
+
+private:
+    FTPTracer::Category category_;
+    const char* name_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+    std::string label_;
+    uint64_t value_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ssftpd/ftp_sharded_counters.hpp"
+
+namespace ssftpd {
+
+class FTPServerConfig;
+class Logger;
+
+/**
+ * @brief Authoritative per-user and per-virtual-host usage totals
+ *
+ * Every user and virtual host has one long-lived account. Sessions look the
+ * account up once (at login, or when they are bound to a virtual host) and
+ * keep the handle, so the transfer path only adds to sharded atomics.
+ *
+ * When usage_log_file is set, totals are checkpointed to that file every
+ * usage_checkpoint_interval and once more on stop(). The file is append-only
+ * binary. Each checkpoint is a block holding a header and one record per
+ * account that changed since the previous checkpoint:
+ *
+ *   header (32 bytes): "SSUA", u16 version, u16 reserved, u32 record count,
+ *                      u32 payload bytes, i64 unix time, u64 FNV-1a of payload
+ *   record:            u8 scope, u8 reserved, u16 name length,
+ *                      u64 bytes uploaded, u64 bytes downloaded, u64 uploads,
+ *                      u64 downloads, u64 sessions, name bytes
+ *
+ * Integers are in host byte order. Records carry running totals, so the
+ * latest record of an account is its current usage and billing periods are
+ * the difference between two checkpoints. On start() the file is replayed to
+ * restore the totals; a torn trailing block is cut off, and a damaged block
+ * in the middle is skipped.
+ */
+class FTPUsageAccounting {
+public:
+    enum class Scope : uint8_t {
+        USER = 1,
+        VIRTUAL_HOST = 2
+    };
+
+    /**
+     * @brief Usage totals of one account
+     */
+    struct Usage {
+        uint64_t bytes_uploaded = 0;
+        uint64_t bytes_downloaded = 0;
+        uint64_t uploads = 0;
+        uint64_t downloads = 0;
+        uint64_t sessions = 0;
+
+        bool operator==(const Usage& other) const;
+        bool operator!=(const Usage& other) const { return !(*this == other); }
+    };
+
+    /**
+     * @brief Counters of one user or virtual host
+     *
+     * Safe to update from any thread.
+     */
+    class Account {
+    public:
+        Account(Scope scope, const std::string& name);
+
+        void addBytesUploaded(uint64_t bytes) { counters_.add(BYTES_UPLOADED, bytes); }
+        void addBytesDownloaded(uint64_t bytes) { counters_.add(BYTES_DOWNLOADED, bytes); }
+        void countUpload() { counters_.add(UPLOADS); }
+        void countDownload() { counters_.add(DOWNLOADS); }
+        void countSession() { counters_.add(SESSIONS); }
+
+        /**
+         * @brief Get the account's totals
+         * @return Usage totals
+         */
+        Usage getUsage() const;
+
+        Scope getScope() const { return scope_; }
+        const std::string& getName() const { return name_; }
+
+    private:
+        friend class FTPUsageAccounting;
+
+        enum Counter {
+            BYTES_UPLOADED,
+            BYTES_DOWNLOADED,
+            UPLOADS,
+            DOWNLOADS,
+            SESSIONS,
+            COUNTER_COUNT
+        };
+
+        // Accounts exist per user, so they get fewer shards than the
+        // server-wide counters
+        static constexpr size_t kShardCount = 8;
+
+        void add(const Usage& usage);
+
+        Scope scope_;
+        std::string name_;
+        FTPShardedCounters<COUNTER_COUNT, kShardCount> counters_;
+        Usage checkpointed_;    // Guarded by the owner's checkpoint mutex
+    };
+
+    /**
+     * @brief Constructor
+     * @param config Server configuration (usage_* settings)
+     * @param logger Logger instance
+     */
+    FTPUsageAccounting(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger);
+
+    /**
+     * @brief Destructor; writes a final checkpoint
+     */
+    ~FTPUsageAccounting();
+
+    FTPUsageAccounting(const FTPUsageAccounting&) = delete;
+    FTPUsageAccounting& operator=(const FTPUsageAccounting&) = delete;
+
+    /**
+     * @brief Restore totals from the usage file and start checkpointing
+     * @return true on success, or when no usage file is configured
+     */
+    bool start();
+
+    /**
+     * @brief Stop checkpointing, write a final checkpoint and close the file
+     */
+    void stop();
+
+    /**
+     * @brief Get the account of a user or virtual host, creating it if needed
+     * @param scope Account kind
+     * @param name Username or virtual host name
+     * @return Account handle, valid for the life of the process
+     */
+    std::shared_ptr<Account> getAccount(Scope scope, const std::string& name);
+
+    /**
+     * @brief Get the totals of one account
+     * @param scope Account kind
+     * @param name Username or virtual host name
+     * @return Usage totals; zero for unknown accounts
+     */
+    Usage getUsage(Scope scope, const std::string& name) const;
+
+    /**
+     * @brief Get the totals of every account of one kind
+     * @param scope Account kind
+     * @return Usage totals by name
+     */
+    std::map<std::string, Usage> getAllUsage(Scope scope) const;
+
+    /**
+     * @brief Append the accounts that changed since the last checkpoint
+     * @return true if the block was written, or there was nothing to write
+     */
+    bool checkpoint();
+
+    /**
+     * @brief Get the number of checkpoint blocks written by this process
+     * @return Checkpoint count
+     */
+    uint64_t getCheckpointCount() const { return checkpoints_.load(); }
+
+private:
+    using AccountKey = std::pair<Scope, std::string>;
+
+    static constexpr uint32_t kFormatVersion = 1;
+    static constexpr size_t kHeaderSize = 32;
+    static constexpr size_t kRecordPrefixSize = 44;
+
+    bool openFile();
+    bool restore();
+    static size_t parseBlock(const std::string& contents, size_t position,
+                             std::map<AccountKey, Usage>& totals);
+    void checkpointLoop();
+    std::vector<std::shared_ptr<Account>> snapshotAccounts() const;
+
+    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<Logger> logger_;
+
+    mutable std::mutex accounts_mutex_;
+    std::map<AccountKey, std::shared_ptr<Account>> accounts_;
+
+    std::mutex checkpoint_mutex_;    // Serializes checkpoints and guards fd_
+    std::string path_;
+    int fd_;
+    std::atomic<uint64_t> checkpoints_;
+
+    std::chrono::seconds interval_;
+    std::mutex thread_mutex_;
+    std::condition_variable thread_condition_;
+    std::thread checkpoint_thread_;
+    bool running_;
+};
+
+} // namespace ssftpd
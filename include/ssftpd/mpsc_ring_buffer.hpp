@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace ssftpd {
+
+/**
+ * @brief Bounded multi-producer, single-consumer ring buffer
+ *
+ * Each slot carries a sequence number that tells producers and the
+ * consumer whose turn it is (Vyukov's bounded queue). Producers claim a
+ * slot with one CAS on the head and never wait: a full buffer makes
+ * tryPush() fail instead. Only one thread may call tryPop().
+ */
+template <typename T>
+class MPSCRingBuffer {
+public:
+    /**
+     * @brief Constructor
+     * @param capacity Slot count (rounded up to a power of two)
+     */
+    explicit MPSCRingBuffer(size_t capacity)
+        : head_(0)
+        , tail_(0)
+    {
+        capacity_ = 2;
+        while (capacity_ < capacity) {
+            capacity_ *= 2;
+        }
+        mask_ = capacity_ - 1;
+
+        slots_.reset(new Slot[capacity_]);
+        for (size_t i = 0; i < capacity_; ++i) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCRingBuffer(const MPSCRingBuffer&) = delete;
+    MPSCRingBuffer& operator=(const MPSCRingBuffer&) = delete;
+
+    /**
+     * @brief Append a value (any thread)
+     * @param value Value, moved in only on success
+     * @return false if the buffer is full
+     */
+    bool tryPush(T& value) {
+        size_t position = head_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[position & mask_];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+            if (difference == 0) {
+                if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                // The consumer has not freed this slot yet: full
+                return false;
+            } else {
+                // Another producer took it; try the new head
+                position = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Take the oldest value (consumer thread only)
+     * @param value Receives the value
+     * @return false if empty, or the next slot is still being written
+     */
+    bool tryPop(T& value) {
+        size_t position = tail_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[position & mask_];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+
+        value = std::move(slot.value);
+        slot.sequence.store(position + capacity_, std::memory_order_release);
+        tail_.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Get the number of queued values (approximate while in use)
+     * @return Queued value count
+     */
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return head > tail ? head - tail : 0;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    // Producers and the consumer each own a cache line
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+} // namespace ssftpd
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ssftpd {
+
+/**
+ * @brief Chase-Lev work-stealing deque
+ *
+ * The owning worker pushes and pops at the bottom (LIFO, cache-warm) without
+ * locks. Other workers steal from the top (FIFO) with a single CAS. The
+ * buffer grows on demand; retired buffers are kept until the deque is
+ * destroyed because a concurrent thief may still be reading them.
+ *
+ * T must be trivially copyable (typically a pointer). push() and pop() may
+ * only be called by the owner thread; steal() may be called by any thread.
+ */
+template <typename T>
+class WorkStealingDeque {
+public:
+    /**
+     * @brief Constructor
+     * @param initial_capacity Initial buffer size (rounded up to a power of two)
+     */
+    explicit WorkStealingDeque(size_t initial_capacity = 256)
+        : top_(0)
+        , bottom_(0)
+    {
+        size_t capacity = 2;
+        while (capacity < initial_capacity) {
+            capacity *= 2;
+        }
+        buffers_.push_back(std::make_unique<Buffer>(capacity));
+        buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    /**
+     * @brief Push an item at the bottom (owner only)
+     * @param item Item to push
+     */
+    void push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+
+        if (bottom - top > static_cast<int64_t>(buffer->capacity) - 1) {
+            buffer = grow(buffer, top, bottom);
+        }
+
+        buffer->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Pop the most recently pushed item (owner only)
+     * @param item Receives the item
+     * @return true if an item was popped
+     */
+    bool pop(T& item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            // Empty
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = buffer->get(bottom);
+        if (top == bottom) {
+            // Last item: race thieves for it
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Steal the oldest item (any thread)
+     * @param item Receives the item
+     * @return true if an item was stolen; false if empty or the steal lost a race
+     */
+    bool steal(T& item) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+        if (top >= bottom) {
+            return false;
+        }
+
+        Buffer* buffer = buffer_.load(std::memory_order_acquire);
+        T candidate = buffer->get(top);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return false;
+        }
+
+        item = candidate;
+        return true;
+    }
+
+    /**
+     * @brief Approximate number of queued items
+     * @return Item count (may be stale)
+     */
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+    }
+
+private:
+    struct Buffer {
+        explicit Buffer(size_t size)
+            : capacity(size)
+            , mask(size - 1)
+            , items(new std::atomic<T>[size])
+        {
+        }
+
+        T get(int64_t index) const {
+            return items[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T item) {
+            items[static_cast<size_t>(index) & mask].store(item, std::memory_order_relaxed);
+        }
+
+        size_t capacity;
+        size_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    Buffer* grow(Buffer* old, int64_t top, int64_t bottom) {
+        buffers_.push_back(std::make_unique<Buffer>(old->capacity * 2));
+        Buffer* buffer = buffers_.back().get();
+        for (int64_t i = top; i < bottom; ++i) {
+            buffer->put(i, old->get(i));
+        }
+        buffer_.store(buffer, std::memory_order_release);
+        return buffer;
+    }
+
+    alignas(64) std::atomic<int64_t> top_;
+    alignas(64) std::atomic<int64_t> bottom_;
+    std::atomic<Buffer*> buffer_;
+    std::vector<std::unique_ptr<Buffer>> buffers_;  ///< Owner only
+};
+
+} // namespace ssftpd
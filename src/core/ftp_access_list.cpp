@@ -0,0 +1,346 @@
+#include "ssftpd/ftp_access_list.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace ssftpd {
+
+namespace {
+
+void loadWords(const FTPIPKey& key, uint64_t words[2]) {
+    // Big-endian, so bit 0 is the most significant bit of the address
+    words[0] = 0;
+    words[1] = 0;
+    for (int i = 0; i < 8; ++i) {
+        words[0] = (words[0] << 8) | key.bytes[i];
+        words[1] = (words[1] << 8) | key.bytes[i + 8];
+    }
+}
+
+uint64_t maskWord(int bits) {
+    if (bits <= 0) {
+        return 0;
+    }
+    if (bits >= 64) {
+        return ~0ULL;
+    }
+    return ~0ULL << (64 - bits);
+}
+
+int bitAt(const uint64_t words[2], int index) {
+    return static_cast<int>((words[index >> 6] >> (63 - (index & 63))) & 1);
+}
+
+bool samePrefix(const uint64_t a[2], const uint64_t b[2], int length) {
+    return (((a[0] ^ b[0]) & maskWord(length)) |
+            ((a[1] ^ b[1]) & maskWord(length - 64))) == 0;
+}
+
+// Second word of ::ffff:0:0/96
+constexpr uint64_t kIPv4Prefix = 0x0000FFFF00000000ULL;
+
+int commonPrefixLength(const uint64_t a[2], const uint64_t b[2], int limit) {
+    uint64_t high = a[0] ^ b[0];
+    int common;
+    if (high != 0) {
+        common = __builtin_clzll(high);
+    } else {
+        uint64_t low = a[1] ^ b[1];
+        common = low != 0 ? 64 + __builtin_clzll(low) : 128;
+    }
+    return std::min(common, limit);
+}
+
+} // namespace
+
+FTPAccessList::FTPAccessList()
+    : rule_count_(0)
+    , allow_count_(0)
+{
+    // The root matches every address and carries no rule of its own
+    const uint64_t zero[2] = {0, 0};
+    addNode(zero, 0, NONE);
+}
+
+uint32_t FTPAccessList::addNode(const uint64_t bits[2], int length, int8_t action) {
+    Node node;
+    node.bits[0] = bits[0] & maskWord(length);
+    node.bits[1] = bits[1] & maskWord(length - 64);
+    node.child[0] = kNoChild;
+    node.child[1] = kNoChild;
+    node.length = static_cast<uint8_t>(length);
+    node.action = action;
+    nodes_.push_back(node);
+    return static_cast<uint32_t>(nodes_.size() - 1);
+}
+
+bool FTPAccessList::parseNetwork(const std::string& network, FTPIPKey& prefix, int& length) {
+    auto slash = network.find('/');
+    if (!FTPIPKey::parse(network.substr(0, slash), prefix)) {
+        return false;
+    }
+
+    int max_length = prefix.isIPv4() ? 32 : 128;
+    length = max_length;
+
+    if (slash != std::string::npos) {
+        std::string digits = network.substr(slash + 1);
+        if (digits.empty() || digits.size() > 3 ||
+            !std::all_of(digits.begin(), digits.end(), ::isdigit)) {
+            return false;
+        }
+        length = std::stoi(digits);
+        if (length > max_length) {
+            return false;
+        }
+    }
+
+    // IPv4 prefixes sit below the ::ffff:0:0/96 mapping
+    if (prefix.isIPv4()) {
+        length += 96;
+    }
+
+    // Clear the host bits
+    for (int i = 0; i < 16; ++i) {
+        int keep = std::min(std::max(length - i * 8, 0), 8);
+        prefix.bytes[i] &= static_cast<uint8_t>(0xFF00 >> keep);
+    }
+
+    return true;
+}
+
+bool FTPAccessList::addRule(const std::string& network, bool allow) {
+    FTPIPKey key;
+    int length;
+    if (!parseNetwork(network, key, length)) {
+        return false;
+    }
+
+    uint64_t bits[2];
+    loadWords(key, bits);
+    int8_t action = allow ? ALLOW : DENY;
+
+    // The jump tables no longer reflect the trie until the next compile()
+    ipv4_jumps_.clear();
+    ipv6_jumps_.clear();
+
+    rule_count_++;
+    if (allow) {
+        allow_count_++;
+    }
+
+    // Walk down while the child's whole prefix is shared with the new one
+    uint32_t index = 0;
+    while (true) {
+        if (nodes_[index].length == length) {
+            // Same network listed twice: deny wins
+            if (nodes_[index].action != DENY) {
+                nodes_[index].action = action;
+            }
+            return true;
+        }
+
+        int branch = bitAt(bits, nodes_[index].length);
+        uint32_t child = nodes_[index].child[branch];
+        if (child == kNoChild) {
+            uint32_t leaf = addNode(bits, length, action);
+            nodes_[index].child[branch] = leaf;
+            return true;
+        }
+
+        int child_length = nodes_[child].length;
+        int common = commonPrefixLength(bits, nodes_[child].bits, std::min(length, child_length));
+        if (common == child_length) {
+            index = child;
+            continue;
+        }
+
+        if (common == length) {
+            // The new network contains the child: insert it above
+            uint32_t inserted = addNode(bits, length, action);
+            nodes_[inserted].child[bitAt(nodes_[child].bits, length)] = child;
+            nodes_[index].child[branch] = inserted;
+            return true;
+        }
+
+        // The two diverge below their common prefix: add a branch node
+        uint32_t split = addNode(bits, common, NONE);
+        uint32_t leaf = addNode(bits, length, action);
+        nodes_[split].child[bitAt(nodes_[child].bits, common)] = child;
+        nodes_[split].child[bitAt(bits, common)] = leaf;
+        nodes_[index].child[branch] = split;
+        return true;
+    }
+}
+
+void FTPAccessList::compile() {
+    ipv4_jumps_.clear();
+    ipv6_jumps_.clear();
+    if (rule_count_ < kJumpTableMinRules) {
+        return;
+    }
+
+    const size_t slots = size_t(1) << kJumpBits;
+    ipv4_jumps_.reserve(slots);
+    ipv6_jumps_.reserve(slots);
+
+    for (uint64_t slot = 0; slot < slots; ++slot) {
+        const uint64_t ipv4[2] = {0, kIPv4Prefix | (slot << (32 - kJumpBits))};
+        const uint64_t ipv6[2] = {slot << (64 - kJumpBits), 0};
+        ipv4_jumps_.push_back(buildJump(ipv4, 96 + kJumpBits));
+        ipv6_jumps_.push_back(buildJump(ipv6, kJumpBits));
+    }
+}
+
+FTPAccessList::Jump FTPAccessList::buildJump(const uint64_t bits[2], int depth) const {
+    Jump jump{kNoChild, NONE};
+    uint32_t index = 0;
+
+    // Same walk as a lookup, stopping at the first node the slot does not decide
+    while (index != kNoChild) {
+        const Node& node = nodes_[index];
+        if (node.length >= depth) {
+            jump.node = index;
+            break;
+        }
+        if (!samePrefix(bits, node.bits, node.length)) {
+            break;
+        }
+        if (node.action != NONE) {
+            jump.action = node.action;
+        }
+        index = node.child[bitAt(bits, node.length)];
+    }
+
+    return jump;
+}
+
+bool FTPAccessList::isAllowed(const FTPIPKey& address) const {
+    uint64_t bits[2];
+    loadWords(address, bits);
+
+    int8_t result = allow_count_ > 0 ? DENY : ALLOW;
+    uint32_t index = 0;
+
+    if (!ipv4_jumps_.empty()) {
+        bool ipv4 = bits[0] == 0 && (bits[1] >> 32) == (kIPv4Prefix >> 32);
+        const Jump& jump = ipv4 ? ipv4_jumps_[(bits[1] >> (32 - kJumpBits)) & ((1u << kJumpBits) - 1)]
+                                : ipv6_jumps_[bits[0] >> (64 - kJumpBits)];
+        if (jump.action != NONE) {
+            result = jump.action;
+        }
+        index = jump.node;
+    }
+
+    // Longest prefix match: the last rule seen on the way down wins
+    while (index != kNoChild) {
+        const Node& node = nodes_[index];
+        if (!samePrefix(bits, node.bits, node.length)) {
+            break;
+        }
+        if (node.action != NONE) {
+            result = node.action;
+        }
+        if (node.length == 128) {
+            break;
+        }
+        index = node.child[bitAt(bits, node.length)];
+    }
+
+    return result == ALLOW;
+}
+
+FTPAccessControl::FTPAccessControl(std::shared_ptr<FTPServerConfig> config,
+                                   std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , tables_(new Tables())
+{
+}
+
+FTPAccessControl::~FTPAccessControl() {
+    delete tables_.load();
+}
+
+bool FTPAccessControl::buildList(FTPAccessList& list, const std::vector<std::string>& allow,
+                               const std::vector<std::string>& deny, const std::string& scope) {
+    bool valid = true;
+
+    for (const auto& network : allow) {
+        if (!list.addRule(network, true)) {
+            logger_->error("Invalid allow network for " + scope + ": " + network);
+            valid = false;
+        }
+    }
+    for (const auto& network : deny) {
+        if (!list.addRule(network, false)) {
+            logger_->error("Invalid deny network for " + scope + ": " + network);
+            valid = false;
+        }
+    }
+
+    list.compile();
+    return valid;
+}
+
+bool FTPAccessControl::reload() {
+    if (!config_) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+
+    // Build the new set off to the side; readers keep using the old one
+    std::unique_ptr<Tables> tables(new Tables());
+    bool valid = buildList(tables->server, config_->security.allow_networks,
+                         config_->security.deny_networks, "server");
+
+    for (const auto& vhost : config_->virtual_hosts) {
+        if (vhost.allow_networks.empty() && vhost.deny_networks.empty()) {
+            continue;
+        }
+        valid = buildList(tables->virtual_hosts[vhost.hostname], vhost.allow_networks,
+                        vhost.deny_networks, "virtual host " + vhost.hostname) && valid;
+    }
+
+    if (!valid) {
+        logger_->error("Network access rules not reloaded; keeping the previous rules");
+        return false;
+    }
+
+    const Tables* previous = tables_.exchange(tables.release());
+    epoch_.retire([previous]() { delete previous; });
+    epoch_.reclaim();
+
+    logger_->info("Network access control loaded with " + std::to_string(getRuleCount()) + " rules");
+    return true;
+}
+
+bool FTPAccessControl::isAllowed(const FTPIPKey& address, const std::string& virtual_host) const {
+    FTPEpochDomain::Guard guard(epoch_);
+    const Tables* tables = tables_.load();
+
+    if (!tables->server.isAllowed(address)) {
+        return false;
+    }
+
+    if (virtual_host.empty() || tables->virtual_hosts.empty()) {
+        return true;
+    }
+
+    auto it = tables->virtual_hosts.find(virtual_host);
+    return it == tables->virtual_hosts.end() || it->second.isAllowed(address);
+}
+
+size_t FTPAccessControl::getRuleCount() const {
+    FTPEpochDomain::Guard guard(epoch_);
+    const Tables* tables = tables_.load();
+
+    size_t count = tables->server.getRuleCount();
+    for (const auto& entry : tables->virtual_hosts) {
+        count += entry.second.getRuleCount();
+    }
+    return count;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,109 @@
+#include "ssftpd/ftp_admission_controller.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+
+namespace ssftpd {
+
+FTPAdmissionController::FTPAdmissionController(std::shared_ptr<FTPServerConfig> config,
+                                               std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , enabled_(false)
+    , defer_on_overload_(false)
+    , max_loop_lag_(std::chrono::milliseconds(100))
+    , max_queue_depth_(1000)
+    , max_pending_disk_io_(256)
+    , overloaded_(false)
+    , loop_lag_us_(0)
+    , queue_depth_(0)
+    , pending_disk_io_(0)
+    , admitted_(0)
+    , rejected_(0)
+    , deferred_(0)
+    , overload_events_(0)
+{
+    if (config_) {
+        enabled_ = config_->connection.admission_control;
+        defer_on_overload_ = config_->connection.overload_action == "defer";
+        max_loop_lag_ = config_->connection.max_loop_lag;
+        max_queue_depth_ = config_->connection.max_queue_depth;
+        max_pending_disk_io_ = config_->connection.max_pending_disk_io;
+    }
+}
+
+void FTPAdmissionController::recordLoopLag(std::chrono::microseconds lag) {
+    uint64_t sample = lag.count() > 0 ? static_cast<uint64_t>(lag.count()) : 0;
+
+    // Exponentially weighted average (1/8), so one slow pass is not an overload
+    uint64_t current = loop_lag_us_.load(std::memory_order_relaxed);
+    loop_lag_us_.store(current - current / 8 + sample / 8, std::memory_order_relaxed);
+}
+
+void FTPAdmissionController::update(size_t queue_depth, size_t pending_disk_io) {
+    if (!enabled_) {
+        return;
+    }
+
+    queue_depth_.store(queue_depth, std::memory_order_relaxed);
+    pending_disk_io_.store(pending_disk_io, std::memory_order_relaxed);
+
+    // Load relative to the limits, in percent; the highest signal decides
+    uint64_t lag_us = loop_lag_us_.load(std::memory_order_relaxed);
+    uint64_t load = 0;
+    if (max_loop_lag_.count() > 0) {
+        load = std::max<uint64_t>(load, lag_us * 100 / static_cast<uint64_t>(max_loop_lag_.count()));
+    }
+    if (max_queue_depth_ > 0) {
+        load = std::max<uint64_t>(load, queue_depth * 100 / max_queue_depth_);
+    }
+    if (max_pending_disk_io_ > 0) {
+        load = std::max<uint64_t>(load, pending_disk_io * 100 / max_pending_disk_io_);
+    }
+
+    bool overloaded = overloaded_.load(std::memory_order_relaxed);
+    if (!overloaded && load >= 100) {
+        overloaded_.store(true);
+        overload_events_++;
+        logger_->warn("Server overloaded, " + std::string(defer_on_overload_ ? "deferring" : "rejecting") +
+                      " new connections (loop lag " + std::to_string(lag_us) + "us, queue depth " +
+                      std::to_string(queue_depth) + ", pending disk I/O " + std::to_string(pending_disk_io) + ")");
+    } else if (overloaded && load < 80) {
+        overloaded_.store(false);
+        logger_->info("Server load back to normal, admitting new connections");
+    }
+}
+
+bool FTPAdmissionController::shouldDefer() {
+    if (!enabled_ || !defer_on_overload_ || !overloaded_.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    deferred_++;
+    return true;
+}
+
+bool FTPAdmissionController::admit() {
+    // Also reached in defer mode when overload starts after accept()
+    if (enabled_ && overloaded_.load(std::memory_order_relaxed)) {
+        rejected_++;
+        return false;
+    }
+
+    admitted_++;
+    return true;
+}
+
+FTPAdmissionController::Stats FTPAdmissionController::getStats() const {
+    Stats stats;
+    stats.overloaded = overloaded_.load();
+    stats.loop_lag_us = loop_lag_us_.load();
+    stats.queue_depth = queue_depth_.load();
+    stats.pending_disk_io = pending_disk_io_.load();
+    stats.admitted = admitted_.load();
+    stats.rejected = rejected_.load();
+    stats.deferred = deferred_.load();
+    stats.overload_events = overload_events_.load();
+    return stats;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,253 @@
+#include "ssftpd/ftp_ban_table.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+#include <sstream>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+namespace ssftpd {
+
+FTPBanTable::FTPBanTable(std::shared_ptr<Logger> logger)
+    : logger_(logger)
+    , ban_count_(0)
+{
+}
+
+int64_t FTPBanTable::tickOf(Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+const FTPBanTable::Shard& FTPBanTable::shardFor(const FTPIPKey& key) const {
+    return shards_[(FTPIPKeyHash{}(key) >> 32) & (kShardCount - 1)];
+}
+
+FTPBanTable::Shard& FTPBanTable::shardFor(const FTPIPKey& key) {
+    return shards_[(FTPIPKeyHash{}(key) >> 32) & (kShardCount - 1)];
+}
+
+bool FTPBanTable::ban(const FTPIPKey& key, std::chrono::seconds duration, Clock::time_point now) {
+    int64_t tick = tickOf(now);
+    int64_t seconds = std::max<int64_t>(duration.count(), 1);
+    int64_t expires = tick + seconds;
+    bool added = false;
+
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        int64_t* existing = shard.bans.find(key);
+        if (existing) {
+            if (expires <= *existing) {
+                return false;
+            }
+
+            // A lapsed ban the wheel has not reached yet counts as new
+            added = *existing <= tick;
+            int64_t previous = *existing;
+            *existing = expires;
+            if (previous % kWheelSlots != expires % kWheelSlots) {
+                shard.wheel[expires % kWheelSlots].push_back(key);
+            }
+        } else {
+            shard.bans.insertOrAssign(key, expires);
+            shard.wheel[expires % kWheelSlots].push_back(key);
+            ban_count_.fetch_add(1);
+            added = true;
+        }
+    }
+
+    // Extensions are not mirrored: once the kernel entry lapses, the table
+    // still refuses the address until the new expiry
+    if (added) {
+        std::lock_guard<std::mutex> lock(mirror_mutex_);
+        if (!nftables_set_.empty()) {
+            mirror_queue_.push_back(MirrorRequest{key, seconds});
+        }
+    }
+
+    return added;
+}
+
+bool FTPBanTable::unban(const FTPIPKey& key) {
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        // The wheel entry goes stale and is dropped when its slot comes up
+        if (!shard.bans.erase(key)) {
+            return false;
+        }
+        ban_count_.fetch_sub(1);
+    }
+
+    std::lock_guard<std::mutex> lock(mirror_mutex_);
+    if (!nftables_set_.empty()) {
+        mirror_queue_.push_back(MirrorRequest{key, 0});
+    }
+    return true;
+}
+
+bool FTPBanTable::isBanned(const FTPIPKey& key, Clock::time_point now) const {
+    // Nothing banned: the common case costs one relaxed load
+    if (ban_count_.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+
+    const Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const int64_t* expires = shard.bans.find(key);
+    return expires && *expires > tickOf(now);
+}
+
+size_t FTPBanTable::expire(Clock::time_point now) {
+    int64_t tick = tickOf(now);
+    size_t expired = 0;
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        expired += expireShard(shard, tick);
+    }
+
+    if (expired > 0) {
+        ban_count_.fetch_sub(expired);
+        logger_->debug("Expired " + std::to_string(expired) + " client bans");
+    }
+
+    runMirrorRequests();
+    return expired;
+}
+
+size_t FTPBanTable::expireShard(Shard& shard, int64_t tick) {
+    // Visit each slot passed since the last call, at most one full turn
+    int64_t first = std::max(shard.last_tick + 1, tick - static_cast<int64_t>(kWheelSlots) + 1);
+    size_t expired = 0;
+
+    for (int64_t current = first; current <= tick; ++current) {
+        size_t slot = static_cast<size_t>(current % kWheelSlots);
+        auto& entries = shard.wheel[slot];
+        size_t kept = 0;
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const int64_t* expires = shard.bans.find(entries[i]);
+            if (!expires) {
+                continue; // Unbanned
+            }
+            if (*expires <= tick) {
+                shard.bans.erase(entries[i]);
+                expired++;
+                continue;
+            }
+            if (static_cast<size_t>(*expires % kWheelSlots) == slot) {
+                // Longer than one turn: wait here for the next one
+                entries[kept++] = entries[i];
+            }
+            // Otherwise the ban was extended and is scheduled in another slot
+        }
+        entries.resize(kept);
+    }
+
+    shard.last_tick = std::max(shard.last_tick, tick);
+    return expired;
+}
+
+void FTPBanTable::setNftablesSet(const std::string& set) {
+    std::lock_guard<std::mutex> lock(mirror_mutex_);
+    nftables_set_ = set;
+    if (set.empty()) {
+        mirror_queue_.clear();
+    }
+}
+
+void FTPBanTable::runMirrorRequests() {
+    std::string set;
+    std::vector<MirrorRequest> requests;
+    {
+        std::lock_guard<std::mutex> lock(mirror_mutex_);
+        if (mirror_queue_.empty()) {
+            return;
+        }
+        set = nftables_set_;
+        requests.swap(mirror_queue_);
+    }
+
+    std::istringstream parts(set);
+    std::string family, table, name;
+    if (!(parts >> family >> table >> name)) {
+        logger_->error("Invalid nftables set '" + set + "', expected '<family> <table> <set>'");
+        return;
+    }
+
+    // One nft run per operation and address family, however many bans queued
+    for (bool add : {true, false}) {
+        for (bool ipv4 : {true, false}) {
+            std::vector<std::string> args = {"nft", add ? "add" : "delete", "element",
+                                             family, table, ipv4 ? name : name + "6", "{"};
+            bool any = false;
+            for (const auto& request : requests) {
+                if ((request.seconds > 0) != add || request.key.isIPv4() != ipv4) {
+                    continue;
+                }
+                if (any) {
+                    args.push_back(",");
+                }
+                args.push_back(request.key.toString());
+                if (add) {
+                    args.push_back("timeout");
+                    args.push_back(std::to_string(request.seconds) + "s");
+                }
+                any = true;
+            }
+            if (!any) {
+                continue;
+            }
+            args.push_back("}");
+
+            // Arguments go straight to nft, no shell in between
+            std::vector<char*> argv;
+            for (auto& arg : args) {
+                argv.push_back(&arg[0]);
+            }
+            argv.push_back(nullptr);
+
+            pid_t pid;
+            int status = 0;
+            if (posix_spawnp(&pid, "nft", nullptr, nullptr, argv.data(), environ) != 0 ||
+                waitpid(pid, &status, 0) < 0 ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                logger_->warn("Failed to update nftables set " + family + " " + table + " " +
+                              args[5] + " (" + std::to_string(argv.size() - 1) + " arguments)");
+            }
+        }
+    }
+}
+
+std::map<std::string, int64_t> FTPBanTable::getBans(Clock::time_point now) const {
+    std::map<std::string, int64_t> bans;
+    int64_t tick = tickOf(now);
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.bans.forEach([&bans, tick](const FTPIPKey& key, int64_t expires) {
+            if (expires > tick) {
+                bans[key.toString()] = expires - tick;
+            }
+        });
+    }
+
+    return bans;
+}
+
+void FTPBanTable::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.bans.clear();
+        for (auto& entries : shard.wheel) {
+            entries.clear();
+        }
+    }
+    ban_count_.store(0);
+}
+
+} // namespace ssftpd
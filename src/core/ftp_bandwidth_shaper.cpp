@@ -0,0 +1,212 @@
+#include "ssftpd/ftp_bandwidth_shaper.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace ssftpd {
+
+namespace {
+
+constexpr double kNanosPerSecond = 1e9;
+
+// Smaller grants wait instead, so a throttled stream makes a few large
+// writes rather than many tiny ones
+constexpr size_t kMinGrant = 16 * 1024;
+
+// Burst allowance: this much time's worth of bytes, and never less than
+// kMinBurst so one grant always fits
+constexpr double kBurstSeconds = 0.05;
+constexpr uint64_t kMinBurst = 64 * 1024;
+
+int64_t toNanos(FTPBandwidthShaper::Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+FTPBandwidthShaper::Clock::time_point fromNanos(int64_t nanos) {
+    return FTPBandwidthShaper::Clock::time_point(
+        std::chrono::duration_cast<FTPBandwidthShaper::Clock::duration>(std::chrono::nanoseconds(nanos)));
+}
+
+} // namespace
+
+FTPTokenBucket::FTPTokenBucket(uint64_t rate, uint64_t burst)
+    : rate_(std::max<uint64_t>(rate, 1))
+    , burst_ns_(0)
+    , tat_ns_(0)
+{
+    burst_ns_ = toNanoseconds(burst);
+}
+
+int64_t FTPTokenBucket::toNanoseconds(uint64_t bytes) const {
+    return static_cast<int64_t>(std::ceil(static_cast<double>(bytes) * kNanosPerSecond / rate_));
+}
+
+uint64_t FTPTokenBucket::available(int64_t now_ns) const {
+    int64_t backlog = std::max(tat_ns_.load(std::memory_order_relaxed), now_ns) - now_ns;
+    if (backlog >= burst_ns_) {
+        return 0;
+    }
+    return static_cast<uint64_t>(static_cast<double>(burst_ns_ - backlog) * rate_ / kNanosPerSecond);
+}
+
+void FTPTokenBucket::consume(uint64_t bytes, int64_t now_ns) {
+    int64_t cost = toNanoseconds(bytes);
+    int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+
+    // An idle bucket starts from now; unused time does not pile up past the burst
+    while (!tat_ns_.compare_exchange_weak(tat, std::max(tat, now_ns) + cost,
+                                          std::memory_order_relaxed)) {
+    }
+}
+
+void FTPTokenBucket::refund(uint64_t bytes) {
+    tat_ns_.fetch_sub(toNanoseconds(bytes), std::memory_order_relaxed);
+}
+
+int64_t FTPTokenBucket::readyAt(uint64_t bytes, int64_t now_ns) const {
+    int64_t tat = std::max(tat_ns_.load(std::memory_order_relaxed), now_ns);
+    return std::max(now_ns, tat - burst_ns_ + toNanoseconds(bytes));
+}
+
+FTPBandwidthShaper::Grant FTPBandwidthShaper::Stream::request(size_t wanted, Clock::time_point now) {
+    int64_t now_ns = toNanos(now);
+
+    uint64_t granted = wanted;
+    for (const auto& bucket : buckets_) {
+        if (bucket) {
+            granted = std::min(granted, bucket->available(now_ns));
+        }
+    }
+
+    size_t needed = std::min(wanted, kMinGrant);
+    if (granted < needed) {
+        // Wake up when the slowest level can cover the minimum grant
+        int64_t ready_ns = now_ns;
+        for (const auto& bucket : buckets_) {
+            if (bucket) {
+                ready_ns = std::max(ready_ns, bucket->readyAt(needed, now_ns));
+            }
+        }
+        shaper_->throttled_.fetch_add(1, std::memory_order_relaxed);
+        return Grant{0, fromNanos(ready_ns)};
+    }
+
+    // Streams racing on a shared level may both take the same budget; the
+    // debt pushes that level's next grant back, so the long-run rate holds
+    for (const auto& bucket : buckets_) {
+        if (bucket) {
+            bucket->consume(granted, now_ns);
+        }
+    }
+    shaper_->granted_bytes_.fetch_add(granted, std::memory_order_relaxed);
+    return Grant{static_cast<size_t>(granted), now};
+}
+
+void FTPBandwidthShaper::Stream::refund(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+
+    for (const auto& bucket : buckets_) {
+        if (bucket) {
+            bucket->refund(bytes);
+        }
+    }
+    shaper_->granted_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void FTPBandwidthShaper::Stream::setUser(const std::string& username) {
+    buckets_[USER] = shaper_->userBucket(username);
+}
+
+FTPBandwidthShaper::FTPBandwidthShaper(std::shared_ptr<FTPServerConfig> config,
+                                       std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , session_rate_(0)
+    , throttled_(0)
+    , granted_bytes_(0)
+{
+    uint64_t global_rate = 0;
+    if (config_) {
+        global_rate = config_->transfer.max_transfer_rate;
+        if (config_->rate_limit.enabled) {
+            session_rate_ = config_->rate_limit.max_transfer_rate;
+        }
+    }
+
+    if (global_rate > 0) {
+        global_bucket_ = std::make_shared<FTPTokenBucket>(global_rate, burstFor(global_rate));
+        logger_->info("Global transfer rate limited to " + std::to_string(global_rate) + " bytes/s");
+    }
+}
+
+std::shared_ptr<FTPBandwidthShaper::Stream> FTPBandwidthShaper::createStream(const std::string& virtual_host,
+                                                                             uint64_t virtual_host_rate) {
+    std::shared_ptr<Stream> stream(new Stream(shared_from_this()));
+
+    if (session_rate_ > 0) {
+        stream->buckets_[Stream::SESSION] = std::make_shared<FTPTokenBucket>(session_rate_, burstFor(session_rate_));
+    }
+    if (virtual_host_rate > 0) {
+        stream->buckets_[Stream::VIRTUAL_HOST] = sharedBucket(virtual_host_buckets_, virtual_host, virtual_host_rate);
+    }
+    stream->buckets_[Stream::GLOBAL] = global_bucket_;
+
+    return stream;
+}
+
+void FTPBandwidthShaper::setUserRateResolver(std::function<uint64_t(const std::string&)> resolver) {
+    std::lock_guard<std::mutex> lock(buckets_mutex_);
+    user_rate_resolver_ = std::move(resolver);
+}
+
+uint64_t FTPBandwidthShaper::burstFor(uint64_t rate) {
+    return std::max(kMinBurst, static_cast<uint64_t>(rate * kBurstSeconds));
+}
+
+std::shared_ptr<FTPTokenBucket> FTPBandwidthShaper::userBucket(const std::string& username) {
+    std::function<uint64_t(const std::string&)> resolver;
+    {
+        std::lock_guard<std::mutex> lock(buckets_mutex_);
+        resolver = user_rate_resolver_;
+    }
+
+    // Resolve outside our lock; the user manager has its own
+    uint64_t rate = resolver ? resolver(username) : 0;
+    if (rate == 0) {
+        return nullptr;
+    }
+
+    return sharedBucket(user_buckets_, username, rate);
+}
+
+std::shared_ptr<FTPTokenBucket> FTPBandwidthShaper::sharedBucket(BucketMap& buckets,
+                                                                 const std::string& name,
+                                                                 uint64_t rate) {
+    std::lock_guard<std::mutex> lock(buckets_mutex_);
+
+    auto it = buckets.find(name);
+    if (it != buckets.end()) {
+        auto bucket = it->second.lock();
+        // A changed rate starts a fresh bucket; streams on the old one keep it
+        if (bucket && bucket->getRate() == rate) {
+            return bucket;
+        }
+    }
+
+    // Buckets live as long as some stream uses them; drop the dead entries
+    for (auto entry = buckets.begin(); entry != buckets.end();) {
+        if (entry->second.expired()) {
+            entry = buckets.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+
+    auto bucket = std::make_shared<FTPTokenBucket>(rate, burstFor(rate));
+    buckets[name] = bucket;
+    return bucket;
+}
+
+} // namespace ssftpd
@@ -1,5 +1,10 @@
 #include "ssftpd/ftp_connection.hpp"
 #include "ssftpd/logger.hpp"
+#include "ssftpd/ftp_statistics.hpp"
+#include "ssftpd/ftp_usage_accounting.hpp"
+#include "ssftpd/ftp_tracer.hpp"
+#include "ssftpd/ftp_loop_monitor.hpp"
+#include "ssftpd/ftp_perf_counters.hpp"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
@@ -14,11 +19,29 @@
 
 namespace ssftpd {
 
+namespace {
+
+// Data and replies queued behind the bandwidth shaper, per session; a
+// client that stops reading gets backpressure instead of a growing buffer
+constexpr size_t kMaxPendingBytes = 4 * 1024 * 1024;
+
+// Profiling names of data sends, by transfer type and mode
+const std::string& transferOperation(FTPTransferType type, FTPTransferMode mode) {
+    static const std::string kOperations[2][3] = {
+        {"send_ascii_stream", "send_ascii_block", "send_ascii_compressed"},
+        {"send_binary_stream", "send_binary_block", "send_binary_compressed"},
+    };
+    return kOperations[type == FTPTransferType::BINARY ? 1 : 0][static_cast<size_t>(mode)];
+}
+
+} // namespace
+
 FTPConnection::FTPConnection(socket_t client_socket, 
-                            const std::string& client_addr,
+                            const FTPIPKey& client_key,
                             std::shared_ptr<FTPVirtualHost> virtual_host)
     : client_socket_(client_socket)
-    , client_addr_(client_addr)
+    , client_key_(client_key)
+    , client_addr_(client_key.toString())
     , virtual_host_(virtual_host)
     , active_(true)
     , state_(FTPConnectionState::CONNECTED)
@@ -36,6 +59,15 @@ FTPConnection::FTPConnection(socket_t client_socket,
     , bytes_received_(0)
     , files_sent_(0)
     , files_received_(0)
+    , session_id_(0)
+    , processing_(false)
+    , disconnect_requested_(false)
+    , pending_offset_(0)
+    , buffer_bytes_(0)
+    , buffer_release_generation_(0)
+    , command_bytes_start_(0)
+    , first_byte_pending_(false)
+    , transfer_open_(false)
     , logger_(std::make_shared<Logger>())
 {
     // Set socket to non-blocking mode
@@ -130,6 +162,21 @@ void FTPConnection::handleCommand(const std::string& command) {
     // Convert to uppercase for comparison
     std::transform(cmd.begin(), cmd.end(), cmd.begin(), ::toupper);
     
+    FTPTraceSpan span(FTPTracer::COMMAND, "command");
+    span.setLabel(cmd);
+    FTPLoopMonitor::TagScope tag("command", cmd);
+    // The verb is client-supplied; unknown ones share one bucket so the
+    // per-operation totals stay bounded
+    FTPPerfScope perf(FTPStatistics::commandLabel(cmd));
+    
+    // A new command closes the previous one's transfer, drained or not
+    auto started = std::chrono::steady_clock::now();
+    finishTransfer(started);
+    command_started_ = started;
+    command_bytes_start_ = bytes_sent_;
+    first_byte_pending_ = true;
+    transfer_open_ = true;
+    
     // Execute command
     if (cmd == "USER") {
         handleUSER(args);
@@ -149,6 +196,15 @@ void FTPConnection::handleCommand(const std::string& command) {
         // Unknown command
         sendResponse(500, "Unknown command: " + cmd);
     }
+    
+    if (statistics_) {
+        auto now = std::chrono::steady_clock::now();
+        statistics_->incrementRequests();
+        statistics_->recordCommand(cmd, now - started);
+        if (!hasPendingData()) {
+            finishTransfer(now);
+        }
+    }
 }
 
 std::vector<std::string> FTPConnection::parseCommandLine(const std::string& line) {
@@ -193,13 +249,36 @@ void FTPConnection::handlePASS(const std::vector<std::string>& args) {
     std::string password = args[1];
     
     // Simple authentication (in production, implement proper authentication)
-    if (username_buffer_ == "admin" && password == "admin") {
+    bool authenticated = username_buffer_ == "admin" && password == "admin";
+    if (statistics_) {
+        statistics_->recordPhase(FTPTransferPhase::AUTH, std::chrono::steady_clock::now() - command_started_);
+        if (authenticated) {
+            statistics_->incrementSuccessfulLogins();
+        } else {
+            statistics_->incrementFailedLogins();
+        }
+    }
+    
+    if (authenticated) {
         state_ = FTPConnectionState::AUTHENTICATED;
+        username_ = username_buffer_;
+        if (usage_accounting_) {
+            user_usage_ = usage_accounting_->getAccount(FTPUsageAccounting::Scope::USER, username_);
+            user_usage_->countSession();
+        }
+        if (login_callback_) {
+            login_callback_(username_);
+        }
         sendResponse(230, "User " + username_buffer_ + " logged in.");
         logger_->info("User " + username_buffer_ + " authenticated from " + client_addr_);
     } else {
         sendResponse(530, "Login incorrect.");
         logger_->warn("Failed login attempt for user " + username_buffer_ + " from " + client_addr_);
+        
+        // Drop the session once the client has been banned
+        if (login_failure_callback_ && login_failure_callback_()) {
+            disconnect();
+        }
     }
 }
 
@@ -262,7 +341,12 @@ void FTPConnection::handleLIST(const std::vector<std::string>& args) {
                           "drwxr-xr-x 2 user group 4096 Jan 1 00:00 ..\r\n";
     
     sendResponse(150, "Here comes the directory listing");
-    sendData(listing.c_str(), listing.length());
+    if (!sendData(listing.c_str(), listing.length())) {
+        if (active_.load()) {
+            sendResponse(451, "Requested action aborted: local error in processing");
+        }
+        return;
+    }
     sendResponse(226, "Directory send OK");
 }
 
@@ -281,17 +365,218 @@ bool FTPConnection::sendData(const char* data, size_t length) {
         return false;
     }
     
-    ssize_t bytes_sent = send(client_socket_, data, length, 0);
-    if (bytes_sent > 0) {
-        bytes_sent_ += bytes_sent;
-        return true;
+    if (!bandwidth_stream_) {
+        FTPTraceSpan span(FTPTracer::TRANSFER, "send");
+        FTPPerfScope perf(transferOperation(transfer_type_, transfer_mode_));
+        ssize_t bytes_sent = send(client_socket_, data, length, 0);
+        span.setValue(bytes_sent > 0 ? static_cast<uint64_t>(bytes_sent) : 0);
+        if (bytes_sent > 0) {
+            countSent(static_cast<size_t>(bytes_sent));
+            return true;
+        }
+        return false;
+    }
+    
+    // Queue behind data still waiting for bandwidth so the stream stays in order
+    if (hasPendingData()) {
+        if (pending_data_.size() - pending_offset_ + length > kMaxPendingBytes) {
+            return false;
+        }
+        pending_data_.append(data, length);
+        flushPendingData();
+        return active_.load();
+    }
+    
+    ssize_t result = sendShaped(data, length);
+    if (result < 0) {
+        return false;
+    }
+    size_t sent = static_cast<size_t>(result);
+    if (sent < length) {
+        if (length - sent > kMaxPendingBytes) {
+            return false;
+        }
+        pending_data_.assign(data + sent, length - sent);
+        pending_offset_ = 0;
+        updateBufferBytes();
+    }
+    return true;
+}
+
+ssize_t FTPConnection::sendShaped(const char* data, size_t length) {
+    auto now = std::chrono::steady_clock::now();
+    if (now < send_ready_at_) {
+        return 0;
+    }
+    
+    auto grant = bandwidth_stream_->request(length, now);
+    if (grant.bytes == 0) {
+        // Out of budget: the event loop retries once the budget is back
+        send_ready_at_ = grant.ready_at;
+        return 0;
+    }
+    
+    FTPTraceSpan span(FTPTracer::TRANSFER, "send");
+    FTPPerfScope perf(transferOperation(transfer_type_, transfer_mode_));
+    ssize_t bytes_sent = send(client_socket_, data, grant.bytes, MSG_NOSIGNAL);
+    if (bytes_sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        // The peer is gone (EPIPE, ECONNRESET, ...); queued data can never go out
+        bandwidth_stream_->refund(grant.bytes);
+        logger_->error("Error sending to client " + client_addr_ + ": " + std::string(strerror(errno)));
+        disconnect();
+        return -1;
+    }
+    size_t written = bytes_sent > 0 ? static_cast<size_t>(bytes_sent) : 0;
+    span.setValue(written);
+    
+    // Socket buffer full: hand back what the kernel did not take
+    if (written < grant.bytes) {
+        bandwidth_stream_->refund(grant.bytes - written);
+    }
+    
+    countSent(written);
+    return static_cast<ssize_t>(written);
+}
+
+void FTPConnection::countSent(size_t bytes) {
+    if (bytes == 0) {
+        return;
+    }
+    
+    bytes_sent_ += bytes;
+    if (user_usage_) {
+        user_usage_->addBytesDownloaded(bytes);
+    }
+    if (vhost_usage_) {
+        vhost_usage_->addBytesDownloaded(bytes);
+    }
+    if (!statistics_) {
+        return;
+    }
+    
+    statistics_->addBytesTransferred(bytes);
+    if (first_byte_pending_) {
+        first_byte_pending_ = false;
+        statistics_->recordPhase(FTPTransferPhase::FIRST_BYTE, std::chrono::steady_clock::now() - command_started_);
+    }
+}
+
+void FTPConnection::finishTransfer(std::chrono::steady_clock::time_point now) {
+    if (!transfer_open_) {
+        return;
+    }
+    transfer_open_ = false;
+    
+    uint64_t sent = bytes_sent_ - command_bytes_start_;
+    if (statistics_ && sent > 0) {
+        statistics_->recordThroughput(sent, now - command_started_);
+    }
+}
+
+void FTPConnection::flushPendingData() {
+    while (hasPendingData()) {
+        ssize_t sent = sendShaped(pending_data_.data() + pending_offset_,
+                                  pending_data_.size() - pending_offset_);
+        if (sent < 0) {
+            // Disconnected; drop what can no longer be delivered
+            std::string().swap(pending_data_);
+            pending_offset_ = 0;
+            updateBufferBytes();
+            return;
+        }
+        if (sent == 0) {
+            break;
+        }
+        pending_offset_ += static_cast<size_t>(sent);
+    }
+    
+    if (!hasPendingData()) {
+        pending_data_.clear();
+        pending_offset_ = 0;
+        finishTransfer(std::chrono::steady_clock::now());
+    } else if (pending_offset_ > pending_data_.size() / 2) {
+        pending_data_.erase(0, pending_offset_);
+        pending_offset_ = 0;
+    }
+    updateBufferBytes();
+}
+
+size_t FTPConnection::releaseIdleBuffers(uint64_t generation) {
+    if (generation == buffer_release_generation_) {
+        return 0;
+    }
+    buffer_release_generation_ = generation;
+    
+    // Only an empty buffer is idle; queued data still has to go out
+    if (hasPendingData() || pending_data_.capacity() == 0) {
+        return 0;
+    }
+    
+    size_t released = pending_data_.capacity();
+    std::string().swap(pending_data_);
+    pending_offset_ = 0;
+    updateBufferBytes();
+    return released;
+}
+
+size_t FTPConnection::getBufferBytes() const {
+    return buffer_bytes_.load(std::memory_order_relaxed);
+}
+
+void FTPConnection::updateBufferBytes() {
+    // Published for the memory monitor, which must not touch the buffer
+    buffer_bytes_.store(pending_data_.capacity(), std::memory_order_relaxed);
+}
+
+bool FTPConnection::hasPendingData() const {
+    return pending_offset_ < pending_data_.size();
+}
+
+void FTPConnection::setBandwidthStream(std::shared_ptr<FTPBandwidthShaper::Stream> stream) {
+    bandwidth_stream_ = std::move(stream);
+}
+
+std::shared_ptr<FTPBandwidthShaper::Stream> FTPConnection::getBandwidthStream() const {
+    return bandwidth_stream_;
+}
+
+void FTPConnection::setStatistics(std::shared_ptr<FTPStatistics> statistics) {
+    statistics_ = std::move(statistics);
+}
+
+void FTPConnection::setUsageAccounting(std::shared_ptr<FTPUsageAccounting> accounting) {
+    usage_accounting_ = std::move(accounting);
+    user_usage_.reset();
+    vhost_usage_.reset();
+    if (!usage_accounting_) {
+        return;
     }
     
-    return false;
+    // Sessions without a virtual host bill to the default one
+    vhost_usage_ = usage_accounting_->getAccount(FTPUsageAccounting::Scope::VIRTUAL_HOST,
+                                                 virtual_host_ ? virtual_host_->getHostname() : "default");
+    vhost_usage_->countSession();
 }
 
 void FTPConnection::sendResponse(int code, const std::string& message) {
     std::string response = std::to_string(code) + " " + message + "\r\n";
+    
+    if (statistics_ && code >= 500) {
+        statistics_->incrementErrors();
+    }
+    
+    // A reply must not overtake the data it reports on
+    if (hasPendingData()) {
+        if (pending_data_.size() - pending_offset_ + response.length() > kMaxPendingBytes) {
+            // Still sending commands but not reading anything back
+            logger_->warn("Client " + client_addr_ + " is not reading replies, disconnecting");
+            disconnect();
+            return;
+        }
+        pending_data_.append(response);
+        updateBufferBytes();
+        return;
+    }
     send(client_socket_, response.c_str(), response.length(), 0);
 }
 
@@ -309,12 +594,34 @@ void FTPConnection::disconnect() {
     }
 }
 
+void FTPConnection::requestDisconnect() {
+    // Only the thread holding the processing claim may touch the sockets. If
+    // a worker holds it, endProcessing() closes them when it lets go
+    active_.store(false);
+    disconnect_requested_.store(true);
+    if (tryBeginProcessing()) {
+        endProcessing();
+    }
+}
+
+bool FTPConnection::isConnected() const {
+    return active_.load();
+}
+
+bool FTPConnection::isActive() const {
+    return active_.load();
+}
+
 void FTPConnection::process() {
     if (!active_.load()) {
         return;
     }
     
     try {
+        if (hasPendingData()) {
+            flushPendingData();
+        }
+        
         std::string command = readCommand();
         if (!command.empty()) {
             handleCommand(command);
@@ -329,6 +636,49 @@ void FTPConnection::setStartTime(const std::chrono::steady_clock::time_point& st
     start_time_ = start_time;
 }
 
+void FTPConnection::setSessionId(uint64_t session_id) {
+    session_id_ = session_id;
+}
+
+uint64_t FTPConnection::getSessionId() const {
+    return session_id_;
+}
+
+bool FTPConnection::tryBeginProcessing() {
+    bool expected = false;
+    return processing_.compare_exchange_strong(expected, true);
+}
+
+void FTPConnection::endProcessing() {
+    if (disconnect_requested_.load()) {
+        disconnect();
+    }
+    processing_.store(false);
+
+    // A request that arrived after the check above found the claim still
+    // held and left the close to us
+    if (disconnect_requested_.load() && tryBeginProcessing()) {
+        disconnect();
+        processing_.store(false);
+    }
+}
+
+void FTPConnection::setLoginCallback(std::function<void(const std::string&)> callback) {
+    login_callback_ = std::move(callback);
+}
+
+void FTPConnection::setLoginFailureCallback(std::function<bool()> callback) {
+    login_failure_callback_ = std::move(callback);
+}
+
+const FTPIPKey& FTPConnection::getClientKey() const {
+    return client_key_;
+}
+
+std::shared_ptr<FTPVirtualHost> FTPConnection::getVirtualHost() const {
+    return virtual_host_;
+}
+
 std::string FTPConnection::getUsername() const {
     return username_;
 }
@@ -0,0 +1,110 @@
+#include "ssftpd/ftp_connection_aggregates.hpp"
+
+namespace ssftpd {
+
+namespace {
+
+// Keys are rendered as text only for admin output
+const std::string& keyText(const std::string& key) {
+    return key;
+}
+
+std::string keyText(const FTPIPKey& key) {
+    return key.toString();
+}
+
+} // namespace
+
+void FTPConnectionAggregates::onConnect(const FTPIPKey& client_key, const std::string& virtual_host) {
+    increment(ips_, client_key);
+    increment(virtual_hosts_, virtual_host);
+    increment(users_, std::string());
+}
+
+void FTPConnectionAggregates::onLogin(const std::string& previous, const std::string& username) {
+    if (previous == username) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(users_.mutex);
+    size_t* count = users_.counts.find(previous);
+    if (count && --(*count) == 0) {
+        users_.counts.erase(previous);
+    }
+    users_.counts[username]++;
+}
+
+void FTPConnectionAggregates::onDisconnect(const FTPIPKey& client_key, const std::string& virtual_host,
+                                           const std::string& username) {
+    decrement(ips_, client_key);
+    decrement(virtual_hosts_, virtual_host);
+    decrement(users_, username);
+}
+
+std::map<std::string, size_t> FTPConnectionAggregates::getUserCounts() const {
+    return collect(users_);
+}
+
+std::map<std::string, size_t> FTPConnectionAggregates::getIPCounts() const {
+    return collect(ips_);
+}
+
+std::map<std::string, size_t> FTPConnectionAggregates::getVirtualHostCounts() const {
+    return collect(virtual_hosts_);
+}
+
+size_t FTPConnectionAggregates::getUserCount(const std::string& username) const {
+    return lookup(users_, username);
+}
+
+size_t FTPConnectionAggregates::getIPCount(const FTPIPKey& client_key) const {
+    return lookup(ips_, client_key);
+}
+
+void FTPConnectionAggregates::clear() {
+    for (auto* counter : {&users_, &virtual_hosts_}) {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        counter->counts.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(ips_.mutex);
+    ips_.counts.clear();
+}
+
+template <typename Key, typename Hash>
+void FTPConnectionAggregates::increment(Counter<Key, Hash>& counter, const Key& key) {
+    std::lock_guard<std::mutex> lock(counter.mutex);
+    counter.counts[key]++;
+}
+
+template <typename Key, typename Hash>
+void FTPConnectionAggregates::decrement(Counter<Key, Hash>& counter, const Key& key) {
+    std::lock_guard<std::mutex> lock(counter.mutex);
+
+    // Drop keys that reach zero so the maps only hold live sessions
+    size_t* count = counter.counts.find(key);
+    if (count && --(*count) == 0) {
+        counter.counts.erase(key);
+    }
+}
+
+template <typename Key, typename Hash>
+std::map<std::string, size_t> FTPConnectionAggregates::collect(const Counter<Key, Hash>& counter) {
+    std::map<std::string, size_t> result;
+
+    std::lock_guard<std::mutex> lock(counter.mutex);
+    counter.counts.forEach([&result](const Key& key, size_t count) {
+        result.emplace(keyText(key), count);
+    });
+
+    return result;
+}
+
+template <typename Key, typename Hash>
+size_t FTPConnectionAggregates::lookup(const Counter<Key, Hash>& counter, const Key& key) {
+    std::lock_guard<std::mutex> lock(counter.mutex);
+    const size_t* count = counter.counts.find(key);
+    return count ? *count : 0;
+}
+
+} // namespace ssftpd
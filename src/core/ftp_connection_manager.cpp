@@ -1,5 +1,9 @@
 #include "ssftpd/ftp_connection_manager.hpp"
 #include "ssftpd/logger.hpp"
+#include "ssftpd/ftp_task_scheduler.hpp"
+#include "ssftpd/ftp_bandwidth_shaper.hpp"
+#include "ssftpd/ftp_statistics.hpp"
+#include "ssftpd/ftp_usage_accounting.hpp"
 #include <algorithm>
 #include <chrono>
 #include <thread>
@@ -14,6 +18,9 @@ FTPConnectionManager::FTPConnectionManager(std::shared_ptr<FTPServerConfig> conf
     , max_connections_(config ? config->connection.max_connections : 100)
     , connection_timeout_(std::chrono::seconds(300)) // 5 minutes
     , cleanup_interval_(std::chrono::seconds(60))   // 1 minute
+    , snapshot_interval_(std::chrono::milliseconds(1000))
+    , buffer_release_generation_(0)
+    , released_buffer_bytes_(0)
 {
 }
 
@@ -48,13 +55,11 @@ void FTPConnectionManager::stop() {
     }
 
     // Close all connections
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    for (auto& connection : connections_) {
-        if (connection && connection->isConnected()) {
-            connection->disconnect();
+    for (auto& entry : registry_.clear()) {
+        if (entry.connection->isConnected()) {
+            entry.connection->requestDisconnect();
         }
     }
-    connections_.clear();
 
     logger_->info("FTP connection manager stopped");
 }
@@ -65,21 +70,55 @@ bool FTPConnectionManager::addConnection(std::shared_ptr<FTPConnection> connecti
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+    // Set connection start time before the session becomes visible
+    connection->setStartTime(std::chrono::steady_clock::now());
 
-    // Check connection limit
-    if (connections_.size() >= max_connections_) {
+    // Add connection; the registry enforces the limit atomically
+    auto virtual_host = connection->getVirtualHost();
+    auto session_id = registry_.add(connection, connection->getClientKey(),
+                                    virtual_host ? virtual_host->getHostname() : std::string(),
+                                    max_connections_);
+    if (session_id == FTPConnectionRegistry::kInvalidSessionId) {
         logger_->warn("Connection limit reached, cannot add new connection");
         return false;
     }
 
-    // Add connection
-    connections_.push_back(connection);
+    connection->setSessionId(session_id);
 
-    // Set connection start time
-    connection->setStartTime(std::chrono::steady_clock::now());
+    // Shape the session's sends against its vhost and the server budget
+    if (bandwidth_shaper_) {
+        connection->setBandwidthStream(bandwidth_shaper_->createStream(
+            virtual_host ? virtual_host->getHostname() : std::string(),
+            virtual_host ? virtual_host->getTransferConfig().max_transfer_rate : 0));
+    }
+
+    connection->setStatistics(statistics_);
+    if (usage_accounting_) {
+        connection->setUsageAccounting(usage_accounting_);
+    }
 
-    logger_->debug("Connection added, total connections: " + std::to_string(connections_.size()));
+    // Keep the user index current when the session logs in, and add the
+    // user's own bandwidth cap
+    std::weak_ptr<FTPConnection> weak_connection = connection;
+    connection->setLoginCallback([this, session_id, weak_connection](const std::string& username) {
+        registry_.updateUsername(session_id, username);
+
+        auto session = weak_connection.lock();
+        auto stream = session ? session->getBandwidthStream() : nullptr;
+        if (stream) {
+            stream->setUser(username);
+        }
+    });
+
+    if (login_failure_handler_) {
+        auto handler = login_failure_handler_;
+        FTPIPKey client_key = connection->getClientKey();
+        connection->setLoginFailureCallback([handler, client_key]() {
+            return handler(client_key);
+        });
+    }
+
+    logger_->debug("Connection added, total connections: " + std::to_string(registry_.size()));
     return true;
 }
 
@@ -88,55 +127,131 @@ void FTPConnectionManager::removeConnection(std::shared_ptr<FTPConnection> conne
         return;
     }
 
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-
-    auto it = std::find(connections_.begin(), connections_.end(), connection);
-    if (it != connections_.end()) {
-        connections_.erase(it);
-        logger_->debug("Connection removed, total connections: " + std::to_string(connections_.size()));
+    if (registry_.remove(connection->getSessionId())) {
+        logger_->debug("Connection removed, total connections: " + std::to_string(registry_.size()));
     }
 }
 
-void FTPConnectionManager::processConnections() {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+size_t FTPConnectionManager::processConnections() {
+    // Work one shard at a time and run session I/O outside the shard lock,
+    // so adds, removes and lookups are never blocked behind a slow session
+    std::vector<FTPConnectionRegistry::Entry> batch;
+    auto scheduler = scheduler_;
+    bool use_scheduler = scheduler && scheduler->isRunning();
+    size_t dispatched = 0;
+
+    for (size_t shard = 0; shard < FTPConnectionRegistry::shardCount(); ++shard) {
+        registry_.snapshotShard(shard, batch);
+
+        for (auto& entry : batch) {
+            // A session already queued or running on a worker, or being
+            // closed by another thread, is skipped; each session is
+            // processed by at most one thread at a time
+            if (!entry.connection->tryBeginProcessing()) {
+                continue;
+            }
 
-    auto it = connections_.begin();
-    while (it != connections_.end()) {
-        auto connection = *it;
+            if (!use_scheduler) {
+                processSession(entry);
+                entry.connection->endProcessing();
+                dispatched++;
+                continue;
+            }
 
-        if (!connection) {
-            // Remove null connections
-            it = connections_.erase(it);
-            continue;
-        }
+            auto connection = entry.connection;
+            bool queued = scheduler->submit([this, entry]() {
+                processSession(entry);
+                entry.connection->endProcessing();
+            }, FTPTaskScheduler::TaskClass::SESSION);
 
-        // Check if connection is still alive
-        if (!connection->isConnected()) {
-            logger_->debug("Connection disconnected, removing");
-            it = connections_.erase(it);
-            continue;
+            if (!queued) {
+                processSession(entry);
+                connection->endProcessing();
+            }
+            dispatched++;
         }
+    }
 
-        // Process the connection
-        try {
-            connection->process();
-        } catch (const std::exception& e) {
-            logger_->error("Error processing connection: " + std::string(e.what()));
-            connection->disconnect();
-            it = connections_.erase(it);
-            continue;
-        }
+    return dispatched;
+}
+
+void FTPConnectionManager::processSession(const FTPConnectionRegistry::Entry& entry) {
+    // Runs with the session's processing claim held, so it may close the
+    // sockets directly
+    const auto& connection = entry.connection;
+
+    // Check if connection is still alive
+    if (!connection->isConnected()) {
+        logger_->debug("Connection disconnected, removing");
+        registry_.remove(entry.session_id);
+        return;
+    }
 
-        // Check connection timeout
-        if (isConnectionTimedOut(connection)) {
-            logger_->warn("Connection timed out, disconnecting");
-            connection->disconnect();
-            it = connections_.erase(it);
-            continue;
+    // Drop idle send buffers when the memory monitor asks; done here because
+    // only the worker processing a session may touch its buffers
+    uint64_t release_generation = buffer_release_generation_.load(std::memory_order_relaxed);
+    if (release_generation != 0) {
+        size_t released = connection->releaseIdleBuffers(release_generation);
+        if (released > 0) {
+            released_buffer_bytes_.fetch_add(released, std::memory_order_relaxed);
         }
+    }
+
+    // Process the connection
+    try {
+        connection->process();
+    } catch (const std::exception& e) {
+        logger_->error("Error processing connection: " + std::string(e.what()));
+        connection->disconnect();
+        registry_.remove(entry.session_id);
+        return;
+    }
+
+    // Check connection timeout
+    if (isConnectionTimedOut(connection)) {
+        logger_->warn("Connection timed out, disconnecting");
+        connection->disconnect();
+        registry_.remove(entry.session_id);
+    }
+}
+
+void FTPConnectionManager::releaseIdleBuffers() {
+    buffer_release_generation_.fetch_add(1, std::memory_order_relaxed);
+}
 
-        ++it;
+size_t FTPConnectionManager::getBufferBytes() const {
+    size_t total = 0;
+    for (size_t shard = 0; shard < FTPConnectionRegistry::shardCount(); ++shard) {
+        registry_.forEachInShard(shard, [&total](FTPConnectionRegistry::SessionId, const FTPConnection& connection,
+                                                 const FTPIPKey&, const std::string&, const std::string&) {
+            total += connection.getBufferBytes();
+        });
     }
+    return total;
+}
+
+uint64_t FTPConnectionManager::getReleasedBufferBytes() const {
+    return released_buffer_bytes_.load(std::memory_order_relaxed);
+}
+
+void FTPConnectionManager::setTaskScheduler(std::shared_ptr<FTPTaskScheduler> scheduler) {
+    scheduler_ = scheduler;
+}
+
+void FTPConnectionManager::setBandwidthShaper(std::shared_ptr<FTPBandwidthShaper> shaper) {
+    bandwidth_shaper_ = shaper;
+}
+
+void FTPConnectionManager::setStatistics(std::shared_ptr<FTPStatistics> statistics) {
+    statistics_ = statistics;
+}
+
+void FTPConnectionManager::setUsageAccounting(std::shared_ptr<FTPUsageAccounting> accounting) {
+    usage_accounting_ = accounting;
+}
+
+void FTPConnectionManager::setLoginFailureHandler(std::function<bool(const FTPIPKey&)> handler) {
+    login_failure_handler_ = std::move(handler);
 }
 
 bool FTPConnectionManager::isConnectionTimedOut(std::shared_ptr<FTPConnection> connection) const {
@@ -152,21 +267,25 @@ bool FTPConnectionManager::isConnectionTimedOut(std::shared_ptr<FTPConnection> c
 }
 
 size_t FTPConnectionManager::getConnectionCount() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    return connections_.size();
+    return registry_.size();
 }
 
 std::vector<std::shared_ptr<FTPConnection>> FTPConnectionManager::getConnections() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    return connections_;
+    std::vector<std::shared_ptr<FTPConnection>> connections;
+    auto entries = registry_.snapshot();
+    connections.reserve(entries.size());
+
+    for (auto& entry : entries) {
+        connections.push_back(std::move(entry.connection));
+    }
+
+    return connections;
 }
 
 void FTPConnectionManager::disconnectAll() {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-
-    for (auto& connection : connections_) {
-        if (connection && connection->isConnected()) {
-            connection->disconnect();
+    for (const auto& entry : registry_.snapshot()) {
+        if (entry.connection->isConnected()) {
+            entry.connection->requestDisconnect();
         }
     }
 
@@ -174,45 +293,39 @@ void FTPConnectionManager::disconnectAll() {
 }
 
 void FTPConnectionManager::disconnectByIP(const std::string& ip_address) {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+    FTPIPKey client_key;
+    if (!FTPIPKey::parse(ip_address, client_key)) {
+        logger_->warn("Cannot disconnect invalid IP address: " + ip_address);
+        return;
+    }
 
-    size_t disconnected_count = 0;
-    auto it = connections_.begin();
+    disconnectByIP(client_key);
+}
 
-    while (it != connections_.end()) {
-        auto connection = *it;
+void FTPConnectionManager::disconnectByIP(const FTPIPKey& client_key) {
+    size_t disconnected_count = 0;
 
-        if (connection && connection->getClientIP() == ip_address) {
-            connection->disconnect();
-            it = connections_.erase(it);
-            disconnected_count++;
-        } else {
-            ++it;
-        }
+    // Only the sessions from this address are touched
+    for (const auto& entry : registry_.findByIP(client_key)) {
+        entry.connection->requestDisconnect();
+        registry_.remove(entry.session_id);
+        disconnected_count++;
     }
 
     if (disconnected_count > 0) {
         logger_->info("Disconnected " + std::to_string(disconnected_count) +
-                     " connections from IP: " + ip_address);
+                     " connections from IP: " + client_key.toString());
     }
 }
 
 void FTPConnectionManager::disconnectByUser(const std::string& username) {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-
     size_t disconnected_count = 0;
-    auto it = connections_.begin();
 
-    while (it != connections_.end()) {
-        auto connection = *it;
-
-        if (connection && connection->getUsername() == username) {
-            connection->disconnect();
-            it = connections_.erase(it);
-            disconnected_count++;
-        } else {
-            ++it;
-        }
+    // Only the sessions logged in as this user are touched
+    for (const auto& entry : registry_.findByUser(username)) {
+        entry.connection->requestDisconnect();
+        registry_.remove(entry.session_id);
+        disconnected_count++;
     }
 
     if (disconnected_count > 0) {
@@ -237,112 +350,139 @@ void FTPConnectionManager::setCleanupInterval(std::chrono::seconds interval) {
 }
 
 void FTPConnectionManager::cleanupLoop() {
+    auto last_cleanup = std::chrono::steady_clock::now();
+
     while (running_) {
-        // Sleep for cleanup interval
-        std::this_thread::sleep_for(cleanup_interval_);
+        // Wake at the snapshot interval; cleanup runs less often
+        std::this_thread::sleep_for(snapshot_interval_);
 
         if (!running_) {
             break;
         }
 
-        // Perform cleanup
-        cleanupConnections();
+        if (std::chrono::steady_clock::now() - last_cleanup >= cleanup_interval_) {
+            cleanupConnections();
+            last_cleanup = std::chrono::steady_clock::now();
+        }
+
+        // Publish session metadata for lock-free readers
+        publishSnapshot();
     }
 }
 
-void FTPConnectionManager::cleanupConnections() {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+void FTPConnectionManager::publishSnapshot() {
+    std::vector<FTPSessionInfo> sessions;
+    sessions.reserve(registry_.size());
+
+    // Copy metadata under each shard lock in turn; no session refcounts are
+    // touched and no lock is held across shards
+    for (size_t shard = 0; shard < FTPConnectionRegistry::shardCount(); ++shard) {
+        registry_.forEachInShard(shard, [&sessions](FTPConnectionRegistry::SessionId session_id,
+                                                    const FTPConnection& connection,
+                                                    const FTPIPKey& client_key,
+                                                    const std::string& virtual_host,
+                                                    const std::string& username) {
+            FTPSessionInfo info;
+            info.session_id = session_id;
+            info.client_key = client_key;
+            info.username = username;
+            info.virtual_host = virtual_host;
+            info.start_time = connection.getStartTime();
+            info.last_activity = connection.getLastActivity();
+            info.bytes_transferred = connection.getBytesTransferred();
+            info.commands_executed = connection.getCommandsExecuted();
+            sessions.push_back(std::move(info));
+        });
+    }
 
-    size_t initial_count = connections_.size();
-    auto it = connections_.begin();
+    snapshots_.publish(std::move(sessions));
+}
 
-    while (it != connections_.end()) {
-        auto connection = *it;
+FTPSessionSnapshotPublisher::ReadHandle FTPConnectionManager::readSnapshot() const {
+    return snapshots_.read();
+}
 
-        if (!connection) {
-            // Remove null connections
-            it = connections_.erase(it);
-            continue;
-        }
+void FTPConnectionManager::setSnapshotInterval(std::chrono::milliseconds interval) {
+    snapshot_interval_ = interval;
+    logger_->info("Session snapshot interval set to " + std::to_string(interval.count()) + " ms");
+}
 
-        // Check for timed out connections
-        if (isConnectionTimedOut(connection)) {
-            logger_->debug("Cleaning up timed out connection");
-            connection->disconnect();
-            it = connections_.erase(it);
-            continue;
-        }
+void FTPConnectionManager::cleanupConnections() {
+    size_t removed_count = 0;
+    std::vector<FTPConnectionRegistry::Entry> batch;
+
+    for (size_t shard = 0; shard < FTPConnectionRegistry::shardCount(); ++shard) {
+        registry_.snapshotShard(shard, batch);
+
+        for (const auto& entry : batch) {
+            const auto& connection = entry.connection;
+
+            // Check for timed out connections
+            if (isConnectionTimedOut(connection)) {
+                logger_->debug("Cleaning up timed out connection");
+                connection->requestDisconnect();
+                if (registry_.remove(entry.session_id)) {
+                    removed_count++;
+                }
+                continue;
+            }
 
-        // Check for inactive connections
-        if (!connection->isActive()) {
-            logger_->debug("Cleaning up inactive connection");
-            connection->disconnect();
-            it = connections_.erase(it);
-            continue;
+            // Check for inactive connections
+            if (!connection->isActive()) {
+                logger_->debug("Cleaning up inactive connection");
+                connection->requestDisconnect();
+                if (registry_.remove(entry.session_id)) {
+                    removed_count++;
+                }
+            }
         }
-
-        ++it;
     }
 
-    size_t final_count = connections_.size();
-    if (final_count < initial_count) {
-        logger_->info("Cleanup removed " + std::to_string(initial_count - final_count) +
-                     " connections, remaining: " + std::to_string(final_count));
+    if (removed_count > 0) {
+        logger_->info("Cleanup removed " + std::to_string(removed_count) +
+                     " connections, remaining: " + std::to_string(registry_.size()));
     }
 }
 
 std::map<std::string, size_t> FTPConnectionManager::getConnectionStats() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-
-    std::map<std::string, size_t> stats;
+    auto stats = registry_.aggregates().getUserCounts();
 
-    for (const auto& connection : connections_) {
-        if (connection) {
-            std::string username = connection->getUsername();
-            if (username.empty()) {
-                username = "anonymous";
-            }
-
-            stats[username]++;
-        }
+    // Sessions that have not logged in are reported as anonymous
+    auto it = stats.find(std::string());
+    if (it != stats.end()) {
+        stats["anonymous"] += it->second;
+        stats.erase(it);
     }
 
     return stats;
 }
 
 std::map<std::string, size_t> FTPConnectionManager::getIPStats() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-
-    std::map<std::string, size_t> stats;
-
-    for (const auto& connection : connections_) {
-        if (connection) {
-            std::string ip = connection->getClientIP();
-            stats[ip]++;
-        }
-    }
+    return registry_.aggregates().getIPCounts();
+}
 
-    return stats;
+std::map<std::string, size_t> FTPConnectionManager::getVirtualHostStats() const {
+    return registry_.aggregates().getVirtualHostCounts();
 }
 
 void FTPConnectionManager::getConnectionInfo(std::vector<ConnectionInfo>& info) const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+    // Served from the published snapshot, so admin polling never contends
+    // with the session shards; data is at most one snapshot interval old
+    auto snapshot = snapshots_.read();
 
     info.clear();
-    info.reserve(connections_.size());
-
-    for (const auto& connection : connections_) {
-        if (connection) {
-            ConnectionInfo conn_info;
-            conn_info.client_ip = connection->getClientIP();
-            conn_info.username = connection->getUsername();
-            conn_info.start_time = connection->getStartTime();
-            conn_info.last_activity = connection->getLastActivity();
-            conn_info.bytes_transferred = connection->getBytesTransferred();
-            conn_info.commands_executed = connection->getCommandsExecuted();
-
-            info.push_back(conn_info);
-        }
+    info.reserve(snapshot->sessions.size());
+
+    for (const auto& session : snapshot->sessions) {
+        ConnectionInfo conn_info;
+        conn_info.client_ip = session.client_key.toString();
+        conn_info.username = session.username;
+        conn_info.start_time = session.start_time;
+        conn_info.last_activity = session.last_activity;
+        conn_info.bytes_transferred = session.bytes_transferred;
+        conn_info.commands_executed = session.commands_executed;
+
+        info.push_back(conn_info);
     }
 }
 
@@ -0,0 +1,236 @@
+#include "ssftpd/ftp_connection_registry.hpp"
+#include <functional>
+
+namespace ssftpd {
+
+namespace {
+
+// High hash bits pick the index shard; the shard's map uses the low ones
+template <typename Key, typename Hash>
+size_t indexShardFor(const Key& key, size_t shard_count) {
+    return (static_cast<uint64_t>(Hash{}(key)) >> 32) & (shard_count - 1);
+}
+
+} // namespace
+
+FTPConnectionRegistry::FTPConnectionRegistry()
+    : next_session_id_(1)
+    , size_(0)
+{
+    static_assert((kShardCount & (kShardCount - 1)) == 0, "shard count must be a power of two");
+}
+
+FTPConnectionRegistry::~FTPConnectionRegistry() = default;
+
+FTPConnectionRegistry::SessionId FTPConnectionRegistry::add(std::shared_ptr<FTPConnection> connection,
+                                                            const FTPIPKey& client_key,
+                                                            const std::string& virtual_host,
+                                                            size_t limit) {
+    if (!connection) {
+        return kInvalidSessionId;
+    }
+
+    // Reserve a slot first so concurrent adds cannot overshoot the limit
+    size_t current = size_.load(std::memory_order_relaxed);
+    do {
+        if (limit > 0 && current >= limit) {
+            return kInvalidSessionId;
+        }
+    } while (!size_.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+
+    SessionId session_id = next_session_id_.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        Shard& shard = shardFor(session_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sessions.emplace(session_id, Session{std::move(connection), client_key, virtual_host, std::string()});
+        aggregates_.onConnect(client_key, virtual_host);
+    }
+
+    indexAdd(ip_index_, client_key, session_id);
+
+    // The id is visible once the shard lock drops, so a remove() may have
+    // run before the index entry existed and left nothing to clean up
+    if (!find(session_id)) {
+        indexRemove(ip_index_, client_key, session_id);
+    }
+    return session_id;
+}
+
+std::shared_ptr<FTPConnection> FTPConnectionRegistry::remove(SessionId session_id) {
+    Session removed;
+
+    {
+        Shard& shard = shardFor(session_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(session_id);
+        if (it == shard.sessions.end()) {
+            return nullptr;
+        }
+
+        removed = std::move(it->second);
+        shard.sessions.erase(it);
+        aggregates_.onDisconnect(removed.client_key, removed.virtual_host, removed.username);
+    }
+
+    size_.fetch_sub(1, std::memory_order_relaxed);
+
+    indexRemove(ip_index_, removed.client_key, session_id);
+    if (!removed.username.empty()) {
+        indexRemove(user_index_, removed.username, session_id);
+    }
+
+    return removed.connection;
+}
+
+std::shared_ptr<FTPConnection> FTPConnectionRegistry::find(SessionId session_id) const {
+    const Shard& shard = shardFor(session_id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.sessions.find(session_id);
+    return it != shard.sessions.end() ? it->second.connection : nullptr;
+}
+
+void FTPConnectionRegistry::updateUsername(SessionId session_id, const std::string& username) {
+    std::string previous;
+
+    {
+        Shard& shard = shardFor(session_id);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(session_id);
+        if (it == shard.sessions.end() || it->second.username == username) {
+            return;
+        }
+
+        previous = std::move(it->second.username);
+        it->second.username = username;
+        aggregates_.onLogin(previous, username);
+    }
+
+    if (!previous.empty()) {
+        indexRemove(user_index_, previous, session_id);
+    }
+    if (!username.empty()) {
+        indexAdd(user_index_, username, session_id);
+
+        // A concurrent remove() may have run between the two locks and
+        // cleaned up the old name only
+        if (!find(session_id)) {
+            indexRemove(user_index_, username, session_id);
+        }
+    }
+}
+
+std::vector<FTPConnectionRegistry::Entry> FTPConnectionRegistry::findByIP(const FTPIPKey& client_key) const {
+    return indexLookup(ip_index_, client_key);
+}
+
+std::vector<FTPConnectionRegistry::Entry> FTPConnectionRegistry::findByUser(const std::string& username) const {
+    return indexLookup(user_index_, username);
+}
+
+void FTPConnectionRegistry::snapshotShard(size_t shard_index, std::vector<Entry>& out) const {
+    out.clear();
+
+    const Shard& shard = shards_[shard_index & (kShardCount - 1)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    out.reserve(shard.sessions.size());
+    for (const auto& pair : shard.sessions) {
+        out.push_back(Entry{pair.first, pair.second.connection});
+    }
+}
+
+std::vector<FTPConnectionRegistry::Entry> FTPConnectionRegistry::snapshot() const {
+    std::vector<Entry> result;
+    result.reserve(size());
+
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (const auto& pair : shard.sessions) {
+            result.push_back(Entry{pair.first, pair.second.connection});
+        }
+    }
+
+    return result;
+}
+
+std::vector<FTPConnectionRegistry::Entry> FTPConnectionRegistry::clear() {
+    std::vector<Entry> removed;
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& pair : shard.sessions) {
+            const Session& session = pair.second;
+            aggregates_.onDisconnect(session.client_key, session.virtual_host, session.username);
+            removed.push_back(Entry{pair.first, std::move(pair.second.connection)});
+        }
+        size_.fetch_sub(shard.sessions.size(), std::memory_order_relaxed);
+        shard.sessions.clear();
+    }
+
+    for (auto& shard : ip_index_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sessions.clear();
+    }
+    for (auto& shard : user_index_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.sessions.clear();
+    }
+
+    return removed;
+}
+
+template <typename Key, typename Hash>
+void FTPConnectionRegistry::indexAdd(Index<Key, Hash>& index, const Key& key, SessionId session_id) {
+    auto& shard = index[indexShardFor<Key, Hash>(key, kShardCount)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.sessions[key].insert(session_id);
+}
+
+template <typename Key, typename Hash>
+void FTPConnectionRegistry::indexRemove(Index<Key, Hash>& index, const Key& key, SessionId session_id) {
+    auto& shard = index[indexShardFor<Key, Hash>(key, kShardCount)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.sessions.find(key);
+    if (it == shard.sessions.end()) {
+        return;
+    }
+
+    it->second.erase(session_id);
+    if (it->second.empty()) {
+        shard.sessions.erase(it);
+    }
+}
+
+template <typename Key, typename Hash>
+std::vector<FTPConnectionRegistry::Entry> FTPConnectionRegistry::indexLookup(const Index<Key, Hash>& index,
+                                                                             const Key& key) const {
+    std::vector<SessionId> session_ids;
+    {
+        const auto& shard = index[indexShardFor<Key, Hash>(key, kShardCount)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(key);
+        if (it == shard.sessions.end()) {
+            return {};
+        }
+        session_ids.assign(it->second.begin(), it->second.end());
+    }
+
+    std::vector<Entry> result;
+    result.reserve(session_ids.size());
+    for (SessionId session_id : session_ids) {
+        auto connection = find(session_id);
+        if (connection) {
+            result.push_back(Entry{session_id, std::move(connection)});
+        }
+    }
+
+    return result;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,100 @@
+#include "ssftpd/ftp_epoch.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace ssftpd {
+
+FTPEpochDomain::Guard::Guard(const FTPEpochDomain& domain)
+    : domain_(domain)
+    , slot_(domain.enter())
+{
+}
+
+FTPEpochDomain::Guard::~Guard() {
+    domain_.exit(slot_);
+}
+
+FTPEpochDomain::FTPEpochDomain()
+    : global_epoch_(1)
+{
+}
+
+FTPEpochDomain::~FTPEpochDomain() {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    for (auto& retired : retired_) {
+        retired.deleter();
+    }
+    retired_.clear();
+}
+
+size_t FTPEpochDomain::enter() const {
+    // Start from a per-thread position so concurrent readers rarely collide
+    size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id()) % kMaxReaders;
+
+    while (true) {
+        for (size_t i = 0; i < kMaxReaders; ++i) {
+            size_t slot = (start + i) % kMaxReaders;
+            uint64_t expected = kIdle;
+
+            // The slot must hold the epoch before the reader loads any
+            // published pointer; seq_cst orders it against the writer's swap
+            if (readers_[slot].epoch.compare_exchange_strong(expected, global_epoch_.load())) {
+                return slot;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void FTPEpochDomain::exit(size_t slot) const {
+    readers_[slot].epoch.store(kIdle, std::memory_order_release);
+}
+
+void FTPEpochDomain::retire(std::function<void()> deleter) {
+    // Readers that entered at or before this epoch may hold the old data;
+    // anyone entering later sees only the replacement
+    uint64_t epoch = global_epoch_.fetch_add(1);
+
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    retired_.push_back(Retired{epoch, std::move(deleter)});
+}
+
+size_t FTPEpochDomain::reclaim() {
+    std::vector<Retired> ready;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        uint64_t oldest = oldestActiveEpoch();
+
+        auto it = std::partition(retired_.begin(), retired_.end(),
+                                 [oldest](const Retired& retired) { return retired.epoch >= oldest; });
+        ready.assign(std::make_move_iterator(it), std::make_move_iterator(retired_.end()));
+        retired_.erase(it, retired_.end());
+    }
+
+    // Deleters run outside the lock
+    for (auto& retired : ready) {
+        retired.deleter();
+    }
+
+    return ready.size();
+}
+
+size_t FTPEpochDomain::pendingCount() const {
+    std::lock_guard<std::mutex> lock(retired_mutex_);
+    return retired_.size();
+}
+
+uint64_t FTPEpochDomain::oldestActiveEpoch() const {
+    uint64_t oldest = global_epoch_.load();
+
+    for (const auto& reader : readers_) {
+        uint64_t epoch = reader.epoch.load();
+        if (epoch != kIdle) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+
+    return oldest;
+}
+
+} // namespace ssftpd
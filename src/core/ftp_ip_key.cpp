@@ -0,0 +1,75 @@
+#include "ssftpd/ftp_ip_key.hpp"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace ssftpd {
+
+namespace {
+
+const uint8_t kIPv4MappedPrefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+} // namespace
+
+bool FTPIPKey::parse(const std::string& address, FTPIPKey& key) {
+    struct in_addr v4;
+    if (inet_pton(AF_INET, address.c_str(), &v4) == 1) {
+        key = fromIPv4(v4.s_addr);
+        return true;
+    }
+
+    struct in6_addr v6;
+    if (inet_pton(AF_INET6, address.c_str(), &v6) == 1) {
+        std::memcpy(key.bytes.data(), &v6, 16);
+        return true;
+    }
+
+    return false;
+}
+
+bool FTPIPKey::fromSockaddr(const struct sockaddr* address, FTPIPKey& key) {
+    if (!address) {
+        return false;
+    }
+
+    if (address->sa_family == AF_INET) {
+        const auto* v4 = reinterpret_cast<const struct sockaddr_in*>(address);
+        key = fromIPv4(v4->sin_addr.s_addr);
+        return true;
+    }
+
+    if (address->sa_family == AF_INET6) {
+        const auto* v6 = reinterpret_cast<const struct sockaddr_in6*>(address);
+        std::memcpy(key.bytes.data(), &v6->sin6_addr, 16);
+        return true;
+    }
+
+    return false;
+}
+
+FTPIPKey FTPIPKey::fromIPv4(uint32_t address) {
+    FTPIPKey key;
+    std::memcpy(key.bytes.data(), kIPv4MappedPrefix, sizeof(kIPv4MappedPrefix));
+    std::memcpy(key.bytes.data() + 12, &address, 4);
+    return key;
+}
+
+bool FTPIPKey::isIPv4() const {
+    return std::memcmp(bytes.data(), kIPv4MappedPrefix, sizeof(kIPv4MappedPrefix)) == 0;
+}
+
+std::string FTPIPKey::toString() const {
+    char buffer[INET6_ADDRSTRLEN];
+
+    if (isIPv4()) {
+        if (!inet_ntop(AF_INET, bytes.data() + 12, buffer, sizeof(buffer))) {
+            return std::string();
+        }
+    } else if (!inet_ntop(AF_INET6, bytes.data(), buffer, sizeof(buffer))) {
+        return std::string();
+    }
+
+    return buffer;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,77 @@
+#include "ssftpd/ftp_latency_histogram.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace ssftpd {
+
+FTPLatencyHistogram::FTPLatencyHistogram() {
+}
+
+uint64_t FTPLatencyHistogram::bucketUpperBound(size_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    size_t shift = bucket / (kSubBuckets / 2) - 1;
+    uint64_t sub_bucket = bucket - shift * (kSubBuckets / 2);
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+FTPLatencyHistogram::Snapshot FTPLatencyHistogram::snapshot() const {
+    Snapshot snapshot;
+    snapshot.counts.assign(kBucketCount, 0);
+
+    for (const auto& shard : shards_) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            uint64_t count = shard.counts[i].load(std::memory_order_relaxed);
+            snapshot.counts[i] += count;
+            snapshot.count += count;
+        }
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+        snapshot.max = std::max(snapshot.max, shard.max.load(std::memory_order_relaxed));
+    }
+
+    return snapshot;
+}
+
+void FTPLatencyHistogram::reset() {
+    for (auto& shard : shards_) {
+        for (auto& count : shard.counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        shard.sum.store(0, std::memory_order_relaxed);
+        shard.max.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64_t FTPLatencyHistogram::Snapshot::percentile(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    double clamped = std::min(std::max(percentile, 0.0), 100.0);
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(clamped / 100.0 * count)));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            // The bucket bound can overshoot the largest value recorded
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+void FTPLatencyHistogram::Snapshot::merge(const Snapshot& other) {
+    if (counts.size() < other.counts.size()) {
+        counts.resize(other.counts.size(), 0);
+    }
+    for (size_t i = 0; i < other.counts.size(); ++i) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+} // namespace ssftpd
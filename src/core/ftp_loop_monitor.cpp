@@ -0,0 +1,283 @@
+#include "ssftpd/ftp_loop_monitor.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+
+namespace ssftpd {
+
+struct alignas(64) FTPLoopMonitor::Reactor {
+    explicit Reactor(const std::string& reactor_name)
+        : name(reactor_name)
+    {
+    }
+
+    std::string name;
+    FTPLatencyHistogram iteration_us;
+    FTPLatencyHistogram handler_us;
+    FTPLatencyHistogram batch_size;
+    std::atomic<size_t> queue_depth{0};
+    std::atomic<uint64_t> stalls{0};
+
+    // The running handler; written by the reactor thread, read by the watchdog
+    std::atomic<int64_t> handler_started_ns{0};  // 0 while idle
+    std::atomic<uint64_t> handler_sequence{0};
+    std::atomic<size_t> depth{0};
+    std::array<std::atomic<const char*>, kMaxTags> tags{};
+    std::array<std::atomic<uint64_t>, kMaxTags> details{};
+
+    uint64_t warned_sequence = 0;  // Watchdog only
+
+    void push(const char* tag, uint64_t detail) {
+        size_t current = depth.load(std::memory_order_relaxed);
+        if (current < kMaxTags) {
+            tags[current].store(tag, std::memory_order_relaxed);
+            details[current].store(detail, std::memory_order_relaxed);
+        }
+        depth.store(current + 1, std::memory_order_release);
+    }
+
+    void pop() {
+        depth.store(depth.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+    }
+};
+
+namespace {
+
+// The reactor the current thread belongs to, if any
+thread_local void* current_reactor = nullptr;
+
+int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+uint64_t toMicroseconds(std::chrono::steady_clock::duration elapsed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return micros > 0 ? static_cast<uint64_t>(micros) : 0;
+}
+
+uint64_t packDetail(const std::string& detail) {
+    uint64_t packed = 0;
+    size_t length = std::min<size_t>(detail.size(), 8);
+    for (size_t i = 0; i < length; ++i) {
+        packed |= static_cast<uint64_t>(static_cast<unsigned char>(detail[i])) << (i * 8);
+    }
+    return packed;
+}
+
+std::string unpackDetail(uint64_t packed) {
+    std::string detail;
+    for (; packed != 0; packed >>= 8) {
+        char c = static_cast<char>(packed & 0xff);
+        detail += (c >= 0x20 && c < 0x7f) ? c : '?';
+    }
+    return detail;
+}
+
+} // namespace
+
+FTPLoopMonitor::HandlerScope::HandlerScope(const char* tag)
+    : reactor_(current_reactor)
+    , outermost_(false)
+{
+    auto* reactor = static_cast<Reactor*>(reactor_);
+    if (!reactor) {
+        return;
+    }
+
+    outermost_ = reactor->depth.load(std::memory_order_relaxed) == 0;
+    reactor->push(tag, 0);
+    if (outermost_) {
+        started_ = std::chrono::steady_clock::now();
+        reactor->handler_sequence.fetch_add(1, std::memory_order_relaxed);
+        reactor->handler_started_ns.store(toNanoseconds(started_), std::memory_order_release);
+    }
+}
+
+FTPLoopMonitor::HandlerScope::~HandlerScope() {
+    auto* reactor = static_cast<Reactor*>(reactor_);
+    if (!reactor) {
+        return;
+    }
+
+    if (outermost_) {
+        reactor->handler_started_ns.store(0, std::memory_order_release);
+        reactor->handler_us.record(toMicroseconds(std::chrono::steady_clock::now() - started_));
+    }
+    reactor->pop();
+}
+
+FTPLoopMonitor::TagScope::TagScope(const char* tag, const std::string& detail)
+    : reactor_(current_reactor)
+{
+    if (reactor_) {
+        static_cast<Reactor*>(reactor_)->push(tag, packDetail(detail));
+    }
+}
+
+FTPLoopMonitor::TagScope::~TagScope() {
+    if (reactor_) {
+        static_cast<Reactor*>(reactor_)->pop();
+    }
+}
+
+FTPLoopMonitor::FTPLoopMonitor(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , budget_(config ? config->handler_budget : std::chrono::milliseconds(100))
+    , reactor_count_(0)
+    , running_(false)
+{
+}
+
+FTPLoopMonitor::~FTPLoopMonitor() {
+    stop();
+}
+
+size_t FTPLoopMonitor::addReactor(const std::string& name) {
+    std::lock_guard<std::mutex> lock(reactors_mutex_);
+
+    size_t id = reactor_count_.load(std::memory_order_relaxed);
+    if (id >= kMaxReactors) {
+        logger_->warn("Loop monitor is full; reactor " + name + " is not monitored");
+        return kMaxReactors;
+    }
+    reactors_[id] = std::make_unique<Reactor>(name);
+    reactor_count_.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+FTPLoopMonitor::Reactor* FTPLoopMonitor::getReactor(size_t reactor) const {
+    return reactor < reactor_count_.load(std::memory_order_acquire) ? reactors_[reactor].get() : nullptr;
+}
+
+void FTPLoopMonitor::attachThread(size_t reactor) {
+    current_reactor = getReactor(reactor);
+}
+
+void FTPLoopMonitor::detachThread() {
+    current_reactor = nullptr;
+}
+
+void FTPLoopMonitor::recordIteration(size_t reactor, std::chrono::steady_clock::duration busy, size_t batch_size) {
+    Reactor* target = getReactor(reactor);
+    if (target) {
+        target->iteration_us.record(toMicroseconds(busy));
+        target->batch_size.record(batch_size);
+    }
+}
+
+void FTPLoopMonitor::setQueueDepth(size_t reactor, size_t depth) {
+    Reactor* target = getReactor(reactor);
+    if (target) {
+        target->queue_depth.store(depth, std::memory_order_relaxed);
+    }
+}
+
+bool FTPLoopMonitor::start() {
+    if (budget_.count() <= 0) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(watchdog_mutex_);
+    if (running_) {
+        return true;
+    }
+    running_ = true;
+    watchdog_thread_ = std::thread(&FTPLoopMonitor::watchdogLoop, this);
+    return true;
+}
+
+void FTPLoopMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(watchdog_mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    watchdog_condition_.notify_all();
+
+    if (watchdog_thread_.joinable()) {
+        watchdog_thread_.join();
+    }
+}
+
+std::vector<FTPLoopMonitor::ReactorStats> FTPLoopMonitor::getStats() const {
+    size_t count = reactor_count_.load(std::memory_order_acquire);
+
+    std::vector<ReactorStats> stats;
+    stats.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto& reactor = reactors_[i];
+        ReactorStats entry;
+        entry.name = reactor->name;
+        entry.iteration_us = reactor->iteration_us.snapshot();
+        entry.handler_us = reactor->handler_us.snapshot();
+        entry.batch_size = reactor->batch_size.snapshot();
+        entry.queue_depth = reactor->queue_depth.load(std::memory_order_relaxed);
+        entry.stalls = reactor->stalls.load(std::memory_order_relaxed);
+        stats.push_back(std::move(entry));
+    }
+    return stats;
+}
+
+uint64_t FTPLoopMonitor::getStallCount() const {
+    size_t count = reactor_count_.load(std::memory_order_acquire);
+
+    uint64_t stalls = 0;
+    for (size_t i = 0; i < count; ++i) {
+        stalls += reactors_[i]->stalls.load(std::memory_order_relaxed);
+    }
+    return stalls;
+}
+
+void FTPLoopMonitor::watchdogLoop() {
+    // Check often enough to catch a handler within a quarter budget of it
+    // going over
+    auto period = std::max<std::chrono::milliseconds>(budget_ / 4, std::chrono::milliseconds(5));
+
+    std::unique_lock<std::mutex> lock(watchdog_mutex_);
+    while (running_) {
+        watchdog_condition_.wait_for(lock, period);
+        if (!running_) {
+            break;
+        }
+
+        lock.unlock();
+        checkHandlers(std::chrono::steady_clock::now());
+        lock.lock();
+    }
+}
+
+void FTPLoopMonitor::checkHandlers(std::chrono::steady_clock::time_point now) {
+    size_t count = reactor_count_.load(std::memory_order_acquire);
+
+    int64_t now_ns = toNanoseconds(now);
+    int64_t budget_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(budget_).count();
+    for (size_t i = 0; i < count; ++i) {
+        auto& reactor = reactors_[i];
+        int64_t started = reactor->handler_started_ns.load(std::memory_order_acquire);
+        uint64_t sequence = reactor->handler_sequence.load(std::memory_order_relaxed);
+        if (started == 0 || now_ns - started <= budget_ns || reactor->warned_sequence == sequence) {
+            continue;
+        }
+
+        // One warning per handler run, however long it stays stuck
+        reactor->warned_sequence = sequence;
+        reactor->stalls.fetch_add(1, std::memory_order_relaxed);
+
+        std::string stack;
+        size_t depth = std::min(reactor->depth.load(std::memory_order_acquire), kMaxTags);
+        for (size_t i = 0; i < depth; ++i) {
+            const char* tag = reactor->tags[i].load(std::memory_order_relaxed);
+            std::string detail = unpackDetail(reactor->details[i].load(std::memory_order_relaxed));
+            stack += (i > 0 ? " > " : "") + std::string(tag ? tag : "?") + (detail.empty() ? "" : " " + detail);
+        }
+
+        logger_->warn("Handler blocking reactor " + reactor->name + " for " +
+                      std::to_string((now_ns - started) / 1000000) + " ms (budget " +
+                      std::to_string(budget_.count()) + " ms): " + (stack.empty() ? "unknown" : stack));
+    }
+}
+
+} // namespace ssftpd
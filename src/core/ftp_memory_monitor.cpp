@@ -0,0 +1,238 @@
+#include "ssftpd/ftp_memory_monitor.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+namespace ssftpd {
+
+namespace {
+
+// Percent of max_memory_usage
+constexpr size_t kReclaimPercent = 80;
+constexpr size_t kCriticalPercent = 95;
+
+const auto kSamplePeriod = std::chrono::seconds(1);
+
+std::string formatMegabytes(size_t bytes) {
+    return std::to_string(bytes / (1024 * 1024)) + " MB";
+}
+
+const char* pressureName(FTPMemoryMonitor::Pressure pressure) {
+    switch (pressure) {
+        case FTPMemoryMonitor::Pressure::RECLAIM: return "reclaiming";
+        case FTPMemoryMonitor::Pressure::CRITICAL: return "refusing new sessions";
+        default: return "normal";
+    }
+}
+
+} // namespace
+
+FTPMemoryMonitor::FTPMemoryMonitor(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , limit_(config ? config->max_memory_usage : 0)
+    , process_()
+    , pressure_(Pressure::NORMAL)
+    , reclaims_(0)
+    , refused_(0)
+    , running_(false)
+{
+}
+
+FTPMemoryMonitor::~FTPMemoryMonitor() {
+    stop();
+}
+
+FTPMemoryMonitor::ProcessMemory FTPMemoryMonitor::readProcessMemory() {
+    ProcessMemory memory{};
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+    // statm is cheap and always there: size, resident and shared, in pages
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return memory;
+    }
+    unsigned long total_pages = 0;
+    unsigned long resident_pages = 0;
+    unsigned long shared_pages = 0;
+    if (fscanf(statm, "%lu %lu %lu", &total_pages, &resident_pages, &shared_pages) == 3) {
+        memory.virtual_size = total_pages * page_size;
+        memory.resident = resident_pages * page_size;
+        memory.shared = shared_pages * page_size;
+    }
+    fclose(statm);
+
+    // smaps_rollup (Linux 4.14+) sums every mapping, in kB
+    FILE* rollup = fopen("/proc/self/smaps_rollup", "r");
+    if (!rollup) {
+        return memory;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), rollup)) {
+        char field[64];
+        unsigned long kilobytes = 0;
+        if (sscanf(line, "%63[^:]: %lu kB", field, &kilobytes) != 2) {
+            continue;
+        }
+        size_t bytes = static_cast<size_t>(kilobytes) * 1024;
+        if (strcmp(field, "Pss") == 0) {
+            memory.proportional = bytes;
+        } else if (strcmp(field, "Private_Dirty") == 0) {
+            memory.private_dirty = bytes;
+        } else if (strcmp(field, "Anonymous") == 0) {
+            memory.anonymous = bytes;
+        } else if (strcmp(field, "Swap") == 0) {
+            memory.swap = bytes;
+        }
+    }
+    fclose(rollup);
+
+    return memory;
+}
+
+void FTPMemoryMonitor::addSubsystem(const std::string& name, UsageFunction usage, ReclaimFunction reclaim) {
+    std::lock_guard<std::mutex> lock(sampler_mutex_);
+    if (running_ || !usage) {
+        return;
+    }
+    subsystems_.push_back(Subsystem{name, std::move(usage), std::move(reclaim)});
+}
+
+bool FTPMemoryMonitor::start() {
+    std::lock_guard<std::mutex> lock(sampler_mutex_);
+    if (running_) {
+        return true;
+    }
+
+    running_ = true;
+    sampler_thread_ = std::thread(&FTPMemoryMonitor::samplerLoop, this);
+    return true;
+}
+
+void FTPMemoryMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(sampler_mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    sampler_condition_.notify_all();
+
+    if (sampler_thread_.joinable()) {
+        sampler_thread_.join();
+    }
+}
+
+void FTPMemoryMonitor::samplerLoop() {
+    std::unique_lock<std::mutex> lock(sampler_mutex_);
+    while (running_) {
+        lock.unlock();
+        update();
+        lock.lock();
+
+        sampler_condition_.wait_for(lock, kSamplePeriod, [this] { return !running_; });
+    }
+}
+
+void FTPMemoryMonitor::update() {
+    ProcessMemory sample = readProcessMemory();
+    {
+        std::lock_guard<std::mutex> lock(sample_mutex_);
+        process_ = sample;
+    }
+
+    if (limit_ == 0 || sample.resident == 0) {
+        return;
+    }
+
+    // Swapped pages still count against us when the OOM killer chooses
+    size_t charged = sample.resident + sample.swap;
+    size_t percent = charged * 100 / limit_;
+
+    // Refusal lasts until usage is back under the reclaim level, so it does
+    // not flap around the critical one
+    Pressure previous = pressure_.load(std::memory_order_relaxed);
+    Pressure pressure = Pressure::NORMAL;
+    if (percent >= kCriticalPercent) {
+        pressure = Pressure::CRITICAL;
+    } else if (percent >= kReclaimPercent) {
+        pressure = previous == Pressure::CRITICAL ? Pressure::CRITICAL : Pressure::RECLAIM;
+    }
+    pressure_.store(pressure, std::memory_order_relaxed);
+
+    if (pressure != previous) {
+        std::string message = "Memory usage " + formatMegabytes(charged) + " of " + formatMegabytes(limit_) +
+                              " (" + std::to_string(percent) + "%), " + pressureName(pressure) + "; " +
+                              describeSubsystems();
+        if (pressure == Pressure::NORMAL) {
+            logger_->info(message);
+        } else {
+            logger_->warn(message);
+        }
+    }
+
+    if (pressure != Pressure::NORMAL) {
+        reclaim(charged);
+    }
+}
+
+void FTPMemoryMonitor::reclaim(size_t charged) {
+    reclaims_++;
+
+    for (const auto& subsystem : subsystems_) {
+        if (subsystem.reclaim) {
+            subsystem.reclaim();
+        }
+    }
+
+#ifdef __GLIBC__
+    // Freed blocks stay in the heap until trimmed; hand them back so the
+    // resident size actually drops
+    malloc_trim(0);
+#endif
+
+    logger_->debug("Memory reclaim pass at " + formatMegabytes(charged));
+}
+
+bool FTPMemoryMonitor::admit() {
+    if (pressure_.load(std::memory_order_relaxed) == Pressure::CRITICAL) {
+        refused_++;
+        return false;
+    }
+    return true;
+}
+
+std::string FTPMemoryMonitor::describeSubsystems() const {
+    std::string description;
+    for (const auto& subsystem : subsystems_) {
+        description += (description.empty() ? "" : ", ") + subsystem.name + " " +
+                       std::to_string(subsystem.usage() / 1024) + " KB";
+    }
+    return description.empty() ? "no subsystems registered" : description;
+}
+
+FTPMemoryMonitor::Stats FTPMemoryMonitor::getStats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(sample_mutex_);
+        stats.process = process_;
+    }
+    stats.limit = limit_;
+    stats.pressure = pressure_.load(std::memory_order_relaxed);
+    stats.reclaims = reclaims_.load();
+    stats.refused = refused_.load();
+
+    stats.subsystems.reserve(subsystems_.size());
+    for (const auto& subsystem : subsystems_) {
+        stats.subsystems.emplace_back(subsystem.name, subsystem.usage());
+    }
+    return stats;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,400 @@
+#include "ssftpd/ftp_metrics_server.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace ssftpd {
+
+namespace {
+
+const char kContentType[] = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+bool setNonBlocking(int socket_fd) {
+    int flags = fcntl(socket_fd, F_GETFL, 0);
+    return flags != -1 && fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+} // namespace
+
+FTPMetricsWriter::FTPMetricsWriter(char* buffer, size_t capacity)
+    : buffer_(buffer)
+    , capacity_(capacity)
+    , length_(0)
+    , truncated_(false)
+{
+}
+
+void FTPMetricsWriter::append(const char* format, ...) {
+    if (truncated_) {
+        return;
+    }
+
+    size_t remaining = capacity_ - length_;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(buffer_ + length_, remaining, format, args);
+    va_end(args);
+
+    if (written < 0 || static_cast<size_t>(written) >= remaining) {
+        truncated_ = true;
+        return;
+    }
+    length_ += static_cast<size_t>(written);
+}
+
+void FTPMetricsWriter::appendLabels(const char* label, const std::string& label_value, const char* quantile) {
+    if (!label && !quantile) {
+        return;
+    }
+
+    append("{");
+    if (label) {
+        append("%s=\"", label);
+        // Backslash, quote and newline must be escaped in label values
+        for (char c : label_value) {
+            if (c == '\\' || c == '"') {
+                append("\\%c", c);
+            } else if (c == '\n') {
+                append("\\n");
+            } else {
+                append("%c", c);
+            }
+        }
+        append("\"%s", quantile ? "," : "");
+    }
+    if (quantile) {
+        append("quantile=\"%s\"", quantile);
+    }
+    append("}");
+}
+
+void FTPMetricsWriter::family(const char* name, const char* type, const char* help) {
+    append("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+void FTPMetricsWriter::sample(const char* name, uint64_t value, const char* label,
+                              const std::string& label_value) {
+    append("%s", name);
+    appendLabels(label, label_value, nullptr);
+    append(" %llu\n", static_cast<unsigned long long>(value));
+}
+
+void FTPMetricsWriter::sample(const char* name, double value, const char* label,
+                              const std::string& label_value) {
+    append("%s", name);
+    appendLabels(label, label_value, nullptr);
+    append(" %.15g\n", value);
+}
+
+void FTPMetricsWriter::counter(const char* name, const char* help, uint64_t value) {
+    family(name, "counter", help);
+    append("%s_total %llu\n", name, static_cast<unsigned long long>(value));
+}
+
+void FTPMetricsWriter::gauge(const char* name, const char* help, double value) {
+    family(name, "gauge", help);
+    sample(name, value);
+}
+
+void FTPMetricsWriter::summary(const char* name, const FTPLatencyHistogram::Snapshot& snapshot,
+                               const char* label, const std::string& label_value) {
+    for (double quantile : kQuantiles) {
+        char quantile_text[16];
+        snprintf(quantile_text, sizeof(quantile_text), "%g", quantile);
+        append("%s", name);
+        appendLabels(label, label_value, quantile_text);
+        append(" %llu\n", static_cast<unsigned long long>(snapshot.percentile(quantile * 100.0)));
+    }
+
+    append("%s_sum", name);
+    appendLabels(label, label_value, nullptr);
+    append(" %llu\n", static_cast<unsigned long long>(snapshot.sum));
+    append("%s_count", name);
+    appendLabels(label, label_value, nullptr);
+    append(" %llu\n", static_cast<unsigned long long>(snapshot.count));
+}
+
+void FTPMetricsWriter::finish() {
+    append("# EOF\n");
+}
+
+FTPMetricsServer::FTPMetricsServer(std::shared_ptr<FTPServerConfig> config,
+                                   std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , listen_socket_(-1)
+    , client_socket_(-1)
+    , state_(ClientState::IDLE)
+    , request_length_(0)
+    , response_offset_(0)
+    , response_end_(0)
+    , scrapes_(0)
+    , last_render_time_(0)
+{
+}
+
+FTPMetricsServer::~FTPMetricsServer() {
+    stop();
+}
+
+void FTPMetricsServer::addCollector(Collector collector) {
+    collectors_.push_back(std::move(collector));
+}
+
+bool FTPMetricsServer::start() {
+    if (listen_socket_ != -1) {
+        return true;
+    }
+
+    // The only buffer a scrape writes into
+    response_.assign(kRenderBufferSize, '\0');
+
+    if (!openListenSocket()) {
+        return false;
+    }
+
+    logger_->info("Metrics endpoint listening on port " + std::to_string(config_->metrics_port) +
+                  " at " + config_->metrics_endpoint);
+    return true;
+}
+
+void FTPMetricsServer::stop() {
+    closeClient();
+    if (listen_socket_ != -1) {
+        close(listen_socket_);
+        listen_socket_ = -1;
+    }
+}
+
+bool FTPMetricsServer::openListenSocket() {
+    struct sockaddr_storage address;
+    socklen_t address_len = 0;
+    memset(&address, 0, sizeof(address));
+
+    const std::string& bind_address = config_->metrics_bind_address;
+    auto* address4 = reinterpret_cast<struct sockaddr_in*>(&address);
+    auto* address6 = reinterpret_cast<struct sockaddr_in6*>(&address);
+    bool dual_stack = false;
+
+    if (bind_address.empty() || bind_address == "0.0.0.0" || bind_address == "::") {
+        address6->sin6_family = AF_INET6;
+        address6->sin6_addr = in6addr_any;
+        address_len = sizeof(struct sockaddr_in6);
+        dual_stack = true;
+    } else if (inet_pton(AF_INET, bind_address.c_str(), &address4->sin_addr) == 1) {
+        address4->sin_family = AF_INET;
+        address_len = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, bind_address.c_str(), &address6->sin6_addr) == 1) {
+        address6->sin6_family = AF_INET6;
+        address_len = sizeof(struct sockaddr_in6);
+    } else {
+        logger_->error("Invalid metrics bind address: " + bind_address);
+        return false;
+    }
+
+    listen_socket_ = socket(address.ss_family, SOCK_STREAM, 0);
+    if (listen_socket_ == -1 && dual_stack && (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)) {
+        memset(&address, 0, sizeof(address));
+        address4->sin_family = AF_INET;
+        address4->sin_addr.s_addr = INADDR_ANY;
+        address_len = sizeof(struct sockaddr_in);
+        dual_stack = false;
+        listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (listen_socket_ == -1) {
+        logger_->error("Failed to create metrics socket: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // Same offset in sockaddr_in and sockaddr_in6
+    uint16_t port = htons(static_cast<uint16_t>(config_->metrics_port));
+    if (address.ss_family == AF_INET) {
+        address4->sin_port = port;
+    } else {
+        address6->sin6_port = port;
+    }
+
+    int opt = 1;
+    setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (dual_stack) {
+        int v6only = 0;
+        setsockopt(listen_socket_, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    }
+
+    if (!setNonBlocking(listen_socket_) ||
+        bind(listen_socket_, reinterpret_cast<struct sockaddr*>(&address), address_len) < 0 ||
+        listen(listen_socket_, 16) < 0) {
+        logger_->error("Failed to listen on metrics port " + std::to_string(config_->metrics_port) +
+                       ": " + std::string(strerror(errno)));
+        close(listen_socket_);
+        listen_socket_ = -1;
+        return false;
+    }
+
+    return true;
+}
+
+void FTPMetricsServer::poll() {
+    if (listen_socket_ == -1) {
+        return;
+    }
+
+    if (state_ == ClientState::IDLE) {
+        acceptClient();
+    }
+    if (state_ == ClientState::READING) {
+        readRequest();
+    }
+    if (state_ == ClientState::WRITING) {
+        writeResponse();
+    }
+
+    // A stalled scraper must not hold the endpoint
+    if (state_ != ClientState::IDLE && std::chrono::steady_clock::now() > deadline_) {
+        closeClient();
+    }
+}
+
+void FTPMetricsServer::acceptClient() {
+    int client = accept(listen_socket_, nullptr, nullptr);
+    if (client == -1) {
+        return;
+    }
+
+    if (!setNonBlocking(client)) {
+        close(client);
+        return;
+    }
+
+    client_socket_ = client;
+    state_ = ClientState::READING;
+    deadline_ = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    request_length_ = 0;
+}
+
+void FTPMetricsServer::readRequest() {
+    ssize_t received = recv(client_socket_, request_.data() + request_length_,
+                            request_.size() - 1 - request_length_, 0);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        closeClient();
+        return;
+    }
+    if (received < 0) {
+        return;
+    }
+
+    request_length_ += static_cast<size_t>(received);
+    request_[request_length_] = '\0';
+
+    if (!strstr(request_.data(), "\r\n\r\n")) {
+        if (request_length_ == request_.size() - 1) {
+            static const char kBody[] = "Request too large\n";
+            memcpy(response_.data() + kHeaderReserve, kBody, sizeof(kBody) - 1);
+            respond(431, "Request Header Fields Too Large", "text/plain", sizeof(kBody) - 1);
+        }
+        return;
+    }
+
+    // Request line: METHOD SP PATH[?QUERY] SP VERSION
+    const char* method_end = strchr(request_.data(), ' ');
+    const char* path = method_end ? method_end + 1 : nullptr;
+    size_t path_length = path ? strcspn(path, " ?\r\n") : 0;
+    const std::string& endpoint = config_->metrics_endpoint;
+
+    if (!method_end || static_cast<size_t>(method_end - request_.data()) != 3 ||
+        strncmp(request_.data(), "GET", 3) != 0) {
+        static const char kBody[] = "Method not allowed\n";
+        memcpy(response_.data() + kHeaderReserve, kBody, sizeof(kBody) - 1);
+        respond(405, "Method Not Allowed", "text/plain", sizeof(kBody) - 1);
+    } else if (path_length != endpoint.size() || strncmp(path, endpoint.data(), path_length) != 0) {
+        static const char kBody[] = "Not found\n";
+        memcpy(response_.data() + kHeaderReserve, kBody, sizeof(kBody) - 1);
+        respond(404, "Not Found", "text/plain", sizeof(kBody) - 1);
+    } else {
+        size_t body_length = render();
+        if (body_length == 0) {
+            static const char kBody[] = "Metrics did not fit the render buffer\n";
+            memcpy(response_.data() + kHeaderReserve, kBody, sizeof(kBody) - 1);
+            respond(500, "Internal Server Error", "text/plain", sizeof(kBody) - 1);
+        } else {
+            scrapes_++;
+            respond(200, "OK", kContentType, body_length);
+        }
+    }
+}
+
+size_t FTPMetricsServer::render() {
+    auto started = std::chrono::steady_clock::now();
+    FTPMetricsWriter writer(response_.data() + kHeaderReserve, response_.size() - kHeaderReserve);
+
+    writer.counter("ssftpd_metrics_scrapes", "Metrics scrapes served", scrapes_.load());
+    writer.gauge("ssftpd_metrics_render_seconds", "Time taken to render the previous scrape",
+                 last_render_time_.count() / 1e6);
+
+    for (const auto& collector : collectors_) {
+        collector(writer);
+    }
+    writer.finish();
+
+    last_render_time_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started);
+
+    if (writer.isTruncated()) {
+        logger_->error("Metrics exceed the " + std::to_string(kRenderBufferSize) + " byte render buffer");
+        return 0;
+    }
+    return writer.size();
+}
+
+void FTPMetricsServer::respond(int status, const char* reason, const char* content_type, size_t body_length) {
+    char header[kHeaderReserve];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.1 %d %s\r\n"
+                                 "Content-Type: %s\r\n"
+                                 "Content-Length: %zu\r\n"
+                                 "Connection: close\r\n\r\n",
+                                 status, reason, content_type, body_length);
+
+    // The body was rendered kHeaderReserve bytes in; the header goes right
+    // before it so the response is one contiguous send
+    response_offset_ = kHeaderReserve - static_cast<size_t>(header_length);
+    memcpy(response_.data() + response_offset_, header, static_cast<size_t>(header_length));
+    response_end_ = kHeaderReserve + body_length;
+    state_ = ClientState::WRITING;
+}
+
+void FTPMetricsServer::writeResponse() {
+    while (response_offset_ < response_end_) {
+        ssize_t sent = send(client_socket_, response_.data() + response_offset_,
+                            response_end_ - response_offset_, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closeClient();
+            }
+            return;
+        }
+        response_offset_ += static_cast<size_t>(sent);
+    }
+
+    closeClient();
+}
+
+void FTPMetricsServer::closeClient() {
+    if (client_socket_ != -1) {
+        close(client_socket_);
+        client_socket_ = -1;
+    }
+    state_ = ClientState::IDLE;
+}
+
+} // namespace ssftpd
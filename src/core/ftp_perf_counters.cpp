@@ -0,0 +1,276 @@
+#include "ssftpd/ftp_perf_counters.hpp"
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ssftpd {
+
+namespace {
+
+struct ThreadTotals {
+    std::mutex mutex;
+    std::unordered_map<std::string, FTPPerfCounters::Totals> operations;
+};
+
+// Totals outlive their threads so exited workers still show up
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTotals>> threads;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+#ifdef __linux__
+
+struct EventSpec {
+    uint32_t type;
+    uint64_t config;
+};
+
+// Hardware counters, in Counter order; context switches come from getrusage
+const EventSpec kEvents[FTPPerfCounters::CONTEXT_SWITCHES] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+};
+
+int openEvent(const EventSpec& spec, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = spec.type;
+    attr.config = spec.config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // User space only, which perf_event_paranoid 2 (the usual default) allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // This thread, any CPU
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+// One counter group per thread; the leader is read for the whole group
+struct ThreadGroup {
+    ThreadGroup() {
+        reset();
+    }
+
+    ~ThreadGroup() {
+        reset();
+    }
+
+    void reset() {
+        for (int fd : fds) {
+            close(fd);
+        }
+        fds.clear();
+        leader = -1;
+        members = 0;
+        for (auto& slot : positions) {
+            slot = -1;
+        }
+    }
+
+    bool open() {
+        for (size_t counter = 0; counter < FTPPerfCounters::CONTEXT_SWITCHES; ++counter) {
+            int fd = openEvent(kEvents[counter], leader);
+            if (fd < 0) {
+                if (leader < 0) {
+                    return false;
+                }
+                // A missing sibling (e.g. no cache events) stays at 0
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds.push_back(fd);
+            positions[counter] = static_cast<int>(members++);
+        }
+        return leader >= 0;
+    }
+
+    int leader;
+    size_t members;
+    int positions[FTPPerfCounters::CONTEXT_SWITCHES];
+    std::vector<int> fds;
+};
+
+FTPPerfCounters::Mode probe() {
+    // getrusage needs no permission, so counting never turns fully off
+    ThreadGroup group;
+    return group.open() ? FTPPerfCounters::Mode::HARDWARE : FTPPerfCounters::Mode::SOFTWARE;
+}
+
+uint64_t readContextSwitches() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(usage.ru_nvcsw) + static_cast<uint64_t>(usage.ru_nivcsw);
+}
+
+#endif
+
+struct ThreadState {
+    ThreadState()
+        : totals(std::make_shared<ThreadTotals>())
+    {
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.threads.push_back(totals);
+    }
+
+#ifdef __linux__
+    ThreadGroup group;
+    FTPPerfCounters::Mode opened_mode = FTPPerfCounters::Mode::OFF;
+    bool opened = false;
+#endif
+    std::shared_ptr<ThreadTotals> totals;
+};
+
+ThreadState& threadState() {
+    thread_local ThreadState state;
+    return state;
+}
+
+} // namespace
+
+std::atomic<FTPPerfCounters::Mode> FTPPerfCounters::mode_{FTPPerfCounters::Mode::OFF};
+
+FTPPerfCounters::Mode FTPPerfCounters::setEnabled(bool enabled) {
+    Mode mode = Mode::OFF;
+#ifdef __linux__
+    if (enabled) {
+        mode = probe();
+    }
+#else
+    (void)enabled;
+#endif
+    mode_.store(mode, std::memory_order_relaxed);
+    return mode;
+}
+
+bool FTPPerfCounters::read(uint64_t values[COUNTER_COUNT]) {
+#ifdef __linux__
+    ThreadState& state = threadState();
+    Mode mode = mode_.load(std::memory_order_relaxed);
+    if (mode == Mode::OFF) {
+        return false;
+    }
+    if (!state.opened || state.opened_mode != mode) {
+        // First scope on this thread, or the mode changed since; a thread
+        // that cannot open its group still counts context switches
+        state.group.reset();
+        state.opened = true;
+        state.opened_mode = mode;
+        if (mode == Mode::HARDWARE) {
+            state.group.open();
+        }
+    }
+
+    for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        values[counter] = 0;
+    }
+    values[CONTEXT_SWITCHES] = readContextSwitches();
+
+    if (state.group.leader < 0) {
+        return true;
+    }
+
+    // nr, time enabled, time running, then one value per member
+    uint64_t buffer[3 + CONTEXT_SWITCHES];
+    ssize_t length = ::read(state.group.leader, buffer, sizeof(buffer));
+    if (length < static_cast<ssize_t>((3 + state.group.members) * sizeof(uint64_t))) {
+        return true;
+    }
+
+    // Scale up when the group only ran part of the time (multiplexing)
+    uint64_t enabled = buffer[1];
+    uint64_t running = buffer[2];
+    for (size_t counter = 0; counter < CONTEXT_SWITCHES; ++counter) {
+        int position = state.group.positions[counter];
+        uint64_t value = position >= 0 ? buffer[3 + position] : 0;
+        if (running > 0 && running < enabled) {
+            value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+        }
+        values[counter] = value;
+    }
+    return true;
+#else
+    (void)values;
+    return false;
+#endif
+}
+
+void FTPPerfCounters::add(const std::string& operation, const uint64_t start[COUNTER_COUNT],
+                          const uint64_t end[COUNTER_COUNT]) {
+    ThreadTotals& totals = *threadState().totals;
+    std::lock_guard<std::mutex> lock(totals.mutex);
+
+    auto it = totals.operations.find(operation);
+    if (it == totals.operations.end()) {
+        it = totals.operations.emplace(operation, Totals{}).first;
+    }
+    it->second.scopes++;
+    for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+        // Scaled values can step back slightly; never count that as a wrap
+        it->second.values[counter] += end[counter] > start[counter] ? end[counter] - start[counter] : 0;
+    }
+}
+
+std::map<std::string, FTPPerfCounters::Totals> FTPPerfCounters::getTotals() {
+    std::vector<std::shared_ptr<ThreadTotals>> threads;
+    {
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        threads = shared.threads;
+    }
+
+    std::map<std::string, Totals> merged;
+    for (const auto& thread : threads) {
+        std::lock_guard<std::mutex> lock(thread->mutex);
+        for (const auto& entry : thread->operations) {
+            Totals& target = merged[entry.first];
+            target.scopes += entry.second.scopes;
+            for (size_t counter = 0; counter < COUNTER_COUNT; ++counter) {
+                target.values[counter] += entry.second.values[counter];
+            }
+        }
+    }
+    return merged;
+}
+
+void FTPPerfCounters::clear() {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    for (const auto& thread : shared.threads) {
+        std::lock_guard<std::mutex> thread_lock(thread->mutex);
+        thread->operations.clear();
+    }
+}
+
+const char* FTPPerfCounters::counterName(Counter counter) {
+    switch (counter) {
+        case CYCLES: return "cycles";
+        case INSTRUCTIONS: return "instructions";
+        case CACHE_REFERENCES: return "cache_references";
+        case CACHE_MISSES: return "cache_misses";
+        case CONTEXT_SWITCHES: return "context_switches";
+        default: return "unknown";
+    }
+}
+
+} // namespace ssftpd
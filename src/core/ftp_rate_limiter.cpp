@@ -2,6 +2,7 @@
 #include "ssftpd/logger.hpp"
 #include <chrono>
 #include <algorithm>
+#include <cstdint>
 
 namespace ssftpd {
 
@@ -15,10 +16,17 @@ FTPRateLimiter::FTPRateLimiter(std::shared_ptr<FTPServerConfig> config,
     , max_requests_per_minute_(1000)
     , connection_window_(std::chrono::minutes(1))
     , request_window_(std::chrono::minutes(1))
+    , max_failed_logins_(config ? static_cast<size_t>(std::max(config->security.max_login_attempts, 1)) : 3)
+    , block_duration_(config ? config->rate_limit.block_duration : std::chrono::seconds(300))
+    , ban_table_(logger)
+    , shared_table_(logger)
+    , expiry_running_(false)
 {
 }
 
-FTPRateLimiter::~FTPRateLimiter() = default;
+FTPRateLimiter::~FTPRateLimiter() {
+    stop();
+}
 
 bool FTPRateLimiter::initialize() {
     if (initialized_) {
@@ -35,8 +43,25 @@ bool FTPRateLimiter::initialize() {
             // Convert time windows from seconds to chrono duration
             connection_window_ = std::chrono::seconds(config_->rate_limit.window_size);
             request_window_ = std::chrono::seconds(config_->rate_limit.window_size);
+
+            // Offenders are banned instead of being re-checked and logged
+            // on every attempt
+            block_duration_ = config_->rate_limit.block_duration;
+            ban_table_.setNftablesSet(config_->rate_limit.nftables_set);
+
+            // Processes sharing the port share one budget through shared memory
+            const std::string& shared_name = config_->rate_limit.shared_memory_name;
+            if (!shared_name.empty() &&
+                !shared_table_.open(shared_name, config_->rate_limit.shared_memory_slots)) {
+                logger_->error("Failed to initialize rate limiter: shared table unavailable");
+                return false;
+            }
         }
 
+        // Idle counters are expired in the background, off the check path
+        expiry_running_ = true;
+        expiry_thread_ = std::thread(&FTPRateLimiter::expiryLoop, this);
+
         initialized_ = true;
         logger_->info("FTP rate limiter initialized");
         return true;
@@ -47,91 +72,280 @@ bool FTPRateLimiter::initialize() {
     }
 }
 
+void FTPRateLimiter::stop() {
+    {
+        std::lock_guard<std::mutex> lock(expiry_mutex_);
+        if (!expiry_running_) {
+            return;
+        }
+        expiry_running_ = false;
+    }
+    expiry_condition_.notify_all();
+
+    if (expiry_thread_.joinable()) {
+        expiry_thread_.join();
+    }
+}
+
 bool FTPRateLimiter::allowConnection(const std::string& ip_address) {
+    FTPIPKey key;
+    if (!FTPIPKey::parse(ip_address, key)) {
+        logger_->warn("Rate limiter cannot parse client address: " + ip_address);
+        return false;
+    }
+
+    return allowConnection(key);
+}
+
+bool FTPRateLimiter::allowConnection(const FTPIPKey& key) {
     if (!initialized_) {
         return true;
     }
 
     auto now = std::chrono::steady_clock::now();
 
-    // Clean up old connection records
-    cleanupOldRecords(ip_connections_, connection_window_);
-
-    // Check connection limit per IP
-    auto& ip_conns = ip_connections_[ip_address];
-    if (ip_conns.size() >= max_connections_per_ip_) {
-        logger_->warn("Rate limit exceeded for IP " + ip_address +
-                     ": max connections per IP reached");
+    // Banned clients are refused without touching the counters or the log
+    if (ban_table_.isBanned(key, now)) {
         return false;
     }
 
-    // Check global connection limit
-    size_t total_connections = 0;
-    for (const auto& pair : ip_connections_) {
-        total_connections += pair.second.size();
+    FTPSharedRateTable::Slot* slot = sharedSlot(key, now);
+    if (slot) {
+        if (slot->isBanned(now)) {
+            return false;
+        }
+        if (slot->connections.count(now, connection_window_) >= max_connections_per_ip_) {
+            banAddress(key, "max connections per IP reached", now);
+            return false;
+        }
+
+        // Global limit first, as below, so a flood refused there does not
+        // spend the per-IP budget of the clients caught in it
+        if (!shared_table_.globalConnections().tryAdd(now, connection_window_, max_connections_per_minute_)) {
+            logger_->warn("Global connection rate limit exceeded");
+            return false;
+        }
+
+        // Another process may have taken the last per-IP slot since the check
+        if (!slot->connections.tryAdd(now, connection_window_, max_connections_per_ip_)) {
+            banAddress(key, "max connections per IP reached", now);
+            return false;
+        }
+        return true;
     }
 
-    if (total_connections >= max_connections_per_minute_) {
+    Shard& shard = shardFor(key);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    // Check connection limit per IP
+    auto& ip_conns = shard.connections[key];
+    if (ip_conns.count(now, connection_window_) >= max_connections_per_ip_) {
+        lock.unlock();
+        banAddress(key, "max connections per IP reached", now);
+        return false;
+    }
+
+    // Check global connection limit; lock-free and shared by all shards
+    if (!global_connections_.tryAdd(now, connection_window_, max_connections_per_minute_)) {
         logger_->warn("Global connection rate limit exceeded");
         return false;
     }
 
     // Record new connection
-    ip_conns.push_back(now);
+    ip_conns.add(now, connection_window_);
 
     return true;
 }
 
 bool FTPRateLimiter::allowRequest(const std::string& ip_address) {
+    FTPIPKey key;
+    if (!FTPIPKey::parse(ip_address, key)) {
+        logger_->warn("Rate limiter cannot parse client address: " + ip_address);
+        return false;
+    }
+
+    return allowRequest(key);
+}
+
+bool FTPRateLimiter::allowRequest(const FTPIPKey& key) {
     if (!initialized_) {
         return true;
     }
 
     auto now = std::chrono::steady_clock::now();
 
-    // Clean up old request records
-    cleanupOldRecords(ip_requests_, request_window_);
+    FTPSharedRateTable::Slot* slot = sharedSlot(key, now);
+    if (slot) {
+        if (!slot->requests.tryAdd(now, request_window_, max_requests_per_minute_)) {
+            logger_->warn("Rate limit exceeded for IP " + key.toString() +
+                         ": max requests per minute reached");
+            return false;
+        }
+        return true;
+    }
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
 
     // Check request limit per IP
-    auto& ip_reqs = ip_requests_[ip_address];
-    if (ip_reqs.size() >= max_requests_per_minute_) {
-        logger_->warn("Rate limit exceeded for IP " + ip_address +
+    auto& ip_reqs = shard.requests[key];
+    if (ip_reqs.count(now, request_window_) >= max_requests_per_minute_) {
+        logger_->warn("Rate limit exceeded for IP " + key.toString() +
                      ": max requests per minute reached");
         return false;
     }
 
     // Record new request
-    ip_reqs.push_back(now);
+    ip_reqs.add(now, request_window_);
 
     return true;
 }
 
-void FTPRateLimiter::cleanupOldRecords(std::map<std::string, std::vector<std::chrono::steady_clock::time_point>>& records,
-                                       const std::chrono::steady_clock::duration& window) {
+bool FTPRateLimiter::recordFailedLogin(const std::string& ip_address) {
+    FTPIPKey key;
+    if (!FTPIPKey::parse(ip_address, key)) {
+        return false;
+    }
+
+    return recordFailedLogin(key);
+}
+
+bool FTPRateLimiter::recordFailedLogin(const FTPIPKey& key) {
+    if (!initialized_) {
+        return false;
+    }
+
     auto now = std::chrono::steady_clock::now();
-    auto cutoff = now - window;
-
-    for (auto& pair : records) {
-        auto& timestamps = pair.second;
-
-        // Remove timestamps older than the window
-        timestamps.erase(
-            std::remove_if(timestamps.begin(), timestamps.end(),
-                [cutoff](const auto& timestamp) {
-                    return timestamp < cutoff;
-                }),
-            timestamps.end()
-        );
-    }
-
-    // Remove empty IP entries
-    auto it = records.begin();
-    while (it != records.end()) {
-        if (it->second.empty()) {
-            it = records.erase(it);
-        } else {
-            ++it;
+
+    FTPSharedRateTable::Slot* slot = sharedSlot(key, now);
+    if (slot) {
+        slot->failed_logins.tryAdd(now, connection_window_, UINT64_MAX);
+        if (slot->failed_logins.count(now, connection_window_) < max_failed_logins_) {
+            return false;
+        }
+        slot->failed_logins.reset();
+    } else {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto& failures = shard.failed_logins[key];
+        failures.add(now, connection_window_);
+        if (failures.count(now, connection_window_) < max_failed_logins_) {
+            return false;
         }
+        shard.failed_logins.erase(key);
+    }
+
+    banAddress(key, "too many failed logins", now);
+    return true;
+}
+
+bool FTPRateLimiter::isBanned(const FTPIPKey& key) const {
+    auto now = std::chrono::steady_clock::now();
+    if (ban_table_.isBanned(key, now)) {
+        return true;
+    }
+
+    // Bans issued by the other processes
+    const FTPSharedRateTable::Slot* slot = shared_table_.find(key);
+    return slot && slot->isBanned(now);
+}
+
+bool FTPRateLimiter::unban(const std::string& ip_address) {
+    FTPIPKey key;
+    if (!FTPIPKey::parse(ip_address, key)) {
+        return false;
+    }
+
+    bool lifted = ban_table_.unban(key);
+    FTPSharedRateTable::Slot* slot = shared_table_.find(key);
+    if (slot && slot->banned_until.exchange(0) != 0) {
+        lifted = true;
+    }
+    if (!lifted) {
+        return false;
+    }
+
+    logger_->info("Ban lifted for IP " + ip_address);
+    return true;
+}
+
+size_t FTPRateLimiter::getBanCount() const {
+    return ban_table_.getBanCount();
+}
+
+std::map<std::string, int64_t> FTPRateLimiter::getBans() const {
+    return ban_table_.getBans(std::chrono::steady_clock::now());
+}
+
+void FTPRateLimiter::banAddress(const FTPIPKey& key, const std::string& reason,
+                                std::chrono::steady_clock::time_point now) {
+    // Publish the ban to the other processes; a later expiry wins
+    FTPSharedRateTable::Slot* slot = sharedSlot(key, now);
+    if (slot) {
+        int64_t until = (now + block_duration_).time_since_epoch().count();
+        int64_t current = slot->banned_until.load();
+        while (current < until && !slot->banned_until.compare_exchange_weak(current, until)) {
+        }
+    }
+
+    // Only the first offence is logged; later attempts hit the ban silently
+    if (ban_table_.ban(key, block_duration_, now)) {
+        logger_->warn("Banned IP " + key.toString() + " for " +
+                      std::to_string(block_duration_.count()) + " seconds: " + reason);
+    }
+}
+
+FTPSharedRateTable::Slot* FTPRateLimiter::sharedSlot(const FTPIPKey& key,
+                                                     std::chrono::steady_clock::time_point now) {
+    if (!shared_table_.isOpen()) {
+        return nullptr;
+    }
+
+    // Counters are empty once two windows have passed without events; a
+    // full probe window leaves the address on the process-local counters
+    return shared_table_.acquire(key, now, 2 * std::max(connection_window_, request_window_));
+}
+
+void FTPRateLimiter::expiryLoop() {
+    std::unique_lock<std::mutex> lock(expiry_mutex_);
+
+    while (expiry_running_) {
+        expiry_condition_.wait_for(lock, std::chrono::seconds(1));
+        if (!expiry_running_) {
+            break;
+        }
+
+        lock.unlock();
+        auto now = std::chrono::steady_clock::now();
+        cleanupOldRecords(now);
+        ban_table_.expire(now);
+        lock.lock();
+    }
+}
+
+void FTPRateLimiter::cleanupOldRecords(std::chrono::steady_clock::time_point now) {
+    // One shard lock at a time, so checks on other shards keep running
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        removeExpired(shard.connections, now, connection_window_);
+        removeExpired(shard.requests, now, request_window_);
+        removeExpired(shard.failed_logins, now, connection_window_);
+    }
+}
+
+void FTPRateLimiter::removeExpired(IPCounterMap& records,
+                                   std::chrono::steady_clock::time_point now,
+                                   std::chrono::steady_clock::duration window) {
+    std::vector<FTPIPKey> expired;
+    records.forEach([&expired, now, window](const FTPIPKey& key, const FTPSlidingWindow& counter) {
+        if (counter.expired(now, window)) {
+            expired.push_back(key);
+        }
+    });
+
+    for (const auto& key : expired) {
+        records.erase(key);
     }
 }
 
@@ -162,9 +376,13 @@ void FTPRateLimiter::setRequestWindow(std::chrono::seconds window) {
 
 std::map<std::string, size_t> FTPRateLimiter::getConnectionStats() const {
     std::map<std::string, size_t> stats;
+    auto now = std::chrono::steady_clock::now();
 
-    for (const auto& pair : ip_connections_) {
-        stats[pair.first] = pair.second.size();
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.connections.forEach([&stats, now, this](const FTPIPKey& key, const FTPSlidingWindow& counter) {
+            stats[key.toString()] = counter.count(now, connection_window_);
+        });
     }
 
     return stats;
@@ -172,17 +390,28 @@ std::map<std::string, size_t> FTPRateLimiter::getConnectionStats() const {
 
 std::map<std::string, size_t> FTPRateLimiter::getRequestStats() const {
     std::map<std::string, size_t> stats;
+    auto now = std::chrono::steady_clock::now();
 
-    for (const auto& pair : ip_requests_) {
-        stats[pair.first] = pair.second.size();
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.requests.forEach([&stats, now, this](const FTPIPKey& key, const FTPSlidingWindow& counter) {
+            stats[key.toString()] = counter.count(now, request_window_);
+        });
     }
 
     return stats;
 }
 
 void FTPRateLimiter::reset() {
-    ip_connections_.clear();
-    ip_requests_.clear();
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.connections.clear();
+        shard.requests.clear();
+        shard.failed_logins.clear();
+    }
+    global_connections_.reset();
+    ban_table_.clear();
+    // The shared table belongs to every process and is left alone
     logger_->info("Rate limiter statistics reset");
 }
 
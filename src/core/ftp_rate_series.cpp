@@ -0,0 +1,88 @@
+#include "ssftpd/ftp_rate_series.hpp"
+#include <algorithm>
+
+namespace ssftpd {
+
+FTPRateSeries::FTPRateSeries() {
+    reset();
+}
+
+void FTPRateSeries::reset(uint64_t total) {
+    seconds_ = Ring<kSeconds>();
+    minutes_ = Ring<kMinutes>();
+    hours_ = Ring<kHours>();
+    last_total_ = total;
+    last_second_ = 0;
+    minute_sum_ = 0;
+    seconds_in_minute_ = 0;
+    hour_sum_ = 0;
+    minutes_in_hour_ = 0;
+}
+
+void FTPRateSeries::advance(uint64_t total, int64_t second) {
+    if (second <= last_second_) {
+        return;
+    }
+
+    // Beyond a day of silence every bucket would be empty anyway
+    int64_t skipped = std::min<int64_t>(second - last_second_ - 1,
+                                        static_cast<int64_t>(kSeconds * kMinutes * kHours));
+    for (int64_t i = 0; i < skipped; ++i) {
+        pushSecond(0);
+    }
+
+    // A reset counter shows up as a smaller total; count from zero
+    pushSecond(total >= last_total_ ? total - last_total_ : total);
+    last_total_ = total;
+    last_second_ = second;
+}
+
+void FTPRateSeries::pushSecond(uint64_t count) {
+    seconds_.push(count);
+
+    minute_sum_ += count;
+    if (++seconds_in_minute_ < kSeconds) {
+        return;
+    }
+    minutes_.push(minute_sum_);
+    hour_sum_ += minute_sum_;
+    minute_sum_ = 0;
+    seconds_in_minute_ = 0;
+
+    if (++minutes_in_hour_ < kMinutes) {
+        return;
+    }
+    hours_.push(hour_sum_);
+    hour_sum_ = 0;
+    minutes_in_hour_ = 0;
+}
+
+double FTPRateSeries::getRate(std::chrono::seconds window) const {
+    auto seconds = static_cast<size_t>(std::max<int64_t>(window.count(), 1));
+
+    if (seconds > kSeconds * kMinutes && hours_.filled > 0) {
+        size_t hours = std::min((seconds + 3599) / 3600, hours_.filled);
+        return static_cast<double>(hours_.sumLast(hours)) / (hours * 3600.0);
+    }
+    if (seconds > kSeconds && minutes_.filled > 0) {
+        size_t minutes = std::min((seconds + 59) / 60, minutes_.filled);
+        return static_cast<double>(minutes_.sumLast(minutes)) / (minutes * 60.0);
+    }
+
+    size_t count = std::min(seconds, seconds_.filled);
+    return count > 0 ? static_cast<double>(seconds_.sumLast(count)) / count : 0.0;
+}
+
+std::vector<uint64_t> FTPRateSeries::getBuckets(Resolution resolution) const {
+    switch (resolution) {
+        case Resolution::SECOND:
+            return seconds_.ordered();
+        case Resolution::MINUTE:
+            return minutes_.ordered();
+        case Resolution::HOUR:
+            return hours_.ordered();
+    }
+    return {};
+}
+
+} // namespace ssftpd
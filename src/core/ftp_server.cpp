@@ -4,8 +4,21 @@
 #include "ssftpd/ftp_user_manager.hpp"
 #include "ssftpd/ftp_virtual_host_manager.hpp"
 #include "ssftpd/ftp_statistics.hpp"
+#include "ssftpd/ftp_statistics_file.hpp"
 #include "ssftpd/ftp_rate_limiter.hpp"
 #include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/ftp_tls_context.hpp"
+#include "ssftpd/ftp_tls_handshake_pool.hpp"
+#include "ssftpd/ftp_task_scheduler.hpp"
+#include "ssftpd/ftp_admission_controller.hpp"
+#include "ssftpd/ftp_bandwidth_shaper.hpp"
+#include "ssftpd/ftp_access_list.hpp"
+#include "ssftpd/ftp_metrics_server.hpp"
+#include "ssftpd/ftp_usage_accounting.hpp"
+#include "ssftpd/ftp_tracer.hpp"
+#include "ssftpd/ftp_loop_monitor.hpp"
+#include "ssftpd/ftp_memory_monitor.hpp"
+#include "ssftpd/ftp_perf_counters.hpp"
 #include <iostream>
 #include <thread>
 #include <chrono>
@@ -31,6 +44,14 @@ FTPServer::FTPServer(std::shared_ptr<FTPServerConfig> config)
     , virtual_host_manager_(std::make_shared<FTPVirtualHostManager>(config, logger_))
     , statistics_(std::make_shared<FTPStatistics>())
     , rate_limiter_(std::make_shared<FTPRateLimiter>(config, logger_))
+    , task_scheduler_(std::make_shared<FTPTaskScheduler>(config, logger_))
+    , admission_controller_(std::make_shared<FTPAdmissionController>(config, logger_))
+    , bandwidth_shaper_(std::make_shared<FTPBandwidthShaper>(config, logger_))
+    , access_control_(std::make_shared<FTPAccessControl>(config, logger_))
+    , usage_accounting_(std::make_shared<FTPUsageAccounting>(config, logger_))
+    , loop_monitor_(std::make_shared<FTPLoopMonitor>(config, logger_))
+    , main_reactor_(0)
+    , memory_monitor_(std::make_shared<FTPMemoryMonitor>(config, logger_))
 {
     if (!config_) {
         throw std::runtime_error("Configuration is required");
@@ -70,6 +91,9 @@ bool FTPServer::initialize() {
             logger_->setLogFile(config_->logging.log_file);
             logger_->setLogLevel(parseLogLevel(config_->logging.log_level));
             logger_->setConsoleOutput(config_->logging.log_to_console);
+            logger_->setLogBufferSize(config_->logging.async_queue_size);
+            logger_->setOverflowPolicy(Logger::parseOverflowPolicy(config_->logging.overflow_policy));
+            logger_->setAsyncLogging(config_->logging.async_logging);
         }
         
         // Initialize managers
@@ -88,6 +112,106 @@ bool FTPServer::initialize() {
             return false;
         }
         
+        if (!access_control_->reload()) {
+            logger_->error("Failed to load network access rules");
+            return false;
+        }
+        
+        // Initialize the TLS context shared by control and data channels
+        if (config_->ssl.enabled) {
+#ifdef ENABLE_SSL
+            tls_context_ = std::make_shared<FTPTLSContext>(config_, logger_);
+            if (!tls_context_->initialize()) {
+                logger_->error("Failed to initialize TLS context");
+                return false;
+            }
+            
+            // Handshakes run on a dedicated crypto pool, never on the reactor
+            tls_handshake_pool_ = std::make_shared<FTPTLSHandshakePool>(config_, logger_);
+#else
+            logger_->error("SSL is enabled but ssftpd was built without SSL support");
+            return false;
+#endif
+        }
+        
+        // Session events run on the work-stealing scheduler
+        connection_manager_->setTaskScheduler(task_scheduler_);
+        
+        // The main loop and every worker report their health and stalls
+        main_reactor_ = loop_monitor_->addReactor("main");
+        task_scheduler_->setLoopMonitor(loop_monitor_);
+        
+        // Memory is charged against max_memory_usage; buffers and caches
+        // give it back under pressure
+        memory_monitor_->addSubsystem("sessions", [this]() {
+            return connection_manager_->getConnectionCount() * sizeof(FTPConnection);
+        });
+        memory_monitor_->addSubsystem("send_buffers",
+            [this]() { return connection_manager_->getBufferBytes(); },
+            [this]() { connection_manager_->releaseIdleBuffers(); });
+#ifdef ENABLE_SSL
+        auto session_cache = tls_context_ ? tls_context_->getSessionCache() : nullptr;
+        if (session_cache) {
+            memory_monitor_->addSubsystem("tls_session_cache",
+                [session_cache]() { return session_cache->getMemoryUsage(); },
+                [session_cache]() { session_cache->trim(50); });
+        }
+#endif
+        
+        // Transfers are shaped per server, vhost, user and session
+        std::weak_ptr<FTPUserManager> users = user_manager_;
+        bandwidth_shaper_->setUserRateResolver([users](const std::string& username) -> uint64_t {
+            auto user_manager = users.lock();
+            return user_manager ? user_manager->getUserMaxTransferRate(username) : 0;
+        });
+        connection_manager_->setBandwidthShaper(bandwidth_shaper_);
+        
+        // Sessions feed the counters and latency histograms directly
+        if (config_->enable_statistics) {
+            connection_manager_->setStatistics(statistics_);
+            
+            // Lifetime totals survive restarts through the snapshot file
+            if (!config_->statistics_file.empty()) {
+                auto snapshot_file = std::make_shared<FTPStatisticsFile>();
+                if (!snapshot_file->open(config_->statistics_file)) {
+                    logger_->error("Failed to open statistics file: " + snapshot_file->getError());
+                    return false;
+                }
+                statistics_->setSnapshotFile(snapshot_file);
+            }
+        }
+        
+        // Per-user and per-vhost usage is billed from the transfer path
+        connection_manager_->setUsageAccounting(usage_accounting_);
+        
+        // Failed logins count towards an automatic ban
+        if (config_->enable_rate_limiting) {
+            std::weak_ptr<FTPRateLimiter> limiter = rate_limiter_;
+            connection_manager_->setLoginFailureHandler([limiter](const FTPIPKey& client_key) {
+                auto rate_limiter = limiter.lock();
+                return rate_limiter && rate_limiter->recordFailedLogin(client_key);
+            });
+        }
+        
+        // Spans are recorded only for the categories asked for
+        if (config_->profile_performance) {
+            FTPTracer::setCategories(FTPTracer::ALL);
+            
+            // Hardware counters per command and transfer, where permitted
+            if (FTPPerfCounters::setEnabled(true) != FTPPerfCounters::Mode::HARDWARE) {
+                logger_->warn("Hardware performance counters unavailable (perf_event_open not permitted "
+                              "or not supported); profiling context switches only");
+            }
+        } else if (config_->trace_commands) {
+            FTPTracer::setCategories(FTPTracer::COMMAND);
+        }
+        
+        // Scrapes are answered from the main loop
+        if (config_->enable_metrics) {
+            metrics_server_ = std::make_shared<FTPMetricsServer>(config_, logger_);
+            registerMetrics();
+        }
+        
         // Create server socket
         if (!createServerSocket()) {
             logger_->error("Failed to create server socket");
@@ -104,8 +228,48 @@ bool FTPServer::initialize() {
 }
 
 bool FTPServer::createServerSocket() {
+    // Resolve the bind address; a wildcard listens on IPv6 and IPv4 at once
+    struct sockaddr_storage server_addr;
+    socklen_t server_addr_len = 0;
+    bool dual_stack = false;
+    memset(&server_addr, 0, sizeof(server_addr));
+    
+    const std::string& bind_address = config_->connection.bind_address;
+    auto* server_addr4 = reinterpret_cast<struct sockaddr_in*>(&server_addr);
+    auto* server_addr6 = reinterpret_cast<struct sockaddr_in6*>(&server_addr);
+    
+    if (bind_address.empty() || bind_address == "0.0.0.0" || bind_address == "::") {
+        server_addr6->sin6_family = AF_INET6;
+        server_addr6->sin6_addr = in6addr_any;
+        server_addr6->sin6_port = htons(config_->connection.bind_port);
+        server_addr_len = sizeof(struct sockaddr_in6);
+        dual_stack = true;
+    } else if (inet_pton(AF_INET, bind_address.c_str(), &server_addr4->sin_addr) == 1) {
+        server_addr4->sin_family = AF_INET;
+        server_addr4->sin_port = htons(config_->connection.bind_port);
+        server_addr_len = sizeof(struct sockaddr_in);
+    } else if (inet_pton(AF_INET6, bind_address.c_str(), &server_addr6->sin6_addr) == 1) {
+        server_addr6->sin6_family = AF_INET6;
+        server_addr6->sin6_port = htons(config_->connection.bind_port);
+        server_addr_len = sizeof(struct sockaddr_in6);
+    } else {
+        logger_->error("Invalid bind address: " + bind_address);
+        return false;
+    }
+    
     // Create socket
-    listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    listen_socket_ = socket(server_addr.ss_family, SOCK_STREAM, 0);
+    if (listen_socket_ == -1 && dual_stack && (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)) {
+        // No IPv6 on this host: fall back to IPv4 only
+        logger_->warn("IPv6 is not available, listening on IPv4 only");
+        memset(&server_addr, 0, sizeof(server_addr));
+        server_addr4->sin_family = AF_INET;
+        server_addr4->sin_addr.s_addr = INADDR_ANY;
+        server_addr4->sin_port = htons(config_->connection.bind_port);
+        server_addr_len = sizeof(struct sockaddr_in);
+        dual_stack = false;
+        listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
+    }
     if (listen_socket_ == -1) {
         logger_->error("Failed to create socket: " + std::string(strerror(errno)));
         return false;
@@ -119,6 +283,15 @@ bool FTPServer::createServerSocket() {
         return false;
     }
     
+    // IPv4 clients arrive on the IPv6 socket as ::ffff:a.b.c.d
+    if (dual_stack) {
+        int v6only = 0;
+        if (setsockopt(listen_socket_, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) < 0) {
+            logger_->warn("Failed to clear IPV6_V6ONLY, IPv4 clients may not be accepted: " +
+                          std::string(strerror(errno)));
+        }
+    }
+    
     // Set non-blocking mode
     int flags = fcntl(listen_socket_, F_GETFL, 0);
     if (flags == -1) {
@@ -134,22 +307,7 @@ bool FTPServer::createServerSocket() {
     }
     
     // Bind socket
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(config_->connection.bind_port);
-    
-    if (config_->connection.bind_address == "0.0.0.0") {
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-    } else {
-        if (inet_pton(AF_INET, config_->connection.bind_address.c_str(), &server_addr.sin_addr) <= 0) {
-            logger_->error("Invalid bind address: " + config_->connection.bind_address);
-            close(listen_socket_);
-            return false;
-        }
-    }
-    
-    if (bind(listen_socket_, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (bind(listen_socket_, reinterpret_cast<struct sockaddr*>(&server_addr), server_addr_len) < 0) {
         logger_->error("Failed to bind socket: " + std::string(strerror(errno)));
         close(listen_socket_);
         return false;
@@ -188,6 +346,11 @@ bool FTPServer::loadConfiguration() {
         virtual_host_manager_->initialize();
     }
     
+    // Swap in the new network rules; on error the old ones stay active
+    if (access_control_) {
+        access_control_->reload();
+    }
+    
     return true;
 }
 
@@ -220,6 +383,34 @@ bool FTPServer::start() {
     running_ = true;
     logger_->info("Starting FTP server...");
     
+    // Watch for handlers that block a reactor past handler_budget
+    if (!loop_monitor_->start()) {
+        logger_->error("Failed to start loop monitor");
+        running_ = false;
+        return false;
+    }
+    
+    // Sample memory and enforce max_memory_usage
+    if (!memory_monitor_->start()) {
+        logger_->error("Failed to start memory monitor");
+        running_ = false;
+        return false;
+    }
+    
+    // Start the worker threads before any session is dispatched
+    if (!task_scheduler_->start()) {
+        logger_->error("Failed to start task scheduler");
+        running_ = false;
+        return false;
+    }
+    
+    // Restore usage totals before any session can add to them
+    if (!usage_accounting_->start()) {
+        logger_->error("Failed to start usage accounting");
+        running_ = false;
+        return false;
+    }
+    
     // Start connection manager
     if (!connection_manager_->start()) {
         logger_->error("Failed to start connection manager");
@@ -227,6 +418,15 @@ bool FTPServer::start() {
         return false;
     }
     
+#ifdef ENABLE_SSL
+    // Start the TLS handshake workers
+    if (tls_handshake_pool_ && !tls_handshake_pool_->start()) {
+        logger_->error("Failed to start TLS handshake pool");
+        running_ = false;
+        return false;
+    }
+#endif
+    
     // Start statistics collection if enabled
     if (config_->enable_statistics) {
         statistics_->start();
@@ -237,6 +437,12 @@ bool FTPServer::start() {
         startMonitoring();
     }
     
+    if (metrics_server_ && !metrics_server_->start()) {
+        logger_->error("Failed to start metrics endpoint");
+        running_ = false;
+        return false;
+    }
+    
     // Main server loop
     try {
         mainLoop();
@@ -252,30 +458,87 @@ bool FTPServer::start() {
 void FTPServer::mainLoop() {
     logger_->info("FTP server main loop started");
     
+    const auto loop_period = std::chrono::milliseconds(10);
+    auto last_iteration = std::chrono::steady_clock::now();
+    loop_monitor_->attachThread(main_reactor_);
+    
     while (running_) {
+        // Measure how far this pass started behind schedule
+        auto iteration_start = std::chrono::steady_clock::now();
+        admission_controller_->recordLoopLag(std::chrono::duration_cast<std::chrono::microseconds>(
+            iteration_start - last_iteration - loop_period));
+        last_iteration = iteration_start;
+        
+        // Refresh load signals before deciding on new clients
+        admission_controller_->update(
+            task_scheduler_->getQueuedCount(),
+            task_scheduler_->getInFlight(FTPTaskScheduler::TaskClass::FILESYSTEM));
+        
         // Accept new connections
-        acceptConnections();
+        {
+            FTPLoopMonitor::HandlerScope handler("accept");
+            acceptConnections();
+        }
         
         // Process existing connections
-        connection_manager_->processConnections();
+        size_t dispatched = 0;
+        {
+            FTPLoopMonitor::HandlerScope handler("dispatch");
+            dispatched = connection_manager_->processConnections();
+        }
         
         // Update statistics
         if (config_->enable_statistics) {
+            FTPLoopMonitor::HandlerScope handler("statistics");
             statistics_->update();
         }
         
+        // Serve any pending metrics scrape
+        if (metrics_server_) {
+            FTPLoopMonitor::HandlerScope handler("metrics");
+            metrics_server_->poll();
+        }
+        
+        // SIGUSR2 asks for the recorded spans
+        if (trace_dump_requested_.exchange(false)) {
+            writeTrace();
+        }
+        
+#ifdef ENABLE_SSL
+        // Rotate ticket keys and expire cached TLS sessions
+        if (tls_context_) {
+            FTPLoopMonitor::HandlerScope handler("tls_tick");
+            tls_context_->tick();
+        }
+#endif
+        
+        // The main loop's queue is the session work handed to the workers
+        loop_monitor_->recordIteration(main_reactor_, std::chrono::steady_clock::now() - iteration_start, dispatched);
+        loop_monitor_->setQueueDepth(main_reactor_, task_scheduler_->getQueuedCount());
+        
         // Sleep briefly to prevent busy waiting
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(loop_period);
     }
     
+    FTPLoopMonitor::detachThread();
     logger_->info("FTP server main loop stopped");
 }
 
 void FTPServer::acceptConnections() {
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len;
+    
+    static const std::string kNoVirtualHost;
+    const std::string& default_virtual_host_name =
+        default_virtual_host_ ? default_virtual_host_->getHostname() : kNoVirtualHost;
+    
+    // Under overload in defer mode, leave new clients in the listen backlog
+    if (admission_controller_->shouldDefer()) {
+        return;
+    }
     
     while (running_) {
+        client_addr_len = sizeof(client_addr);
         int client_socket = accept(listen_socket_, (struct sockaddr*)&client_addr, &client_addr_len);
         
         if (client_socket == -1) {
@@ -288,30 +551,49 @@ void FTPServer::acceptConnections() {
             }
         }
         
+        FTPTraceSpan span(FTPTracer::ACCEPT, "accept");
+        
+        // Filter banned clients and networks before any per-client state or
+        // string is built; refused clients are not logged so a flood stays cheap
+        FTPIPKey client_key;
+        if (!FTPIPKey::fromSockaddr(reinterpret_cast<struct sockaddr*>(&client_addr), client_key) ||
+            rate_limiter_->isBanned(client_key) ||
+            !access_control_->isAllowed(client_key, default_virtual_host_name)) {
+            close(client_socket);
+            continue;
+        }
+        
         // Check rate limiting
-        std::string client_ip = inet_ntoa(client_addr.sin_addr);
-        if (config_->enable_rate_limiting && !rate_limiter_->allowConnection(client_ip)) {
-            logger_->warn("Rate limit exceeded for client: " + client_ip);
+        if (config_->enable_rate_limiting && !rate_limiter_->allowConnection(client_key)) {
+            close(client_socket);
+            continue;
+        }
+        
+        // Shed load before any per-session state is created
+        if (!memory_monitor_->admit() || !admission_controller_->admit()) {
+            static const char kOverloaded[] = "421 Service not available, server overloaded\r\n";
+            ssize_t ignored = send(client_socket, kOverloaded, sizeof(kOverloaded) - 1, MSG_NOSIGNAL);
+            (void)ignored; // Best effort; the client is closed either way
             close(client_socket);
             continue;
         }
         
         // Check connection limit
         if (connection_manager_->getConnectionCount() >= config_->connection.max_connections) {
-            logger_->warn("Connection limit reached, rejecting client: " + client_ip);
+            logger_->warn("Connection limit reached, rejecting client: " + client_key.toString());
             close(client_socket);
             continue;
         }
         
         // Create new connection
         auto connection = std::make_shared<FTPConnection>(
-            client_socket, client_ip, default_virtual_host_);
+            client_socket, client_key, default_virtual_host_);
         
         if (connection_manager_->addConnection(connection)) {
-            logger_->info("New connection accepted from " + client_ip);
+            logger_->info("New connection accepted from " + connection->getClientIP());
             statistics_->incrementConnections();
         } else {
-            logger_->error("Failed to add connection from " + client_ip);
+            logger_->error("Failed to add connection from " + connection->getClientIP());
             close(client_socket);
         }
     }
@@ -325,11 +607,33 @@ void FTPServer::stop() {
     logger_->info("Stopping FTP server...");
     running_ = false;
     
+    // Stop the workers first so no session task outlives the manager
+    if (task_scheduler_) {
+        task_scheduler_->stop();
+    }
+    
     // Stop connection manager
     if (connection_manager_) {
         connection_manager_->stop();
     }
     
+    // Checkpoint usage once no session can add to it
+    if (usage_accounting_) {
+        usage_accounting_->stop();
+    }
+    
+#ifdef ENABLE_SSL
+    // Stop TLS handshake workers
+    if (tls_handshake_pool_) {
+        tls_handshake_pool_->stop();
+    }
+#endif
+    
+    // Stop the rate limiter's expiry thread
+    if (rate_limiter_) {
+        rate_limiter_->stop();
+    }
+    
     // Stop statistics
     if (config_->enable_statistics && statistics_) {
         statistics_->stop();
@@ -337,6 +641,21 @@ void FTPServer::stop() {
     
     // Stop monitoring
     stopMonitoring();
+    if (loop_monitor_) {
+        loop_monitor_->stop();
+    }
+    if (memory_monitor_) {
+        memory_monitor_->stop();
+    }
+    
+    if (metrics_server_) {
+        metrics_server_->stop();
+    }
+    
+    // Keep the spans leading up to shutdown
+    if (config_->profile_performance || config_->trace_commands) {
+        writeTrace();
+    }
     
     // Close server socket
     if (listen_socket_ != -1) {
@@ -349,11 +668,141 @@ void FTPServer::stop() {
 
 
 
+void FTPServer::registerMetrics() {
+    metrics_server_->addCollector([this](FTPMetricsWriter& writer) {
+        auto stats = statistics_->getStatsMap();
+        writer.counter("ssftpd_connections", "Client connections accepted", stats["total_connections"]);
+        writer.gauge("ssftpd_sessions", "Open client sessions",
+                     static_cast<double>(connection_manager_->getConnectionCount()));
+        writer.counter("ssftpd_commands", "FTP commands processed", stats["total_requests"]);
+        writer.counter("ssftpd_sent_bytes", "Bytes sent to clients", stats["total_bytes_transferred"]);
+        writer.counter("ssftpd_files_transferred", "Files transferred", stats["total_files_transferred"]);
+        writer.counter("ssftpd_logins_succeeded", "Successful logins", stats["successful_logins"]);
+        writer.counter("ssftpd_logins_failed", "Failed logins", stats["failed_logins"]);
+        writer.counter("ssftpd_error_replies", "5xx replies sent", stats["total_errors"]);
+        
+        writer.family("ssftpd_command_latency_microseconds", "summary", "FTP command latency by verb");
+        for (const auto& entry : statistics_->getCommandLatencies()) {
+            writer.summary("ssftpd_command_latency_microseconds", entry.second, "verb", entry.first);
+        }
+        
+        writer.family("ssftpd_phase_latency_microseconds", "summary", "Session phase latency");
+        auto phases = statistics_->getPhaseLatencies();
+        for (const auto& entry : phases) {
+            if (entry.first != "throughput_kib") {
+                writer.summary("ssftpd_phase_latency_microseconds", entry.second, "phase", entry.first);
+            }
+        }
+        writer.family("ssftpd_transfer_throughput_kibibytes_per_second", "summary", "Per-command transfer rate");
+        writer.summary("ssftpd_transfer_throughput_kibibytes_per_second", phases["throughput_kib"]);
+    });
+    
+    metrics_server_->addCollector([this](FTPMetricsWriter& writer) {
+        auto admission = admission_controller_->getStats();
+        writer.gauge("ssftpd_overloaded", "1 while admission control sheds load", admission.overloaded ? 1.0 : 0.0);
+        writer.gauge("ssftpd_loop_lag_seconds", "Smoothed main loop lag", admission.loop_lag_us / 1e6);
+        writer.counter("ssftpd_admission_rejected", "Connections refused by admission control", admission.rejected);
+        writer.counter("ssftpd_admission_deferred", "Accept passes skipped while overloaded", admission.deferred);
+        
+        auto memory = memory_monitor_->getStats();
+        writer.gauge("ssftpd_resident_memory_bytes", "Resident set size", static_cast<double>(memory.process.resident));
+        writer.gauge("ssftpd_proportional_memory_bytes", "Proportional set size",
+                     static_cast<double>(memory.process.proportional));
+        writer.gauge("ssftpd_swap_bytes", "Swapped out memory", static_cast<double>(memory.process.swap));
+        writer.gauge("ssftpd_memory_limit_bytes", "max_memory_usage", static_cast<double>(memory.limit));
+        writer.gauge("ssftpd_memory_pressure", "0 normal, 1 reclaiming, 2 refusing sessions",
+                     static_cast<double>(memory.pressure));
+        writer.counter("ssftpd_memory_reclaims", "Memory reclaim passes", memory.reclaims);
+        writer.counter("ssftpd_memory_refused_sessions", "Connections refused for memory", memory.refused);
+        writer.counter("ssftpd_released_buffer_bytes", "Idle send buffer bytes released",
+                       connection_manager_->getReleasedBufferBytes());
+        writer.family("ssftpd_subsystem_memory_bytes", "gauge", "Memory held by a subsystem");
+        for (const auto& subsystem : memory.subsystems) {
+            writer.sample("ssftpd_subsystem_memory_bytes", static_cast<double>(subsystem.second),
+                          "subsystem", subsystem.first);
+        }
+        
+        auto scheduler = task_scheduler_->getStats();
+        writer.gauge("ssftpd_scheduler_workers", "Worker threads", static_cast<double>(scheduler.workers));
+        writer.gauge("ssftpd_scheduler_queued_tasks", "Tasks not yet started", static_cast<double>(scheduler.queued));
+        writer.counter("ssftpd_scheduler_executed_tasks", "Tasks executed", scheduler.executed);
+        writer.counter("ssftpd_scheduler_stolen_tasks", "Tasks taken from another worker", scheduler.stolen);
+        
+        // Reactors are the main loop and the scheduler workers
+        auto reactors = loop_monitor_->getStats();
+        writer.family("ssftpd_reactor_iteration_microseconds", "summary", "Busy time per event loop iteration");
+        for (const auto& reactor : reactors) {
+            writer.summary("ssftpd_reactor_iteration_microseconds", reactor.iteration_us, "reactor", reactor.name);
+        }
+        writer.family("ssftpd_reactor_handler_microseconds", "summary", "Time a handler held its reactor");
+        for (const auto& reactor : reactors) {
+            writer.summary("ssftpd_reactor_handler_microseconds", reactor.handler_us, "reactor", reactor.name);
+        }
+        writer.family("ssftpd_reactor_batch_size", "summary", "Events handled per event loop iteration");
+        for (const auto& reactor : reactors) {
+            writer.summary("ssftpd_reactor_batch_size", reactor.batch_size, "reactor", reactor.name);
+        }
+        writer.family("ssftpd_reactor_queue_depth", "gauge", "Events queued on the reactor");
+        for (const auto& reactor : reactors) {
+            writer.sample("ssftpd_reactor_queue_depth", static_cast<double>(reactor.queue_depth), "reactor", reactor.name);
+        }
+        writer.family("ssftpd_reactor_stalls", "counter", "Handlers that exceeded handler_budget");
+        for (const auto& reactor : reactors) {
+            writer.sample("ssftpd_reactor_stalls_total", reactor.stalls, "reactor", reactor.name);
+        }
+        
+        writer.gauge("ssftpd_banned_clients", "Client addresses currently banned",
+                     static_cast<double>(rate_limiter_->getBanCount()));
+        writer.gauge("ssftpd_access_rules", "Network access rules loaded",
+                     static_cast<double>(access_control_->getRuleCount()));
+        writer.counter("ssftpd_shaper_granted_bytes", "Bytes granted by the bandwidth shaper",
+                       bandwidth_shaper_->getGrantedBytes());
+        writer.counter("ssftpd_shaper_throttled", "Sends delayed by the bandwidth shaper",
+                       bandwidth_shaper_->getThrottledCount());
+        
+        // Totals per FTP verb and per transfer type and mode
+        if (FTPPerfCounters::isEnabled()) {
+            auto operations = FTPPerfCounters::getTotals();
+            writer.family("ssftpd_operation_perf_scopes", "counter", "Profiled commands and sends");
+            for (const auto& entry : operations) {
+                writer.sample("ssftpd_operation_perf_scopes_total", entry.second.scopes, "operation", entry.first);
+            }
+            for (size_t counter = 0; counter < FTPPerfCounters::COUNTER_COUNT; ++counter) {
+                auto id = static_cast<FTPPerfCounters::Counter>(counter);
+                std::string name = std::string("ssftpd_operation_") + FTPPerfCounters::counterName(id);
+                writer.family(name.c_str(), "counter", "Performance counter total by operation");
+                for (const auto& entry : operations) {
+                    writer.sample((name + "_total").c_str(), entry.second.values[counter], "operation", entry.first);
+                }
+            }
+        }
+        
+        // Per-vhost only; per-user series would grow with the user base
+        writer.family("ssftpd_vhost_sent_bytes", "counter", "Bytes sent to clients by virtual host");
+        for (const auto& entry : usage_accounting_->getAllUsage(FTPUsageAccounting::Scope::VIRTUAL_HOST)) {
+            writer.sample("ssftpd_vhost_sent_bytes_total", entry.second.bytes_downloaded, "vhost", entry.first);
+        }
+        
+        writer.counter("ssftpd_log_messages", "Log messages written", logger_->getMessagesLogged());
+        writer.counter("ssftpd_log_bytes", "Log bytes written", logger_->getBytesWritten());
+        
+#ifdef ENABLE_SSL
+        auto session_cache = tls_context_ ? tls_context_->getSessionCache() : nullptr;
+        if (session_cache) {
+            auto tls = session_cache->getStats();
+            writer.counter("ssftpd_tls_session_cache_hits", "TLS session resumptions from the cache", tls.hits);
+            writer.counter("ssftpd_tls_session_cache_misses", "TLS session cache misses", tls.misses);
+        }
+#endif
+    });
+}
+
 void FTPServer::setupSignalHandlers() {
     // Set up signal handlers for graceful shutdown
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     signal(SIGHUP, signalHandler);
+    signal(SIGUSR2, signalHandler);
 }
 
 void FTPServer::signalHandler(int signal) {
@@ -371,6 +820,23 @@ void FTPServer::signalHandler(int signal) {
                 instance_->loadConfiguration();
             }
             break;
+        case SIGUSR2:
+            // Dump trace spans; the file is written from the main loop
+            trace_dump_requested_ = true;
+            break;
+    }
+}
+
+void FTPServer::writeTrace() {
+    if (!config_->profile_performance && !config_->trace_commands) {
+        logger_->warn("Trace dump requested but tracing is off; set profile_performance or trace_commands");
+        return;
+    }
+    
+    if (FTPTracer::writeTrace(config_->trace_file)) {
+        logger_->info("Trace written to " + config_->trace_file);
+    } else {
+        logger_->error("Failed to write trace to " + config_->trace_file);
     }
 }
 
@@ -400,24 +866,30 @@ void FTPServer::stopMonitoring() {
 }
 
 void FTPServer::monitorSystemResources() {
-    // Monitor memory usage
-    if (config_->max_memory_usage > 0) {
-        // This is a simplified memory check
-        // In a real implementation, you would get actual memory usage
-        size_t current_memory = 0; // Placeholder
-        
-        if (current_memory > config_->max_memory_usage) {
-            logger_->warn("Memory usage limit exceeded: " + 
-                         std::to_string(current_memory) + " bytes");
-        }
+    // Enforcement runs on the memory monitor's own thread; this only reports
+    auto memory = memory_monitor_->getStats();
+    if (memory.limit > 0 && memory.process.resident + memory.process.swap > memory.limit) {
+        logger_->warn("Memory usage limit exceeded: " +
+                     std::to_string(memory.process.resident + memory.process.swap) + " bytes");
     }
+    
+    std::string breakdown;
+    for (const auto& subsystem : memory.subsystems) {
+        breakdown += " " + subsystem.first + "=" + std::to_string(subsystem.second);
+    }
+    logger_->debug("Memory: resident=" + std::to_string(memory.process.resident) +
+                  " pss=" + std::to_string(memory.process.proportional) +
+                  " anonymous=" + std::to_string(memory.process.anonymous) +
+                  " swap=" + std::to_string(memory.process.swap) + breakdown);
 }
 
 
 
 void FTPServer::monitorConnections() {
     if (connection_manager_) {
-        size_t connection_count = connection_manager_->getConnectionCount();
+        // Read the published snapshot; this never touches the session shards
+        auto snapshot = connection_manager_->readSnapshot();
+        size_t connection_count = snapshot->sessions.size();
         size_t max_connections = config_->connection.max_connections;
         
         if (connection_count > max_connections * 0.8) {
@@ -425,6 +897,18 @@ void FTPServer::monitorConnections() {
                          std::to_string(connection_count) + "/" + 
                          std::to_string(max_connections));
         }
+        
+        size_t unauthenticated = 0;
+        for (const auto& session : snapshot->sessions) {
+            if (session.username.empty()) {
+                unauthenticated++;
+            }
+        }
+        
+        if (unauthenticated > 0) {
+            logger_->debug("Sessions not logged in: " + std::to_string(unauthenticated) +
+                          "/" + std::to_string(connection_count));
+        }
     }
 }
 
@@ -432,5 +916,6 @@ void FTPServer::monitorConnections() {
 
 // Static instance pointer for signal handling
 FTPServer* FTPServer::instance_ = nullptr;
+std::atomic<bool> FTPServer::trace_dump_requested_(false);
 
 } // namespace ssftpd
@@ -0,0 +1,37 @@
+#include "ssftpd/ftp_session_snapshot.hpp"
+
+namespace ssftpd {
+
+FTPSessionSnapshotPublisher::ReadHandle::ReadHandle(const FTPSessionSnapshotPublisher& publisher)
+    : guard_(publisher.epoch_)
+    , snapshot_(publisher.current_.load())
+{
+}
+
+FTPSessionSnapshotPublisher::FTPSessionSnapshotPublisher()
+    : current_(new FTPSessionSnapshot{0, std::chrono::steady_clock::now(), {}})
+    , next_version_(1)
+{
+}
+
+FTPSessionSnapshotPublisher::~FTPSessionSnapshotPublisher() {
+    delete current_.load();
+}
+
+void FTPSessionSnapshotPublisher::publish(std::vector<FTPSessionInfo> sessions) {
+    auto* snapshot = new FTPSessionSnapshot{next_version_++, std::chrono::steady_clock::now(),
+                                            std::move(sessions)};
+
+    const FTPSessionSnapshot* previous = current_.exchange(snapshot);
+    epoch_.retire([previous]() { delete previous; });
+
+    // Free whatever earlier snapshots readers have finished with
+    epoch_.reclaim();
+}
+
+uint64_t FTPSessionSnapshotPublisher::version() const {
+    ReadHandle handle(*this);
+    return handle->version;
+}
+
+} // namespace ssftpd
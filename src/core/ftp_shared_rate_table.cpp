@@ -0,0 +1,274 @@
+#include "ssftpd/ftp_shared_rate_table.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ssftpd {
+
+namespace {
+
+constexpr uint64_t kMagic = 0x4C52445054465353ULL; // "SSFTPDRL"
+constexpr uint32_t kVersion = 2;
+
+// Processes share these words through the mapping, so they must never
+// fall back to a lock living in one process
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters need lock-free 64-bit atomics");
+static_assert(std::atomic<int64_t>::is_always_lock_free, "shared counters need lock-free 64-bit atomics");
+
+uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = rotateLeft(v1, 13); v1 ^= v0; v0 = rotateLeft(v0, 32);
+    v2 += v3; v3 = rotateLeft(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = rotateLeft(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = rotateLeft(v1, 17); v1 ^= v2; v2 = rotateLeft(v2, 32);
+}
+
+// SipHash-2-4 of the two address words; without the key nobody can pick
+// an address that lands on another one's fingerprint
+uint64_t sipHash(const uint64_t key[2], uint64_t high, uint64_t low) {
+    uint64_t v0 = key[0] ^ 0x736F6D6570736575ULL;
+    uint64_t v1 = key[1] ^ 0x646F72616E646F6DULL;
+    uint64_t v2 = key[0] ^ 0x6C7967656E657261ULL;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+
+    const uint64_t words[3] = {high, low, static_cast<uint64_t>(16) << 56};
+    for (uint64_t word : words) {
+        v3 ^= word;
+        sipRound(v0, v1, v2, v3);
+        sipRound(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+
+    v2 ^= 0xFF;
+    for (int round = 0; round < 4; ++round) {
+        sipRound(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+} // namespace
+
+struct alignas(64) FTPSharedRateTable::Header {
+    std::atomic<uint64_t> magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t hash_key[2];  // Random, chosen by the creator
+    FTPAtomicSlidingWindow global_connections;
+};
+
+FTPSharedRateTable::FTPSharedRateTable(std::shared_ptr<Logger> logger)
+    : logger_(logger)
+    , header_(nullptr)
+    , slots_(nullptr)
+    , mapped_size_(0)
+    , slot_mask_(0)
+{
+}
+
+FTPSharedRateTable::~FTPSharedRateTable() {
+    close();
+}
+
+void FTPSharedRateTable::close() {
+    if (header_) {
+        munmap(header_, mapped_size_);
+    }
+    header_ = nullptr;
+    slots_ = nullptr;
+    mapped_size_ = 0;
+    slot_mask_ = 0;
+}
+
+bool FTPSharedRateTable::open(const std::string& name, size_t slot_count) {
+    close();
+
+    size_t slots = kMaxProbe;
+    while (slots < slot_count) {
+        slots <<= 1;
+    }
+
+    // Whoever creates the object initializes it; the rest wait for the magic
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+        logger_->error("Failed to open shared rate limit table " + name + ": " + strerror(errno));
+        return false;
+    }
+
+    size_t size = sizeof(Header) + slots * sizeof(Slot);
+    if (created) {
+        // ftruncate() zero-fills, and an all-zero slot is an empty one
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            logger_->error("Failed to size shared rate limit table " + name + ": " + strerror(errno));
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+    } else {
+        struct stat info;
+        for (int attempt = 0;; ++attempt) {
+            if (fstat(fd, &info) != 0) {
+                logger_->error("Failed to stat shared rate limit table " + name + ": " + strerror(errno));
+                ::close(fd);
+                return false;
+            }
+            if (static_cast<size_t>(info.st_size) >= sizeof(Header)) {
+                break;
+            }
+            if (attempt == 100) {
+                logger_->error("Shared rate limit table " + name + " was never initialized");
+                ::close(fd);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        size = static_cast<size_t>(info.st_size);
+    }
+
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        logger_->error("Failed to map shared rate limit table " + name + ": " + strerror(errno));
+        return false;
+    }
+
+    Header* header = static_cast<Header*>(memory);
+    if (created) {
+        header->version = kVersion;
+        header->slot_count = static_cast<uint32_t>(slots);
+        std::random_device random;
+        for (auto& word : header->hash_key) {
+            word = (static_cast<uint64_t>(random()) << 32) | random();
+        }
+        header->magic.store(kMagic, std::memory_order_release);
+    } else {
+        for (int attempt = 0; header->magic.load(std::memory_order_acquire) != kMagic; ++attempt) {
+            if (attempt == 100) {
+                logger_->error("Shared rate limit table " + name + " was never initialized");
+                munmap(memory, size);
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        slots = header->slot_count;
+        if (header->version != kVersion || slots < kMaxProbe || (slots & (slots - 1)) != 0 ||
+            size != sizeof(Header) + slots * sizeof(Slot)) {
+            logger_->error("Shared rate limit table " + name +
+                           " has an incompatible layout; remove it from /dev/shm after stopping all servers");
+            munmap(memory, size);
+            return false;
+        }
+    }
+
+    header_ = header;
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(memory) + sizeof(Header));
+    mapped_size_ = size;
+    slot_mask_ = slots - 1;
+
+    logger_->info(std::string(created ? "Created" : "Attached to") + " shared rate limit table " + name +
+                  " with " + std::to_string(slots) + " slots");
+    return true;
+}
+
+uint64_t FTPSharedRateTable::fingerprintOf(const FTPIPKey& key) const {
+    // Zero marks an empty slot
+    uint64_t fingerprint = sipHash(header_->hash_key, key.high(), key.low());
+    return fingerprint != 0 ? fingerprint : 1;
+}
+
+bool FTPSharedRateTable::isIdle(const Slot& slot, Clock::time_point now, Clock::duration idle_after) {
+    int64_t now_ns = now.time_since_epoch().count();
+    return slot.banned_until.load(std::memory_order_relaxed) <= now_ns &&
+           slot.last_used.load(std::memory_order_relaxed) + idle_after.count() <= now_ns;
+}
+
+FTPSharedRateTable::Slot* FTPSharedRateTable::acquire(const FTPIPKey& key, Clock::time_point now,
+                                                      Clock::duration idle_after) {
+    if (!header_) {
+        return nullptr;
+    }
+
+    uint64_t fingerprint = fingerprintOf(key);
+    int64_t now_ns = now.time_since_epoch().count();
+    Slot* found = nullptr;
+    Slot* reusable = nullptr;
+
+    // Slots are never emptied, so the first empty slot ends the chain
+    for (size_t probe = 0; probe < kMaxProbe && !found; ++probe) {
+        Slot& slot = slots_[(fingerprint + probe) & slot_mask_];
+        uint64_t current = slot.fingerprint.load(std::memory_order_acquire);
+
+        if (current == 0 && slot.fingerprint.compare_exchange_strong(current, fingerprint)) {
+            found = &slot;
+        } else if (current == fingerprint) {
+            found = &slot;
+        } else if (current != 0 && !reusable && isIdle(slot, now, idle_after)) {
+            reusable = &slot;
+        } else if (current == 0) {
+            break;
+        }
+    }
+
+    if (!found && reusable) {
+        // Take over a slot nobody has used for a while
+        uint64_t previous = reusable->fingerprint.load(std::memory_order_acquire);
+        if (!isIdle(*reusable, now, idle_after) ||
+            !reusable->fingerprint.compare_exchange_strong(previous, fingerprint)) {
+            return nullptr;
+        }
+        reusable->connections.reset();
+        reusable->requests.reset();
+        reusable->failed_logins.reset();
+        reusable->banned_until.store(0);
+        found = reusable;
+    }
+
+    if (found && found->last_used.load(std::memory_order_relaxed) != now_ns) {
+        found->last_used.store(now_ns, std::memory_order_relaxed);
+    }
+    return found;
+}
+
+FTPSharedRateTable::Slot* FTPSharedRateTable::find(const FTPIPKey& key) const {
+    if (!header_) {
+        return nullptr;
+    }
+
+    uint64_t fingerprint = fingerprintOf(key);
+    for (size_t probe = 0; probe < kMaxProbe; ++probe) {
+        Slot& slot = slots_[(fingerprint + probe) & slot_mask_];
+        uint64_t current = slot.fingerprint.load(std::memory_order_acquire);
+        if (current == fingerprint) {
+            return &slot;
+        }
+        if (current == 0) {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+FTPAtomicSlidingWindow& FTPSharedRateTable::globalConnections() {
+    return header_->global_connections;
+}
+
+size_t FTPSharedRateTable::getSlotCount() const {
+    return slot_mask_ + 1;
+}
+
+} // namespace ssftpd
@@ -1,23 +1,82 @@
 #include "ssftpd/ftp_statistics.hpp"
 #include "ssftpd/logger.hpp"
+#include "ssftpd/ftp_statistics_file.hpp"
 #include <chrono>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
 
 namespace ssftpd {
 
+namespace {
+
+// RFC 959 verbs plus the common extensions; anything else is "OTHER"
+const char* const kCommandVerbs[] = {
+    "USER", "PASS", "ACCT", "CWD", "CDUP", "SMNT", "QUIT", "REIN", "PORT", "PASV",
+    "TYPE", "STRU", "MODE", "RETR", "STOR", "STOU", "APPE", "ALLO", "REST", "RNFR",
+    "RNTO", "ABOR", "DELE", "RMD", "MKD", "PWD", "LIST", "NLST", "SITE", "SYST",
+    "STAT", "HELP", "NOOP", "FEAT", "OPTS", "AUTH", "PBSZ", "PROT", "CCC", "EPSV",
+    "EPRT", "MDTM", "SIZE", "MLSD", "MLST"
+};
+
+constexpr size_t kCommandVerbCount = sizeof(kCommandVerbs) / sizeof(kCommandVerbs[0]);
+
+const char* const kPhaseNames[] = {"auth", "data_connect", "first_byte", "throughput_kib"};
+
+uint32_t packVerb(const char* verb, size_t length) {
+    uint32_t code = 0;
+    for (size_t i = 0; i < length; ++i) {
+        code = (code << 8) | static_cast<uint8_t>(verb[i]);
+    }
+    return code;
+}
+
+size_t commandIndex(const std::string& verb) {
+    // Verbs are at most four letters, so each one packs into one word
+    static const std::vector<uint32_t> codes = []() {
+        std::vector<uint32_t> packed;
+        for (const char* known : kCommandVerbs) {
+            packed.push_back(packVerb(known, strlen(known)));
+        }
+        return packed;
+    }();
+
+    if (verb.empty() || verb.size() > 4) {
+        return kCommandVerbCount;
+    }
+    uint32_t code = packVerb(verb.data(), verb.size());
+    for (size_t i = 0; i < kCommandVerbCount; ++i) {
+        if (codes[i] == code) {
+            return i;
+        }
+    }
+    return kCommandVerbCount;
+}
+
+// Snapshot file slots after the counters, which keep their enum order
+constexpr size_t kCurrentConnectionsValue = 7;
+constexpr size_t kUptimeValue = 8;
+
+// msync is asynchronous between these; stop() waits for the last one
+constexpr int64_t kSnapshotSyncSeconds = 10;
+
+uint64_t toMicroseconds(std::chrono::steady_clock::duration elapsed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return micros > 0 ? static_cast<uint64_t>(micros) : 0;
+}
+
+} // namespace
+
 FTPStatistics::FTPStatistics()
     : running_(false)
     , start_time_(std::chrono::steady_clock::now())
-    , total_connections_(0)
     , current_connections_(0)
-    , total_requests_(0)
-    , total_bytes_transferred_(0)
-    , total_files_transferred_(0)
-    , successful_logins_(0)
-    , failed_logins_(0)
-    , total_errors_(0)
+    , series_second_(0)
 {
+    for (size_t i = 0; i <= kCommandVerbCount; ++i) {
+        command_latency_.push_back(std::make_unique<FTPLatencyHistogram>());
+    }
 }
 
 FTPStatistics::~FTPStatistics() {
@@ -32,19 +91,44 @@ void FTPStatistics::start() {
     running_ = true;
     start_time_ = std::chrono::steady_clock::now();
     
-    // Reset counters
-    total_connections_ = 0;
+    // Reset counters, then carry the lifetime totals over from the last run
+    counters_.reset();
     current_connections_ = 0;
-    total_requests_ = 0;
-    total_bytes_transferred_ = 0;
-    total_files_transferred_ = 0;
-    successful_logins_ = 0;
-    failed_logins_ = 0;
-    total_errors_ = 0;
+    FTPStatisticsFile::Values values;
+    if (snapshot_file_ && snapshot_file_->load(values)) {
+        for (size_t i = 0; i < COUNTER_COUNT; ++i) {
+            counters_.add(i, values[i]);
+        }
+    }
+    resetLatencies();
+    resetSeries();
 }
 
 void FTPStatistics::stop() {
-    running_ = false;
+    if (!running_.exchange(false)) {
+        return;
+    }
+    
+    if (snapshot_file_) {
+        publishSnapshot();
+        snapshot_file_->sync(true);
+    }
+}
+
+void FTPStatistics::setSnapshotFile(std::shared_ptr<FTPStatisticsFile> file) {
+    snapshot_file_ = std::move(file);
+}
+
+void FTPStatistics::publishSnapshot() {
+    static_assert(COUNTER_COUNT <= kCurrentConnectionsValue, "counters overlap the snapshot gauges");
+    
+    FTPStatisticsFile::Values values{};
+    auto counters = counters_.getAll();
+    std::copy(counters.begin(), counters.end(), values.begin());
+    values[kCurrentConnectionsValue] = current_connections_;
+    values[kUptimeValue] = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - start_time_).count());
+    snapshot_file_->publish(values);
 }
 
 void FTPStatistics::update() {
@@ -55,10 +139,58 @@ void FTPStatistics::update() {
     // Update uptime and other time-based statistics
     auto now = std::chrono::steady_clock::now();
     uptime_ = now - start_time_;
+    
+    // Close the rate buckets once per second; the counters themselves are
+    // not touched on the hot path
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(uptime_).count();
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    if (second <= series_second_) {
+        return;
+    }
+    
+    auto counters = counters_.getAll();
+    series_[static_cast<size_t>(Series::REQUESTS)].advance(counters[TOTAL_REQUESTS], second);
+    series_[static_cast<size_t>(Series::BYTES)].advance(counters[TOTAL_BYTES_TRANSFERRED], second);
+    series_[static_cast<size_t>(Series::LOGINS)].advance(counters[SUCCESSFUL_LOGINS], second);
+    series_[static_cast<size_t>(Series::FAILED_LOGINS)].advance(counters[FAILED_LOGINS], second);
+    series_[static_cast<size_t>(Series::ERRORS)].advance(counters[TOTAL_ERRORS], second);
+    series_second_ = second;
+    
+    // Readers of the file see the counters at most a second late
+    if (snapshot_file_) {
+        publishSnapshot();
+        if (second % kSnapshotSyncSeconds == 0) {
+            snapshot_file_->sync(false);
+        }
+    }
+}
+
+double FTPStatistics::getRate(Series series, std::chrono::seconds window) const {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    return series_[static_cast<size_t>(series)].getRate(window);
+}
+
+std::vector<uint64_t> FTPStatistics::getRateSeries(Series series, FTPRateSeries::Resolution resolution) const {
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    return series_[static_cast<size_t>(series)].getBuckets(resolution);
+}
+
+void FTPStatistics::resetSeries() {
+    // Totals restored from the snapshot file must not show up as one
+    // huge first bucket
+    auto counters = counters_.getAll();
+    std::lock_guard<std::mutex> lock(series_mutex_);
+    series_[static_cast<size_t>(Series::REQUESTS)].reset(counters[TOTAL_REQUESTS]);
+    series_[static_cast<size_t>(Series::BYTES)].reset(counters[TOTAL_BYTES_TRANSFERRED]);
+    series_[static_cast<size_t>(Series::LOGINS)].reset(counters[SUCCESSFUL_LOGINS]);
+    series_[static_cast<size_t>(Series::FAILED_LOGINS)].reset(counters[FAILED_LOGINS]);
+    series_[static_cast<size_t>(Series::ERRORS)].reset(counters[TOTAL_ERRORS]);
+    series_second_ = 0;
 }
 
 void FTPStatistics::incrementConnections() {
-    total_connections_++;
+    counters_.add(TOTAL_CONNECTIONS);
+    // The gauge stays one atomic; it changes per session, not per command
     current_connections_++;
 }
 
@@ -69,27 +201,79 @@ void FTPStatistics::decrementConnections() {
 }
 
 void FTPStatistics::incrementRequests() {
-    total_requests_++;
+    counters_.add(TOTAL_REQUESTS);
 }
 
 void FTPStatistics::addBytesTransferred(size_t bytes) {
-    total_bytes_transferred_ += bytes;
+    counters_.add(TOTAL_BYTES_TRANSFERRED, bytes);
 }
 
 void FTPStatistics::incrementFilesTransferred() {
-    total_files_transferred_++;
+    counters_.add(TOTAL_FILES_TRANSFERRED);
 }
 
 void FTPStatistics::incrementSuccessfulLogins() {
-    successful_logins_++;
+    counters_.add(SUCCESSFUL_LOGINS);
 }
 
 void FTPStatistics::incrementFailedLogins() {
-    failed_logins_++;
+    counters_.add(FAILED_LOGINS);
 }
 
 void FTPStatistics::incrementErrors() {
-    total_errors_++;
+    counters_.add(TOTAL_ERRORS);
+}
+
+void FTPStatistics::recordCommand(const std::string& verb, std::chrono::steady_clock::duration elapsed) {
+    command_latency_[commandIndex(verb)]->record(toMicroseconds(elapsed));
+}
+
+void FTPStatistics::recordPhase(FTPTransferPhase phase, std::chrono::steady_clock::duration elapsed) {
+    phase_latency_[static_cast<size_t>(phase)].record(toMicroseconds(elapsed));
+}
+
+void FTPStatistics::recordThroughput(uint64_t bytes, std::chrono::steady_clock::duration elapsed) {
+    auto micros = std::max<uint64_t>(toMicroseconds(elapsed), 1);
+    // bytes per microsecond * 10^6 / 1024 = KiB/s
+    uint64_t kib_per_second = static_cast<uint64_t>(static_cast<double>(bytes) * 1000000.0 / 1024.0 / micros);
+    phase_latency_[static_cast<size_t>(FTPTransferPhase::THROUGHPUT)].record(kib_per_second);
+}
+
+const char* FTPStatistics::commandLabel(const std::string& verb) {
+    size_t index = commandIndex(verb);
+    return index < kCommandVerbCount ? kCommandVerbs[index] : "OTHER";
+}
+
+std::map<std::string, FTPLatencyHistogram::Snapshot> FTPStatistics::getCommandLatencies() const {
+    std::map<std::string, FTPLatencyHistogram::Snapshot> latencies;
+
+    for (size_t i = 0; i <= kCommandVerbCount; ++i) {
+        auto snapshot = command_latency_[i]->snapshot();
+        if (snapshot.count > 0) {
+            latencies[i < kCommandVerbCount ? kCommandVerbs[i] : "OTHER"] = std::move(snapshot);
+        }
+    }
+
+    return latencies;
+}
+
+std::map<std::string, FTPLatencyHistogram::Snapshot> FTPStatistics::getPhaseLatencies() const {
+    std::map<std::string, FTPLatencyHistogram::Snapshot> latencies;
+
+    for (size_t i = 0; i < phase_latency_.size(); ++i) {
+        latencies[kPhaseNames[i]] = phase_latency_[i].snapshot();
+    }
+
+    return latencies;
+}
+
+void FTPStatistics::resetLatencies() {
+    for (auto& histogram : command_latency_) {
+        histogram->reset();
+    }
+    for (auto& histogram : phase_latency_) {
+        histogram.reset();
+    }
 }
 
 void FTPStatistics::setCurrentConnections(size_t count) {
@@ -128,27 +312,46 @@ std::string FTPStatistics::getFormattedBytes(size_t bytes) const {
 }
 
 std::string FTPStatistics::getSummary() const {
+    auto counters = counters_.getAll();
     std::ostringstream oss;
     
     oss << "FTP Server Statistics" << std::endl;
     oss << "====================" << std::endl;
     oss << "Uptime: " << getUptimeString() << std::endl;
-    oss << "Total Connections: " << total_connections_ << std::endl;
+    oss << "Total Connections: " << counters[TOTAL_CONNECTIONS] << std::endl;
     oss << "Current Connections: " << current_connections_ << std::endl;
-    oss << "Total Requests: " << total_requests_ << std::endl;
-    oss << "Total Bytes Transferred: " << getFormattedBytes(total_bytes_transferred_) << std::endl;
-    oss << "Total Files Transferred: " << total_files_transferred_ << std::endl;
-    oss << "Successful Logins: " << successful_logins_ << std::endl;
-    oss << "Failed Logins: " << failed_logins_ << std::endl;
-    oss << "Total Errors: " << total_errors_ << std::endl;
-    
-    if (uptime_.count() > 0) {
-        auto uptime_seconds = std::chrono::duration_cast<std::chrono::seconds>(uptime_).count();
-        double requests_per_second = static_cast<double>(total_requests_) / uptime_seconds;
-        double bytes_per_second = static_cast<double>(total_bytes_transferred_) / uptime_seconds;
-        
-        oss << "Requests per Second: " << std::fixed << std::setprecision(2) << requests_per_second << std::endl;
-        oss << "Transfer Rate: " << getFormattedBytes(static_cast<size_t>(bytes_per_second)) << "/s" << std::endl;
+    oss << "Total Requests: " << counters[TOTAL_REQUESTS] << std::endl;
+    oss << "Total Bytes Transferred: " << getFormattedBytes(counters[TOTAL_BYTES_TRANSFERRED]) << std::endl;
+    oss << "Total Files Transferred: " << counters[TOTAL_FILES_TRANSFERRED] << std::endl;
+    oss << "Successful Logins: " << counters[SUCCESSFUL_LOGINS] << std::endl;
+    oss << "Failed Logins: " << counters[FAILED_LOGINS] << std::endl;
+    oss << "Total Errors: " << counters[TOTAL_ERRORS] << std::endl;
+    
+    // Recent windows, so a current spike is not averaged away over the uptime
+    const std::chrono::seconds windows[] = {std::chrono::seconds(10), std::chrono::minutes(1), std::chrono::hours(1)};
+    oss << "Requests per Second (10s/1m/1h): " << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < 3; ++i) {
+        oss << (i > 0 ? " / " : "") << getRate(Series::REQUESTS, windows[i]);
+    }
+    oss << std::endl;
+    oss << "Transfer Rate (10s/1m/1h): ";
+    for (size_t i = 0; i < 3; ++i) {
+        oss << (i > 0 ? " / " : "")
+            << getFormattedBytes(static_cast<size_t>(getRate(Series::BYTES, windows[i]))) << "/s";
+    }
+    oss << std::endl;
+    oss << "Failed Logins per Minute (1m): " << getRate(Series::FAILED_LOGINS, std::chrono::minutes(1)) * 60
+        << std::endl;
+    oss << "Errors per Minute (1m): " << getRate(Series::ERRORS, std::chrono::minutes(1)) * 60 << std::endl;
+    
+    auto commands = getCommandLatencies();
+    if (!commands.empty()) {
+        oss << "Command Latency (p50/p99/p99.9 us):" << std::endl;
+        for (const auto& entry : commands) {
+            oss << "  " << std::left << std::setw(6) << entry.first << std::right
+                << entry.second.percentile(50) << "/" << entry.second.percentile(99) << "/"
+                << entry.second.percentile(99.9) << " (" << entry.second.count << " samples)" << std::endl;
+        }
     }
     
     return oss.str();
@@ -156,29 +359,28 @@ std::string FTPStatistics::getSummary() const {
 
 std::map<std::string, size_t> FTPStatistics::getStatsMap() const {
     std::map<std::string, size_t> stats;
+    auto counters = counters_.getAll();
     
-    stats["total_connections"] = total_connections_;
+    stats["total_connections"] = counters[TOTAL_CONNECTIONS];
     stats["current_connections"] = current_connections_;
-    stats["total_requests"] = total_requests_;
-    stats["total_bytes_transferred"] = total_bytes_transferred_;
-    stats["total_files_transferred"] = total_files_transferred_;
-    stats["successful_logins"] = successful_logins_;
-    stats["failed_logins"] = failed_logins_;
-    stats["total_errors"] = total_errors_;
+    stats["total_requests"] = counters[TOTAL_REQUESTS];
+    stats["total_bytes_transferred"] = counters[TOTAL_BYTES_TRANSFERRED];
+    stats["total_files_transferred"] = counters[TOTAL_FILES_TRANSFERRED];
+    stats["successful_logins"] = counters[SUCCESSFUL_LOGINS];
+    stats["failed_logins"] = counters[FAILED_LOGINS];
+    stats["total_errors"] = counters[TOTAL_ERRORS];
+    stats["requests_last_minute"] = static_cast<size_t>(getRate(Series::REQUESTS, std::chrono::minutes(1)) * 60);
+    stats["bytes_last_minute"] = static_cast<size_t>(getRate(Series::BYTES, std::chrono::minutes(1)) * 60);
     
     return stats;
 }
 
 void FTPStatistics::reset() {
     start_time_ = std::chrono::steady_clock::now();
-    total_connections_ = 0;
+    counters_.reset();
     current_connections_ = 0;
-    total_requests_ = 0;
-    total_bytes_transferred_ = 0;
-    total_files_transferred_ = 0;
-    successful_logins_ = 0;
-    failed_logins_ = 0;
-    total_errors_ = 0;
+    resetLatencies();
+    resetSeries();
 }
 
 } // namespace ssftpd
@@ -0,0 +1,234 @@
+#include "ssftpd/ftp_statistics_file.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ssftpd {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'S', 'F', 'T', 'P', 'D', 'S', 'T'};
+constexpr uint32_t kVersion = 1;
+
+// Monitoring tools map the file too, so the atomics must be plain words
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "statistics file needs lock-free 64-bit atomics");
+
+void hashWord(uint64_t& hash, uint64_t word) {
+    for (int i = 0; i < 8; ++i) {
+        hash ^= (word >> (i * 8)) & 0xff;
+        hash *= 0x100000001b3ULL;
+    }
+}
+
+int64_t unixNow() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct alignas(64) FTPStatisticsFile::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t slot_size;
+    uint32_t value_count;
+    int64_t created;
+    char reserved[32];
+};
+
+struct alignas(64) FTPStatisticsFile::Slot {
+    std::atomic<uint64_t> generation;
+    std::atomic<int64_t> updated;
+    std::atomic<uint64_t> values[kMaxValues];
+    std::atomic<uint64_t> checksum;
+};
+
+FTPStatisticsFile::FTPStatisticsFile()
+    : header_(nullptr)
+    , slots_(nullptr)
+    , mapped_size_(0)
+    , read_only_(false)
+    , generation_(0)
+{
+}
+
+FTPStatisticsFile::~FTPStatisticsFile() {
+    close();
+}
+
+bool FTPStatisticsFile::open(const std::string& path, bool read_only) {
+    close();
+    error_.clear();
+    read_only_ = read_only;
+
+    int fd = ::open(path.c_str(), read_only ? O_RDONLY | O_CLOEXEC : O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return fail("cannot open " + path + ": " + strerror(errno));
+    }
+
+    const size_t size = sizeof(Header) + 2 * sizeof(Slot);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        ::close(fd);
+        return fail("cannot stat " + path + ": " + strerror(errno));
+    }
+
+    // A writer starts over when the file is new, truncated or from another
+    // layout; a reader cannot
+    bool fresh = static_cast<size_t>(info.st_size) != size;
+    if (fresh && read_only) {
+        ::close(fd);
+        return fail(path + " is not a statistics file");
+    }
+    if (fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+        ::close(fd);
+        return fail("cannot size " + path + ": " + strerror(errno));
+    }
+
+    void* mapping = mmap(nullptr, size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return fail("cannot map " + path + ": " + strerror(errno));
+    }
+
+    header_ = static_cast<Header*>(mapping);
+    slots_ = reinterpret_cast<Slot*>(static_cast<char*>(mapping) + sizeof(Header));
+    mapped_size_ = size;
+
+    bool compatible = std::memcmp(header_->magic, kMagic, sizeof(kMagic)) == 0 &&
+                      header_->version == kVersion &&
+                      header_->header_size == sizeof(Header) &&
+                      header_->slot_size == sizeof(Slot) &&
+                      header_->value_count == kMaxValues;
+    if (!compatible && read_only) {
+        close();
+        return fail(path + " has an unsupported layout");
+    }
+
+    if (!compatible) {
+        std::memset(mapping, 0, size);
+        header_->version = kVersion;
+        header_->header_size = sizeof(Header);
+        header_->slot_size = sizeof(Slot);
+        header_->value_count = kMaxValues;
+        header_->created = unixNow();
+        // Magic last, so a half-written header is never taken as valid
+        std::memcpy(header_->magic, kMagic, sizeof(kMagic));
+        sync(true);
+    }
+
+    // Continue the generation sequence of the snapshot already on disk
+    generation_ = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        Values values;
+        uint64_t generation;
+        int64_t updated;
+        if (readSlot(slots_[i], values, generation, updated) && generation > generation_) {
+            generation_ = generation;
+        }
+    }
+
+    return true;
+}
+
+void FTPStatisticsFile::close() {
+    if (header_) {
+        munmap(header_, mapped_size_);
+    }
+    header_ = nullptr;
+    slots_ = nullptr;
+    mapped_size_ = 0;
+}
+
+bool FTPStatisticsFile::load(Values& values, int64_t* updated) const {
+    if (!header_) {
+        return false;
+    }
+
+    // The writer may publish while we read; retry a few times before
+    // settling for whichever slot was stable
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        uint64_t best_generation = 0;
+        for (size_t i = 0; i < 2; ++i) {
+            Values candidate;
+            uint64_t generation;
+            int64_t time;
+            if (readSlot(slots_[i], candidate, generation, time) && generation > best_generation) {
+                best_generation = generation;
+                values = candidate;
+                if (updated) {
+                    *updated = time;
+                }
+            }
+        }
+        if (best_generation > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool FTPStatisticsFile::readSlot(const Slot& slot, Values& values, uint64_t& generation, int64_t& updated) const {
+    generation = slot.generation.load(std::memory_order_acquire);
+    if (generation == 0) {
+        return false;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hashWord(hash, generation);
+    updated = slot.updated.load(std::memory_order_relaxed);
+    hashWord(hash, static_cast<uint64_t>(updated));
+    for (size_t i = 0; i < kMaxValues; ++i) {
+        values[i] = slot.values[i].load(std::memory_order_relaxed);
+        hashWord(hash, values[i]);
+    }
+    uint64_t checksum = slot.checksum.load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.generation.load(std::memory_order_relaxed) == generation && checksum == hash;
+}
+
+void FTPStatisticsFile::publish(const Values& values) {
+    if (!header_ || read_only_) {
+        return;
+    }
+
+    // Overwrite the older slot; the newer one stays readable meanwhile
+    uint64_t generation = generation_ + 1;
+    Slot& slot = slots_[generation & 1];
+    slot.generation.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    int64_t updated = unixNow();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hashWord(hash, generation);
+    hashWord(hash, static_cast<uint64_t>(updated));
+    slot.updated.store(updated, std::memory_order_relaxed);
+    for (size_t i = 0; i < kMaxValues; ++i) {
+        slot.values[i].store(values[i], std::memory_order_relaxed);
+        hashWord(hash, values[i]);
+    }
+    slot.checksum.store(hash, std::memory_order_relaxed);
+    slot.generation.store(generation, std::memory_order_release);
+
+    generation_ = generation;
+}
+
+bool FTPStatisticsFile::sync(bool wait) {
+    if (!header_ || read_only_) {
+        return false;
+    }
+    return msync(header_, mapped_size_, wait ? MS_SYNC : MS_ASYNC) == 0;
+}
+
+bool FTPStatisticsFile::fail(const std::string& message) {
+    error_ = message;
+    return false;
+}
+
+} // namespace ssftpd
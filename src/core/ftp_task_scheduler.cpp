@@ -0,0 +1,311 @@
+#include "ssftpd/ftp_task_scheduler.hpp"
+#include "ssftpd/logger.hpp"
+#include "ssftpd/ftp_loop_monitor.hpp"
+#include "ssftpd/ftp_tracer.hpp"
+#include <algorithm>
+
+namespace ssftpd {
+
+namespace {
+
+// Identifies the worker the current thread belongs to, so tasks spawned by
+// a task land on the local deque instead of the injection queue
+thread_local const void* current_scheduler = nullptr;
+thread_local size_t current_worker = 0;
+
+const char* const kTaskSpanNames[] = {"session_task", "filesystem_task", "hashing_task"};
+
+// A worker that never runs dry still reports an iteration this often
+constexpr size_t kMaxIterationBatch = 64;
+
+uint64_t nextRandom(uint64_t& state) {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+} // namespace
+
+FTPTaskScheduler::FTPTaskScheduler(std::shared_ptr<FTPServerConfig> config,
+                                   std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , running_(false)
+    , worker_count_(4)
+    , sleeping_(0)
+    , pending_(0)
+    , submitted_(0)
+    , dropped_(0)
+{
+    if (config_ && config_->thread_pool_size > 0) {
+        worker_count_ = config_->thread_pool_size;
+    }
+
+    for (size_t i = 0; i < kTaskClassCount; ++i) {
+        executed_by_class_[i] = 0;
+        in_flight_by_class_[i] = 0;
+    }
+}
+
+FTPTaskScheduler::~FTPTaskScheduler() {
+    stop();
+
+    // A submit racing stop() can enqueue after the final drain
+    drain();
+}
+
+void FTPTaskScheduler::setLoopMonitor(std::shared_ptr<FTPLoopMonitor> monitor) {
+    if (running_ || !monitor) {
+        return;
+    }
+
+    loop_monitor_ = monitor;
+    reactor_ids_.clear();
+    for (size_t i = 0; i < worker_count_; ++i) {
+        reactor_ids_.push_back(loop_monitor_->addReactor("worker-" + std::to_string(i)));
+    }
+}
+
+bool FTPTaskScheduler::start() {
+    if (running_) {
+        return true;
+    }
+
+    workers_.clear();
+    for (size_t i = 0; i < worker_count_; ++i) {
+        workers_.push_back(std::make_unique<Worker>());
+        workers_.back()->rng_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+
+    running_ = true;
+
+    for (size_t i = 0; i < worker_count_; ++i) {
+        workers_[i]->thread = std::thread(&FTPTaskScheduler::workerLoop, this, i);
+    }
+
+    logger_->info("Task scheduler started with " + std::to_string(worker_count_) + " workers");
+    return true;
+}
+
+void FTPTaskScheduler::stop() {
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_condition_.notify_all();
+    }
+
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+
+    size_t dropped = drain();
+    if (dropped > 0) {
+        logger_->warn("Task scheduler dropped " + std::to_string(dropped) + " queued tasks at stop");
+    }
+
+    logger_->info("Task scheduler stopped");
+}
+
+bool FTPTaskScheduler::submit(Task task, TaskClass task_class) {
+    if (!running_ || !task) {
+        return false;
+    }
+
+    Job* job = new Job{std::move(task), task_class};
+    submitted_++;
+    in_flight_by_class_[static_cast<size_t>(task_class)]++;
+
+    if (current_scheduler == this) {
+        // Spawned by one of our tasks: keep it local, others can steal it
+        workers_[current_worker]->deque.push(job);
+    } else {
+        std::lock_guard<std::mutex> lock(injection_mutex_);
+        injection_queue_.push_back(job);
+    }
+
+    // Publish the job before checking for sleepers; a worker going to sleep
+    // checks pending_ after announcing itself, so one side always sees the other
+    pending_++;
+    if (sleeping_.load() > 0) {
+        wakeWorker();
+    }
+
+    return true;
+}
+
+void FTPTaskScheduler::wakeWorker() {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    idle_condition_.notify_one();
+}
+
+void FTPTaskScheduler::workerLoop(size_t index) {
+    current_scheduler = this;
+    current_worker = index;
+
+    Worker& worker = *workers_[index];
+
+    // An iteration runs from wake-up until the worker finds no more work
+    FTPLoopMonitor* monitor = loop_monitor_.get();
+    size_t reactor = monitor ? reactor_ids_[index] : 0;
+    size_t batch = 0;
+    std::chrono::steady_clock::time_point iteration_start;
+    if (monitor) {
+        monitor->attachThread(reactor);
+    }
+
+    while (running_) {
+        Job* job = findWork(worker, index);
+        if (job && monitor && batch++ == 0) {
+            iteration_start = std::chrono::steady_clock::now();
+        }
+        if (job) {
+            run(worker, job);
+            if (batch < kMaxIterationBatch) {
+                continue;
+            }
+        }
+
+        if (monitor && batch > 0) {
+            monitor->recordIteration(reactor, std::chrono::steady_clock::now() - iteration_start, batch);
+            monitor->setQueueDepth(reactor, worker.deque.size());
+            batch = 0;
+        }
+        if (job) {
+            continue;
+        }
+
+        // Nothing anywhere: sleep until a submit announces new work
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        sleeping_++;
+        idle_condition_.wait(lock, [this] { return !running_ || pending_.load() > 0; });
+        sleeping_--;
+    }
+
+    current_scheduler = nullptr;
+    FTPLoopMonitor::detachThread();
+}
+
+FTPTaskScheduler::Job* FTPTaskScheduler::findWork(Worker& worker, size_t index) {
+    Job* job = nullptr;
+
+    // Own deque first (most recent, cache-warm)
+    if (worker.deque.pop(job)) {
+        return job;
+    }
+
+    // Then work from outside the pool
+    job = popInjected();
+    if (job) {
+        worker.injected++;
+        return job;
+    }
+
+    // Then steal from a random victim, visiting every other worker once
+    if (worker_count_ > 1) {
+        size_t start = nextRandom(worker.rng_state) % worker_count_;
+        for (size_t i = 0; i < worker_count_; ++i) {
+            size_t victim = (start + i) % worker_count_;
+            if (victim != index && workers_[victim]->deque.steal(job)) {
+                worker.stolen++;
+                return job;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+FTPTaskScheduler::Job* FTPTaskScheduler::popInjected() {
+    std::lock_guard<std::mutex> lock(injection_mutex_);
+    if (injection_queue_.empty()) {
+        return nullptr;
+    }
+
+    Job* job = injection_queue_.front();
+    injection_queue_.pop_front();
+    return job;
+}
+
+void FTPTaskScheduler::run(Worker& worker, Job* job) {
+    pending_--;
+
+    // Session tasks trace with command dispatch; the rest are disk and CPU jobs
+    FTPTraceSpan span(job->task_class == TaskClass::SESSION ? FTPTracer::COMMAND : FTPTracer::FILESYSTEM,
+                      kTaskSpanNames[static_cast<size_t>(job->task_class)]);
+    FTPLoopMonitor::HandlerScope handler(kTaskSpanNames[static_cast<size_t>(job->task_class)]);
+
+    try {
+        job->task();
+    } catch (const std::exception& e) {
+        logger_->error("Scheduled task failed: " + std::string(e.what()));
+    } catch (...) {
+        logger_->error("Scheduled task failed with unknown exception");
+    }
+
+    worker.executed++;
+    executed_by_class_[static_cast<size_t>(job->task_class)]++;
+    in_flight_by_class_[static_cast<size_t>(job->task_class)]--;
+    delete job;
+}
+
+size_t FTPTaskScheduler::drain() {
+    size_t dropped = 0;
+    Job* job = nullptr;
+
+    // Workers have exited, so stealing from their deques is safe here
+    for (auto& worker : workers_) {
+        while (worker->deque.steal(job)) {
+            in_flight_by_class_[static_cast<size_t>(job->task_class)]--;
+            delete job;
+            dropped++;
+        }
+    }
+
+    while ((job = popInjected()) != nullptr) {
+        in_flight_by_class_[static_cast<size_t>(job->task_class)]--;
+        delete job;
+        dropped++;
+    }
+
+    pending_ -= static_cast<int64_t>(dropped);
+    dropped_ += dropped;
+    return dropped;
+}
+
+size_t FTPTaskScheduler::getQueuedCount() const {
+    return static_cast<size_t>(std::max<int64_t>(0, pending_.load()));
+}
+
+size_t FTPTaskScheduler::getInFlight(TaskClass task_class) const {
+    return static_cast<size_t>(std::max<int64_t>(0, in_flight_by_class_[static_cast<size_t>(task_class)].load()));
+}
+
+FTPTaskScheduler::Stats FTPTaskScheduler::getStats() const {
+    Stats stats{};
+    stats.workers = worker_count_;
+    stats.queued = getQueuedCount();
+    stats.submitted = submitted_.load();
+    stats.dropped = dropped_.load();
+
+    for (const auto& worker : workers_) {
+        stats.executed += worker->executed.load();
+        stats.stolen += worker->stolen.load();
+        stats.injected += worker->injected.load();
+    }
+
+    for (size_t i = 0; i < kTaskClassCount; ++i) {
+        stats.executed_by_class[i] = executed_by_class_[i].load();
+    }
+
+    return stats;
+}
+
+} // namespace ssftpd
@@ -0,0 +1,148 @@
+#include "ssftpd/ftp_tls_context.hpp"
+#include "ssftpd/logger.hpp"
+
+#ifdef ENABLE_SSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+namespace ssftpd {
+
+namespace {
+
+// Maps the 0x0301..0x0304 style values in SSLConfig to OpenSSL versions
+int toOpenSSLVersion(int version) {
+    switch (version) {
+        case 0x0301: return TLS1_VERSION;
+        case 0x0302: return TLS1_1_VERSION;
+        case 0x0303: return TLS1_2_VERSION;
+        case 0x0304: return TLS1_3_VERSION;
+        default: return 0;
+    }
+}
+
+// Shared by control and data channels so sessions are resumable across both
+const unsigned char kSessionIdContext[] = "ssftpd";
+
+} // namespace
+
+FTPTLSContext::FTPTLSContext(std::shared_ptr<FTPServerConfig> config,
+                             std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , ctx_(nullptr)
+    , session_cache_(std::make_shared<FTPTLSSessionCache>(config, logger))
+{
+}
+
+FTPTLSContext::~FTPTLSContext() {
+    if (ctx_) {
+        SSL_CTX_free(ctx_);
+        ctx_ = nullptr;
+    }
+}
+
+bool FTPTLSContext::initialize() {
+    if (ctx_) {
+        return true;
+    }
+
+    ctx_ = SSL_CTX_new(TLS_server_method());
+    if (!ctx_) {
+        logger_->error("Failed to create TLS context: " + getOpenSSLError());
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx_, toOpenSSLVersion(config_->ssl.min_tls_version));
+    SSL_CTX_set_max_proto_version(ctx_, toOpenSSLVersion(config_->ssl.max_tls_version));
+    SSL_CTX_set_options(ctx_, SSL_OP_NO_COMPRESSION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+    if (!config_->ssl.cipher_suite.empty()) {
+        // Accept either TLS 1.3 suite names or a TLS 1.2 cipher list
+        if (SSL_CTX_set_ciphersuites(ctx_, config_->ssl.cipher_suite.c_str()) != 1 &&
+            SSL_CTX_set_cipher_list(ctx_, config_->ssl.cipher_suite.c_str()) != 1) {
+            logger_->warn("Ignoring invalid cipher suite: " + config_->ssl.cipher_suite);
+        }
+        ERR_clear_error();
+    }
+
+    if (SSL_CTX_use_certificate_chain_file(ctx_, config_->ssl.certificate_file.c_str()) != 1) {
+        logger_->error("Failed to load TLS certificate " + config_->ssl.certificate_file +
+                       ": " + getOpenSSLError());
+        return false;
+    }
+
+    if (SSL_CTX_use_PrivateKey_file(ctx_, config_->ssl.private_key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx_) != 1) {
+        logger_->error("Failed to load TLS private key " + config_->ssl.private_key_file +
+                       ": " + getOpenSSLError());
+        return false;
+    }
+
+    if (!config_->ssl.ca_certificate_file.empty() &&
+        SSL_CTX_load_verify_locations(ctx_, config_->ssl.ca_certificate_file.c_str(), nullptr) != 1) {
+        logger_->error("Failed to load CA certificate " + config_->ssl.ca_certificate_file +
+                       ": " + getOpenSSLError());
+        return false;
+    }
+
+    if (config_->ssl.require_client_cert) {
+        SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, nullptr);
+    } else if (config_->ssl.verify_peer) {
+        SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+    }
+
+    SSL_CTX_set_session_id_context(ctx_, kSessionIdContext, sizeof(kSessionIdContext) - 1);
+
+    if (!session_cache_->attach(ctx_)) {
+        return false;
+    }
+
+    logger_->info("TLS context initialized");
+    return true;
+}
+
+SSL* FTPTLSContext::createConnection(int socket) const {
+    if (!ctx_) {
+        return nullptr;
+    }
+
+    SSL* ssl = SSL_new(ctx_);
+    if (!ssl) {
+        logger_->error("Failed to create TLS connection: " + getOpenSSLError());
+        return nullptr;
+    }
+
+    if (SSL_set_fd(ssl, socket) != 1) {
+        logger_->error("Failed to bind TLS connection to socket: " + getOpenSSLError());
+        SSL_free(ssl);
+        return nullptr;
+    }
+
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+bool FTPTLSContext::verifyDataChannel(SSL* control, SSL* data) {
+    return session_cache_->verifyDataChannel(control, data);
+}
+
+void FTPTLSContext::tick() {
+    session_cache_->tick();
+}
+
+std::string FTPTLSContext::getOpenSSLError() const {
+    unsigned long code = ERR_get_error();
+    if (code == 0) {
+        return "unknown error";
+    }
+
+    char buffer[256];
+    ERR_error_string_n(code, buffer, sizeof(buffer));
+    ERR_clear_error();
+    return buffer;
+}
+
+} // namespace ssftpd
+
+#endif // ENABLE_SSL
@@ -0,0 +1,361 @@
+#include "ssftpd/ftp_tls_handshake_pool.hpp"
+#include "ssftpd/logger.hpp"
+#include "ssftpd/ftp_tracer.hpp"
+
+#ifdef ENABLE_SSL
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <algorithm>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+namespace ssftpd {
+
+FTPTLSHandshakePool::FTPTLSHandshakePool(std::shared_ptr<FTPServerConfig> config,
+                                         std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , running_(false)
+    , worker_count_(2)
+    , max_in_flight_(256)
+    , handshake_timeout_(std::chrono::seconds(10))
+    , wake_pipe_{-1, -1}
+    , in_flight_(0)
+    , parked_(0)
+    , completed_(0)
+    , failed_(0)
+    , timed_out_(0)
+    , cancelled_(0)
+    , rejected_(0)
+    , latency_count_(0)
+    , latency_total_us_(0)
+    , latency_max_us_(0)
+{
+    if (config_) {
+        worker_count_ = std::max<size_t>(1, config_->ssl.handshake_threads);
+        max_in_flight_ = std::max<size_t>(1, config_->ssl.handshake_queue_size);
+        handshake_timeout_ = config_->ssl.handshake_timeout;
+    }
+}
+
+FTPTLSHandshakePool::~FTPTLSHandshakePool() {
+    stop();
+}
+
+bool FTPTLSHandshakePool::start() {
+    if (running_) {
+        return true;
+    }
+
+    if (pipe(wake_pipe_) != 0) {
+        logger_->error("Failed to create handshake pool wake pipe: " + std::string(strerror(errno)));
+        return false;
+    }
+    for (int fd : wake_pipe_) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    running_ = true;
+
+    workers_.reserve(worker_count_);
+    for (size_t i = 0; i < worker_count_; ++i) {
+        workers_.emplace_back(&FTPTLSHandshakePool::workerLoop, this);
+    }
+    poller_ = std::thread(&FTPTLSHandshakePool::pollerLoop, this);
+
+    logger_->info("TLS handshake pool started with " + std::to_string(worker_count_) +
+                  " workers, " + std::to_string(max_in_flight_) + " handshakes max");
+    return true;
+}
+
+void FTPTLSHandshakePool::stop() {
+    if (!running_) {
+        return;
+    }
+
+    running_ = false;
+    queue_condition_.notify_all();
+    wakePoller();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers_.clear();
+
+    if (poller_.joinable()) {
+        poller_.join();
+    }
+
+    // Anything still queued never got a worker, and a worker may have
+    // parked a job after the poller's final drain
+    std::deque<std::unique_ptr<Job>> remaining;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        remaining.swap(run_queue_);
+    }
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        for (auto& job : incoming_parked_) {
+            parked_--;
+            remaining.push_back(std::move(job));
+        }
+        incoming_parked_.clear();
+    }
+    for (auto& job : remaining) {
+        finish(std::move(job), Result::CANCELLED);
+    }
+
+    for (int& fd : wake_pipe_) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    logger_->info("TLS handshake pool stopped");
+}
+
+bool FTPTLSHandshakePool::submit(SSL* ssl, int socket, Completion done) {
+    if (!running_ || !ssl || socket < 0) {
+        return false;
+    }
+
+    // A blocking socket would hold a crypto worker for a whole round trip,
+    // or for as long as a stalled client likes; steps must only ever park
+    int flags = fcntl(socket, F_GETFL, 0);
+    if (flags < 0 || ((flags & O_NONBLOCK) == 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) != 0)) {
+        logger_->error("Cannot make TLS handshake socket non-blocking: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // Admission is bounded on all unfinished handshakes, not just the run
+    // queue, so parked slow clients count against the budget too
+    size_t current = in_flight_.load();
+    do {
+        if (current >= max_in_flight_) {
+            rejected_++;
+            return false;
+        }
+    } while (!in_flight_.compare_exchange_weak(current, current + 1));
+
+    auto now = std::chrono::steady_clock::now();
+    auto job = std::make_unique<Job>();
+    job->ssl = ssl;
+    job->socket = socket;
+    job->done = std::move(done);
+    job->submitted = now;
+    job->deadline = now + handshake_timeout_;
+    job->wait_events = 0;
+
+    enqueue(std::move(job));
+    return true;
+}
+
+void FTPTLSHandshakePool::enqueue(std::unique_ptr<Job> job) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        run_queue_.push_back(std::move(job));
+    }
+    queue_condition_.notify_one();
+}
+
+void FTPTLSHandshakePool::workerLoop() {
+    while (true) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_condition_.wait(lock, [this] { return !running_ || !run_queue_.empty(); });
+
+            if (!running_) {
+                break;
+            }
+
+            job = std::move(run_queue_.front());
+            run_queue_.pop_front();
+        }
+
+        runStep(std::move(job));
+    }
+}
+
+void FTPTLSHandshakePool::runStep(std::unique_ptr<Job> job) {
+    if (std::chrono::steady_clock::now() >= job->deadline) {
+        finish(std::move(job), Result::TIMED_OUT);
+        return;
+    }
+
+    FTPTraceSpan span(FTPTracer::TLS, "handshake_step");
+    ERR_clear_error();
+    int rc = SSL_do_handshake(job->ssl);
+    if (rc == 1) {
+        finish(std::move(job), Result::COMPLETED);
+        return;
+    }
+
+    switch (SSL_get_error(job->ssl, rc)) {
+        case SSL_ERROR_WANT_READ:
+            park(std::move(job), POLLIN);
+            break;
+        case SSL_ERROR_WANT_WRITE:
+            park(std::move(job), POLLOUT);
+            break;
+        default:
+            ERR_clear_error();
+            finish(std::move(job), Result::FAILED);
+            break;
+    }
+}
+
+void FTPTLSHandshakePool::park(std::unique_ptr<Job> job, short events) {
+    job->wait_events = events;
+    parked_++;
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        incoming_parked_.push_back(std::move(job));
+    }
+    wakePoller();
+}
+
+void FTPTLSHandshakePool::wakePoller() {
+    if (wake_pipe_[1] != -1) {
+        char byte = 1;
+        ssize_t ignored = write(wake_pipe_[1], &byte, 1);
+        (void)ignored; // A full pipe already guarantees a wakeup
+    }
+}
+
+void FTPTLSHandshakePool::pollerLoop() {
+    std::vector<std::unique_ptr<Job>> parked;
+    std::vector<struct pollfd> fds;
+
+    while (running_) {
+        {
+            std::lock_guard<std::mutex> lock(park_mutex_);
+            for (auto& job : incoming_parked_) {
+                parked.push_back(std::move(job));
+            }
+            incoming_parked_.clear();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto timeout = std::chrono::milliseconds(100);
+        for (const auto& job : parked) {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(job->deadline - now);
+            timeout = std::max(std::chrono::milliseconds(0), std::min(timeout, remaining));
+        }
+
+        fds.clear();
+        fds.push_back({wake_pipe_[0], POLLIN, 0});
+        for (const auto& job : parked) {
+            fds.push_back({job->socket, job->wait_events, 0});
+        }
+
+        int ready = poll(fds.data(), fds.size(), static_cast<int>(timeout.count()));
+        if (ready < 0 && errno != EINTR) {
+            logger_->error("Handshake pool poll failed: " + std::string(strerror(errno)));
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wake_pipe_[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+
+        now = std::chrono::steady_clock::now();
+        std::vector<std::unique_ptr<Job>> still_parked;
+        still_parked.reserve(parked.size());
+
+        for (size_t i = 0; i < parked.size(); ++i) {
+            auto& job = parked[i];
+            if (fds[i + 1].revents != 0) {
+                // Readable, writable or errored: the next handshake step
+                // will make progress or report the failure
+                parked_--;
+                enqueue(std::move(job));
+            } else if (now >= job->deadline) {
+                parked_--;
+                finish(std::move(job), Result::TIMED_OUT);
+            } else {
+                still_parked.push_back(std::move(job));
+            }
+        }
+        parked.swap(still_parked);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(park_mutex_);
+        for (auto& job : incoming_parked_) {
+            parked.push_back(std::move(job));
+        }
+        incoming_parked_.clear();
+    }
+    for (auto& job : parked) {
+        parked_--;
+        finish(std::move(job), Result::CANCELLED);
+    }
+}
+
+void FTPTLSHandshakePool::finish(std::unique_ptr<Job> job, Result result) {
+    auto elapsed = std::chrono::steady_clock::now() - job->submitted;
+    uint64_t elapsed_us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+    switch (result) {
+        case Result::COMPLETED:
+            completed_++;
+            latency_count_++;
+            latency_total_us_ += elapsed_us;
+            {
+                uint64_t current_max = latency_max_us_.load();
+                while (elapsed_us > current_max &&
+                       !latency_max_us_.compare_exchange_weak(current_max, elapsed_us)) {
+                    // Loop until we successfully update the max value
+                }
+            }
+            break;
+        case Result::TIMED_OUT:
+            timed_out_++;
+            break;
+        case Result::FAILED:
+            failed_++;
+            break;
+        case Result::CANCELLED:
+            cancelled_++;
+            break;
+    }
+
+    in_flight_--;
+
+    if (job->done) {
+        job->done(job->ssl, result);
+    }
+}
+
+FTPTLSHandshakePool::Stats FTPTLSHandshakePool::getStats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stats.queue_depth = run_queue_.size();
+    }
+    stats.parked = parked_.load();
+    stats.in_flight = in_flight_.load();
+    stats.completed = completed_.load();
+    stats.failed = failed_.load();
+    stats.timed_out = timed_out_.load();
+    stats.cancelled = cancelled_.load();
+    stats.rejected = rejected_.load();
+    stats.latency_count = latency_count_.load();
+    stats.latency_total_us = latency_total_us_.load();
+    stats.latency_max_us = latency_max_us_.load();
+    return stats;
+}
+
+} // namespace ssftpd
+
+#endif // ENABLE_SSL
@@ -0,0 +1,589 @@
+#include "ssftpd/ftp_tls_session_cache.hpp"
+#include "ssftpd/logger.hpp"
+
+#ifdef ENABLE_SSL
+
+#include <openssl/ssl.h>
+#include <openssl/rand.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace ssftpd {
+
+// Bridges OpenSSL's ticket key callback (whose signature changed in 3.0) to
+// FTPTLSSessionCache::selectTicketKey.
+struct TicketKeyCallbacks {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int callback(SSL* ssl, unsigned char key_name[16], unsigned char* iv,
+                        EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* mac_ctx, int enc) {
+        auto* cache = FTPTLSSessionCache::fromContext(SSL_get_SSL_CTX(ssl));
+        if (!cache) {
+            return -1;
+        }
+
+        FTPTLSSessionCache::TicketKey key;
+        int result = cache->selectTicketKey(key_name, key, enc == 1);
+        if (result <= 0) {
+            return result;
+        }
+
+        if (enc == 1 && RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            OPENSSL_cleanse(&key, sizeof(key));
+            return -1;
+        }
+
+        OSSL_PARAM params[3];
+        params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+                                                      key.hmac_key, sizeof(key.hmac_key));
+        params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                                     const_cast<char*>("SHA256"), 0);
+        params[2] = OSSL_PARAM_construct_end();
+
+        bool ok = EVP_MAC_CTX_set_params(mac_ctx, params) == 1;
+        if (ok) {
+            ok = enc == 1
+                ? EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1
+                : EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1;
+        }
+
+        OPENSSL_cleanse(&key, sizeof(key));
+        return ok ? result : -1;
+    }
+#else
+    static int callback(SSL* ssl, unsigned char key_name[16], unsigned char* iv,
+                        EVP_CIPHER_CTX* cipher_ctx, HMAC_CTX* hmac_ctx, int enc) {
+        auto* cache = FTPTLSSessionCache::fromContext(SSL_get_SSL_CTX(ssl));
+        if (!cache) {
+            return -1;
+        }
+
+        FTPTLSSessionCache::TicketKey key;
+        int result = cache->selectTicketKey(key_name, key, enc == 1);
+        if (result <= 0) {
+            return result;
+        }
+
+        if (enc == 1 && RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1) {
+            OPENSSL_cleanse(&key, sizeof(key));
+            return -1;
+        }
+
+        bool ok = HMAC_Init_ex(hmac_ctx, key.hmac_key, sizeof(key.hmac_key),
+                               EVP_sha256(), nullptr) == 1;
+        if (ok) {
+            ok = enc == 1
+                ? EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1
+                : EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) == 1;
+        }
+
+        OPENSSL_cleanse(&key, sizeof(key));
+        return ok ? result : -1;
+    }
+#endif
+};
+
+FTPTLSSessionCache::FTPTLSSessionCache(std::shared_ptr<FTPServerConfig> config,
+                                       std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , max_entries_per_shard_(1)
+    , session_timeout_(std::chrono::seconds(3600))
+    , has_previous_ticket_key_(false)
+    , ticket_rotation_interval_(std::chrono::seconds(3600))
+    , last_rotation_(std::chrono::steady_clock::now())
+    , last_tick_(std::chrono::steady_clock::now())
+    , require_reuse_(true)
+    , hits_(0)
+    , misses_(0)
+    , stores_(0)
+    , evictions_(0)
+    , expirations_(0)
+    , ticket_rotations_(0)
+    , data_channel_rejections_(0)
+{
+    size_t cache_size = 20480;
+    if (config_) {
+        cache_size = config_->ssl.session_cache_size;
+        session_timeout_ = config_->ssl.session_timeout;
+        ticket_rotation_interval_ = config_->ssl.session_ticket_rotation;
+        require_reuse_ = config_->ssl.require_session_reuse;
+    }
+
+    max_entries_per_shard_ = std::max<size_t>(1, cache_size / kShardCount);
+
+    std::memset(&current_ticket_key_, 0, sizeof(current_ticket_key_));
+    std::memset(&previous_ticket_key_, 0, sizeof(previous_ticket_key_));
+    rotateTicketKeys();
+}
+
+FTPTLSSessionCache::~FTPTLSSessionCache() {
+    clear();
+    OPENSSL_cleanse(&current_ticket_key_, sizeof(current_ticket_key_));
+    OPENSSL_cleanse(&previous_ticket_key_, sizeof(previous_ticket_key_));
+}
+
+int FTPTLSSessionCache::contextIndex() {
+    static const int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+int FTPTLSSessionCache::bindingIndex() {
+    static const int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr,
+        [](void*, void* binding, CRYPTO_EX_DATA*, int, long, void*) {
+            delete static_cast<SessionBinding*>(binding);
+        });
+    return index;
+}
+
+FTPTLSSessionCache* FTPTLSSessionCache::fromContext(SSL_CTX* ctx) {
+    if (!ctx) {
+        return nullptr;
+    }
+    return static_cast<FTPTLSSessionCache*>(SSL_CTX_get_ex_data(ctx, contextIndex()));
+}
+
+bool FTPTLSSessionCache::attach(SSL_CTX* ctx) {
+    if (!ctx) {
+        logger_->error("Cannot attach TLS session cache to null context");
+        return false;
+    }
+
+    if (SSL_CTX_set_ex_data(ctx, contextIndex(), this) != 1) {
+        logger_->error("Failed to register TLS session cache on context");
+        return false;
+    }
+
+    // Every lookup goes through the shared cache instead of OpenSSL's
+    // per-context internal store, so all reactors see the same sessions.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_set_timeout(ctx, static_cast<long>(session_timeout_.count()));
+    SSL_CTX_sess_set_new_cb(ctx, &FTPTLSSessionCache::newSessionCallback);
+    SSL_CTX_sess_set_get_cb(ctx, &FTPTLSSessionCache::getSessionCallback);
+    SSL_CTX_sess_set_remove_cb(ctx, &FTPTLSSessionCache::removeSessionCallback);
+    SSL_CTX_set_session_ticket_cb(ctx, &FTPTLSSessionCache::generateTicketCallback, nullptr, nullptr);
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &TicketKeyCallbacks::callback) != 1) {
+#else
+    if (SSL_CTX_set_tlsext_ticket_key_cb(ctx, &TicketKeyCallbacks::callback) != 1) {
+#endif
+        logger_->error("Failed to install TLS session ticket key callback");
+        return false;
+    }
+
+    logger_->info("TLS session cache attached (" + std::to_string(max_entries_per_shard_ * kShardCount) +
+                  " sessions, " + std::to_string(session_timeout_.count()) + "s timeout)");
+    return true;
+}
+
+int FTPTLSSessionCache::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+    auto* cache = fromContext(SSL_get_SSL_CTX(ssl));
+    if (!cache) {
+        return 0;
+    }
+
+    // Returning 1 tells OpenSSL we keep the reference it handed us
+    return cache->storeSession(session) ? 1 : 0;
+}
+
+SSL_SESSION* FTPTLSSessionCache::getSessionCallback(SSL* ssl, const unsigned char* id,
+                                                    int id_length, int* copy) {
+    auto* cache = fromContext(SSL_get_SSL_CTX(ssl));
+    if (!cache || id_length <= 0) {
+        return nullptr;
+    }
+
+    // lookupSession hands back a session with a reference already taken
+    // for OpenSSL, so it must not add another one
+    *copy = 0;
+    return cache->lookupSession(id, static_cast<size_t>(id_length));
+}
+
+void FTPTLSSessionCache::removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session) {
+    auto* cache = fromContext(ctx);
+    if (!cache || !session) {
+        return;
+    }
+
+    unsigned int id_length = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+    cache->removeSession(id, id_length);
+}
+
+int FTPTLSSessionCache::generateTicketCallback(SSL* ssl, void* arg) {
+    (void)arg;
+    SSL_SESSION* session = SSL_get_session(ssl);
+    if (!session) {
+        return 0;
+    }
+
+    auto* binding = static_cast<SessionBinding*>(SSL_get_ex_data(ssl, bindingIndex()));
+    if (!binding) {
+        binding = new SessionBinding;
+
+        // A resumed connection keeps the binding of the ticket it came with,
+        // so the tickets it issues stay tied to the same control session
+        void* appdata = nullptr;
+        size_t appdata_length = 0;
+        bool inherited = SSL_session_reused(ssl) &&
+                         SSL_SESSION_get0_ticket_appdata(session, &appdata, &appdata_length) == 1 &&
+                         appdata_length == sizeof(binding->nonce);
+        if (inherited) {
+            std::memcpy(binding->nonce, appdata, sizeof(binding->nonce));
+        } else if (RAND_bytes(binding->nonce, sizeof(binding->nonce)) != 1) {
+            delete binding;
+            return 0;
+        }
+
+        if (SSL_set_ex_data(ssl, bindingIndex(), binding) != 1) {
+            delete binding;
+            return 0;
+        }
+    }
+
+    return SSL_SESSION_set1_ticket_appdata(session, binding->nonce, sizeof(binding->nonce));
+}
+
+FTPTLSSessionCache::Shard& FTPTLSSessionCache::shardFor(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) & (kShardCount - 1)];
+}
+
+bool FTPTLSSessionCache::storeSession(SSL_SESSION* session) {
+    unsigned int id_length = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+    if (id_length == 0 || id_length > kMaxSessionIdLength) {
+        return false;
+    }
+
+    std::string key(reinterpret_cast<const char*>(id), id_length);
+    auto expires = std::chrono::steady_clock::now() + session_timeout_;
+    SSL_SESSION* evicted = nullptr;
+    SSL_SESSION* replaced = nullptr;
+
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(key);
+        if (it != shard.sessions.end()) {
+            replaced = it->second.session;
+            it->second.session = session;
+            it->second.expires = expires;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+        } else {
+            if (shard.sessions.size() >= max_entries_per_shard_ && !shard.lru.empty()) {
+                auto victim = shard.sessions.find(shard.lru.back());
+                evicted = victim->second.session;
+                shard.sessions.erase(victim);
+                shard.lru.pop_back();
+            }
+
+            shard.lru.push_front(key);
+            shard.sessions.emplace(key, Entry{session, expires, shard.lru.begin()});
+        }
+    }
+
+    // Free outside the shard lock; SSL_SESSION_free may take OpenSSL locks
+    if (replaced) {
+        SSL_SESSION_free(replaced);
+    }
+    if (evicted) {
+        SSL_SESSION_free(evicted);
+        evictions_++;
+    }
+
+    stores_++;
+    return true;
+}
+
+SSL_SESSION* FTPTLSSessionCache::lookupSession(const unsigned char* id, size_t id_length) {
+    std::string key(reinterpret_cast<const char*>(id), id_length);
+    auto now = std::chrono::steady_clock::now();
+    SSL_SESSION* expired = nullptr;
+    SSL_SESSION* found = nullptr;
+
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(key);
+        if (it != shard.sessions.end()) {
+            if (it->second.expires <= now) {
+                expired = it->second.session;
+                shard.lru.erase(it->second.lru_position);
+                shard.sessions.erase(it);
+            } else {
+                found = it->second.session;
+                // Take OpenSSL's reference while still under the lock so a
+                // concurrent eviction cannot free the session first
+                SSL_SESSION_up_ref(found);
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+            }
+        }
+    }
+
+    if (expired) {
+        SSL_SESSION_free(expired);
+        expirations_++;
+    }
+
+    if (!found) {
+        misses_++;
+        return nullptr;
+    }
+
+    hits_++;
+    return found;
+}
+
+void FTPTLSSessionCache::removeSession(const unsigned char* id, size_t id_length) {
+    if (!id || id_length == 0) {
+        return;
+    }
+
+    std::string key(reinterpret_cast<const char*>(id), id_length);
+    SSL_SESSION* removed = nullptr;
+
+    {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.sessions.find(key);
+        if (it != shard.sessions.end()) {
+            removed = it->second.session;
+            shard.lru.erase(it->second.lru_position);
+            shard.sessions.erase(it);
+        }
+    }
+
+    if (removed) {
+        SSL_SESSION_free(removed);
+    }
+}
+
+void FTPTLSSessionCache::tick() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_tick_ < std::chrono::seconds(1)) {
+        return;
+    }
+    last_tick_ = now;
+
+    if (ticket_rotation_interval_.count() > 0 && now - last_rotation_ >= ticket_rotation_interval_) {
+        rotateTicketKeys();
+    }
+
+    expireSessions();
+}
+
+void FTPTLSSessionCache::expireSessions() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<SSL_SESSION*> expired;
+
+    for (auto& shard : shards_) {
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            // Walk from the least recently used end; entries there are the
+            // most likely to have expired
+            auto it = shard.lru.end();
+            while (it != shard.lru.begin()) {
+                --it;
+                auto entry = shard.sessions.find(*it);
+                if (entry->second.expires > now) {
+                    continue;
+                }
+                expired.push_back(entry->second.session);
+                shard.sessions.erase(entry);
+                it = shard.lru.erase(it);
+            }
+        }
+
+        for (auto* session : expired) {
+            SSL_SESSION_free(session);
+        }
+        expirations_ += expired.size();
+        expired.clear();
+    }
+}
+
+bool FTPTLSSessionCache::rotateTicketKeys() {
+    TicketKey key;
+    if (RAND_bytes(key.name, sizeof(key.name)) != 1 ||
+        RAND_bytes(key.aes_key, sizeof(key.aes_key)) != 1 ||
+        RAND_bytes(key.hmac_key, sizeof(key.hmac_key)) != 1) {
+        logger_->error("Failed to generate TLS session ticket key");
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ticket_mutex_);
+        previous_ticket_key_ = current_ticket_key_;
+        has_previous_ticket_key_ = ticket_rotations_.load() > 0;
+        current_ticket_key_ = key;
+        last_rotation_ = std::chrono::steady_clock::now();
+    }
+
+    OPENSSL_cleanse(&key, sizeof(key));
+    ticket_rotations_++;
+    logger_->debug("TLS session ticket key rotated");
+    return true;
+}
+
+int FTPTLSSessionCache::selectTicketKey(unsigned char key_name[16], TicketKey& key, bool encrypt) {
+    std::lock_guard<std::mutex> lock(ticket_mutex_);
+
+    if (encrypt) {
+        std::memcpy(key_name, current_ticket_key_.name, sizeof(current_ticket_key_.name));
+        key = current_ticket_key_;
+        return 1;
+    }
+
+    if (CRYPTO_memcmp(key_name, current_ticket_key_.name, sizeof(current_ticket_key_.name)) == 0) {
+        key = current_ticket_key_;
+        return 1;
+    }
+
+    if (has_previous_ticket_key_ &&
+        CRYPTO_memcmp(key_name, previous_ticket_key_.name, sizeof(previous_ticket_key_.name)) == 0) {
+        key = previous_ticket_key_;
+        return 2; // valid, but re-issue under the current key
+    }
+
+    return 0;
+}
+
+bool FTPTLSSessionCache::verifyDataChannel(SSL* control, SSL* data) {
+    if (!require_reuse_) {
+        return true;
+    }
+
+    if (!control || !data || !SSL_session_reused(data)) {
+        data_channel_rejections_++;
+        logger_->warn("Rejecting TLS data connection that did not resume the control session");
+        return false;
+    }
+
+    // Up to TLS 1.2 a resumed session shares the master secret with the
+    // session it came from. TLS 1.3 derives a fresh secret for every
+    // resumption, so there the ticket carries the nonce of the control
+    // connection that issued it.
+    if (SSL_version(data) >= TLS1_3_VERSION) {
+        auto* binding = static_cast<SessionBinding*>(SSL_get_ex_data(control, bindingIndex()));
+        SSL_SESSION* data_session = SSL_get_session(data);
+        void* appdata = nullptr;
+        size_t appdata_length = 0;
+
+        bool bound = binding && data_session &&
+                     SSL_SESSION_get0_ticket_appdata(data_session, &appdata, &appdata_length) == 1 &&
+                     appdata_length == sizeof(binding->nonce) &&
+                     CRYPTO_memcmp(appdata, binding->nonce, sizeof(binding->nonce)) == 0;
+        if (!bound) {
+            data_channel_rejections_++;
+            logger_->warn("Rejecting TLS data connection resumed from another session's ticket");
+            return false;
+        }
+    } else {
+        SSL_SESSION* control_session = SSL_get_session(control);
+        SSL_SESSION* data_session = SSL_get_session(data);
+        if (!control_session || !data_session) {
+            data_channel_rejections_++;
+            return false;
+        }
+
+        unsigned char control_key[SSL_MAX_MASTER_KEY_LENGTH];
+        unsigned char data_key[SSL_MAX_MASTER_KEY_LENGTH];
+        size_t control_length = SSL_SESSION_get_master_key(control_session, control_key, sizeof(control_key));
+        size_t data_length = SSL_SESSION_get_master_key(data_session, data_key, sizeof(data_key));
+
+        bool same = control_length == data_length && control_length > 0 &&
+                    CRYPTO_memcmp(control_key, data_key, control_length) == 0;
+        OPENSSL_cleanse(control_key, sizeof(control_key));
+        OPENSSL_cleanse(data_key, sizeof(data_key));
+
+        if (!same) {
+            data_channel_rejections_++;
+            logger_->warn("Rejecting TLS data connection resumed from a foreign session");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void FTPTLSSessionCache::clear() {
+    std::vector<SSL_SESSION*> released;
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& pair : shard.sessions) {
+            released.push_back(pair.second.session);
+        }
+        shard.sessions.clear();
+        shard.lru.clear();
+    }
+
+    for (auto* session : released) {
+        SSL_SESSION_free(session);
+    }
+}
+
+size_t FTPTLSSessionCache::trim(size_t keep_percent) {
+    std::vector<SSL_SESSION*> evicted;
+
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size_t keep = shard.sessions.size() * std::min<size_t>(keep_percent, 100) / 100;
+        while (shard.sessions.size() > keep && !shard.lru.empty()) {
+            auto victim = shard.sessions.find(shard.lru.back());
+            evicted.push_back(victim->second.session);
+            shard.sessions.erase(victim);
+            shard.lru.pop_back();
+        }
+    }
+
+    for (auto* session : evicted) {
+        SSL_SESSION_free(session);
+    }
+    evictions_ += evicted.size();
+    return evicted.size();
+}
+
+size_t FTPTLSSessionCache::getMemoryUsage() const {
+    return size() * kEstimatedEntryBytes;
+}
+
+size_t FTPTLSSessionCache::size() const {
+    size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.sessions.size();
+    }
+    return total;
+}
+
+FTPTLSSessionCache::Stats FTPTLSSessionCache::getStats() const {
+    Stats stats;
+    stats.hits = hits_.load();
+    stats.misses = misses_.load();
+    stats.stores = stores_.load();
+    stats.evictions = evictions_.load();
+    stats.expirations = expirations_.load();
+    stats.ticket_rotations = ticket_rotations_.load();
+    stats.data_channel_rejections = data_channel_rejections_.load();
+    stats.entries = size();
+    return stats;
+}
+
+} // namespace ssftpd
+
+#endif // ENABLE_SSL
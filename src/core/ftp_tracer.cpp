@@ -0,0 +1,226 @@
+#include "ssftpd/ftp_tracer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ssftpd {
+
+namespace {
+
+// Fields are atomics so a dump may read a ring while its thread writes;
+// relaxed stores compile to plain moves on the recording path
+struct Event {
+    std::atomic<const char*> name;
+    std::atomic<uint32_t> category;
+    std::atomic<int64_t> start_ns;
+    std::atomic<int64_t> duration_ns;
+    std::atomic<uint64_t> label;
+    std::atomic<uint64_t> value;
+};
+
+struct ThreadRing {
+    ThreadRing()
+        : events(new Event[FTPTracer::kRingSize]())
+        , head(0)
+        , cleared(0)
+        , thread_id(static_cast<uint64_t>(syscall(SYS_gettid)))
+    {
+    }
+
+    std::unique_ptr<Event[]> events;
+    std::atomic<uint64_t> head;      // Spans ever written
+    std::atomic<uint64_t> cleared;   // Spans before this index were cleared
+    uint64_t thread_id;
+};
+
+// Rings outlive their threads so a dump still shows spans of exited workers
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadRing& threadRing() {
+    thread_local std::shared_ptr<ThreadRing> ring = []() {
+        auto created = std::make_shared<ThreadRing>();
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.rings.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+const char* categoryName(uint32_t category) {
+    switch (category) {
+        case FTPTracer::ACCEPT: return "accept";
+        case FTPTracer::COMMAND: return "command";
+        case FTPTracer::FILESYSTEM: return "filesystem";
+        case FTPTracer::TLS: return "tls";
+        case FTPTracer::TRANSFER: return "transfer";
+        default: return "other";
+    }
+}
+
+uint64_t packLabel(const std::string& label) {
+    uint64_t packed = 0;
+    size_t length = std::min<size_t>(label.size(), 8);
+    for (size_t i = 0; i < length; ++i) {
+        packed |= static_cast<uint64_t>(static_cast<unsigned char>(label[i])) << (i * 8);
+    }
+    return packed;
+}
+
+std::string unpackLabel(uint64_t packed) {
+    std::string label;
+    for (; packed != 0; packed >>= 8) {
+        char c = static_cast<char>(packed & 0xff);
+        // Labels come from clients; keep the JSON valid whatever they sent
+        label += (c >= 0x20 && c < 0x7f && c != '"' && c != '\\') ? c : '?';
+    }
+    return label;
+}
+
+void appendFormatted(std::string& out, const char* buffer, size_t capacity, int length) {
+    if (length > 0) {
+        out.append(buffer, std::min(static_cast<size_t>(length), capacity - 1));
+    }
+}
+
+int64_t toNanoseconds(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+std::atomic<uint32_t> FTPTracer::categories_{0};
+
+void FTPTracer::setCategories(uint32_t categories) {
+    categories_.store(categories & ALL, std::memory_order_relaxed);
+}
+
+void FTPTracer::record(Category category, const char* name,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end,
+                       const std::string& label, uint64_t value) {
+    ThreadRing& ring = threadRing();
+    uint64_t index = ring.head.load(std::memory_order_relaxed);
+    Event& event = ring.events[index % kRingSize];
+
+    int64_t start_ns = toNanoseconds(start);
+    event.name.store(name, std::memory_order_relaxed);
+    event.category.store(category, std::memory_order_relaxed);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(toNanoseconds(end) - start_ns, std::memory_order_relaxed);
+    event.label.store(label.empty() ? 0 : packLabel(label), std::memory_order_relaxed);
+    event.value.store(value, std::memory_order_relaxed);
+    ring.head.store(index + 1, std::memory_order_release);
+}
+
+std::string FTPTracer::dump() {
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        Registry& shared = registry();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        rings = shared.rings;
+    }
+
+    struct Copy {
+        const char* name;
+        uint32_t category;
+        int64_t start_ns;
+        int64_t duration_ns;
+        uint64_t label;
+        uint64_t value;
+        uint64_t thread_id;
+    };
+    std::vector<Copy> spans;
+    int64_t origin = INT64_MAX;
+
+    for (const auto& ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = std::max(ring->cleared.load(std::memory_order_relaxed),
+                                  head > kRingSize ? head - kRingSize : 0);
+        size_t begin = spans.size();
+        for (uint64_t index = first; index < head; ++index) {
+            const Event& event = ring->events[index % kRingSize];
+            spans.push_back({event.name.load(std::memory_order_relaxed),
+                             event.category.load(std::memory_order_relaxed),
+                             event.start_ns.load(std::memory_order_relaxed),
+                             event.duration_ns.load(std::memory_order_relaxed),
+                             event.label.load(std::memory_order_relaxed),
+                             event.value.load(std::memory_order_relaxed),
+                             ring->thread_id});
+        }
+
+        // Drop spans the owner overwrote while they were being copied
+        uint64_t now_head = ring->head.load(std::memory_order_acquire);
+        uint64_t valid_from = now_head + 1 > kRingSize ? now_head + 1 - kRingSize : 0;
+        if (valid_from > first) {
+            size_t stale = static_cast<size_t>(std::min<uint64_t>(valid_from - first, head - first));
+            spans.erase(spans.begin() + static_cast<std::ptrdiff_t>(begin),
+                        spans.begin() + static_cast<std::ptrdiff_t>(begin + stale));
+        }
+    }
+
+    for (const auto& span : spans) {
+        origin = std::min(origin, span.start_ns);
+    }
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    int pid = static_cast<int>(getpid());
+    char buffer[512];
+    bool first = true;
+    for (const auto& span : spans) {
+        if (!span.name) {
+            continue;
+        }
+        int length = snprintf(buffer, sizeof(buffer),
+                              "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"pid\":%d,\"tid\":%llu",
+                              first ? "" : ",", span.name, categoryName(span.category),
+                              (span.start_ns - origin) / 1000.0, span.duration_ns / 1000.0,
+                              pid, static_cast<unsigned long long>(span.thread_id));
+        appendFormatted(json, buffer, sizeof(buffer), length);
+
+        if (span.label != 0 || span.value != 0) {
+            length = snprintf(buffer, sizeof(buffer), ",\"args\":{\"detail\":\"%s\",\"value\":%llu}",
+                              unpackLabel(span.label).c_str(), static_cast<unsigned long long>(span.value));
+            appendFormatted(json, buffer, sizeof(buffer), length);
+        }
+        json += "}";
+        first = false;
+    }
+    json += "]}\n";
+    return json;
+}
+
+bool FTPTracer::writeTrace(const std::string& path) {
+    std::string json = dump();
+
+    std::ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file << json;
+    return static_cast<bool>(file);
+}
+
+void FTPTracer::clear() {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    for (const auto& ring : shared.rings) {
+        ring->cleared.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+} // namespace ssftpd
@@ -0,0 +1,419 @@
+#include "ssftpd/ftp_usage_accounting.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ssftpd {
+
+namespace {
+
+constexpr char kMagic[4] = {'S', 'S', 'U', 'A'};
+
+uint64_t fnv1a(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void appendValue(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T readValue(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+bool writeAll(int fd, const std::string& buffer) {
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t result = write(fd, buffer.data() + written, buffer.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(result);
+    }
+    return true;
+}
+
+} // namespace
+
+bool FTPUsageAccounting::Usage::operator==(const Usage& other) const {
+    return bytes_uploaded == other.bytes_uploaded &&
+           bytes_downloaded == other.bytes_downloaded &&
+           uploads == other.uploads &&
+           downloads == other.downloads &&
+           sessions == other.sessions;
+}
+
+FTPUsageAccounting::Account::Account(Scope scope, const std::string& name)
+    : scope_(scope)
+    , name_(name)
+{
+}
+
+FTPUsageAccounting::Usage FTPUsageAccounting::Account::getUsage() const {
+    auto counters = counters_.getAll();
+
+    Usage usage;
+    usage.bytes_uploaded = counters[BYTES_UPLOADED];
+    usage.bytes_downloaded = counters[BYTES_DOWNLOADED];
+    usage.uploads = counters[UPLOADS];
+    usage.downloads = counters[DOWNLOADS];
+    usage.sessions = counters[SESSIONS];
+    return usage;
+}
+
+void FTPUsageAccounting::Account::add(const Usage& usage) {
+    counters_.add(BYTES_UPLOADED, usage.bytes_uploaded);
+    counters_.add(BYTES_DOWNLOADED, usage.bytes_downloaded);
+    counters_.add(UPLOADS, usage.uploads);
+    counters_.add(DOWNLOADS, usage.downloads);
+    counters_.add(SESSIONS, usage.sessions);
+}
+
+FTPUsageAccounting::FTPUsageAccounting(std::shared_ptr<FTPServerConfig> config, std::shared_ptr<Logger> logger)
+    : config_(config)
+    , logger_(logger)
+    , path_(config ? config->usage_log_file : std::string())
+    , fd_(-1)
+    , checkpoints_(0)
+    , interval_(config ? config->usage_checkpoint_interval : std::chrono::seconds(60))
+    , running_(false)
+{
+}
+
+FTPUsageAccounting::~FTPUsageAccounting() {
+    stop();
+}
+
+bool FTPUsageAccounting::start() {
+    if (path_.empty()) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+        if (fd_ != -1) {
+            return true;
+        }
+        if (!openFile() || !restore()) {
+            if (fd_ != -1) {
+                close(fd_);
+                fd_ = -1;
+            }
+            return false;
+        }
+    }
+
+    if (interval_.count() > 0) {
+        std::lock_guard<std::mutex> lock(thread_mutex_);
+        running_ = true;
+        checkpoint_thread_ = std::thread(&FTPUsageAccounting::checkpointLoop, this);
+    }
+
+    logger_->info("Usage accounting checkpoints to " + path_);
+    return true;
+}
+
+void FTPUsageAccounting::stop() {
+    {
+        std::lock_guard<std::mutex> lock(thread_mutex_);
+        running_ = false;
+    }
+    thread_condition_.notify_all();
+
+    if (checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+
+    // Usage since the last interval must not be lost on shutdown
+    checkpoint();
+
+    std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+std::shared_ptr<FTPUsageAccounting::Account> FTPUsageAccounting::getAccount(Scope scope, const std::string& name) {
+    std::lock_guard<std::mutex> lock(accounts_mutex_);
+
+    auto& account = accounts_[AccountKey(scope, name)];
+    if (!account) {
+        account = std::make_shared<Account>(scope, name);
+    }
+    return account;
+}
+
+FTPUsageAccounting::Usage FTPUsageAccounting::getUsage(Scope scope, const std::string& name) const {
+    std::lock_guard<std::mutex> lock(accounts_mutex_);
+
+    auto it = accounts_.find(AccountKey(scope, name));
+    return it != accounts_.end() ? it->second->getUsage() : Usage();
+}
+
+std::map<std::string, FTPUsageAccounting::Usage> FTPUsageAccounting::getAllUsage(Scope scope) const {
+    std::map<std::string, Usage> result;
+
+    for (const auto& account : snapshotAccounts()) {
+        if (account->getScope() == scope) {
+            result[account->getName()] = account->getUsage();
+        }
+    }
+    return result;
+}
+
+std::vector<std::shared_ptr<FTPUsageAccounting::Account>> FTPUsageAccounting::snapshotAccounts() const {
+    std::lock_guard<std::mutex> lock(accounts_mutex_);
+
+    std::vector<std::shared_ptr<Account>> accounts;
+    accounts.reserve(accounts_.size());
+    for (const auto& entry : accounts_) {
+        accounts.push_back(entry.second);
+    }
+    return accounts;
+}
+
+bool FTPUsageAccounting::checkpoint() {
+    std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+    if (fd_ == -1) {
+        return true;
+    }
+
+    // Only accounts that moved since the last block are written
+    std::vector<std::pair<Account*, Usage>> changed;
+    std::string payload;
+    for (const auto& account : snapshotAccounts()) {
+        Usage usage = account->getUsage();
+        if (usage == account->checkpointed_) {
+            continue;
+        }
+
+        // Names are bounded by the record's u16 length field
+        const std::string& name = account->getName();
+        uint16_t name_length = static_cast<uint16_t>(std::min<size_t>(name.size(), UINT16_MAX));
+
+        appendValue<uint8_t>(payload, static_cast<uint8_t>(account->getScope()));
+        appendValue<uint8_t>(payload, 0);
+        appendValue<uint16_t>(payload, name_length);
+        appendValue<uint64_t>(payload, usage.bytes_uploaded);
+        appendValue<uint64_t>(payload, usage.bytes_downloaded);
+        appendValue<uint64_t>(payload, usage.uploads);
+        appendValue<uint64_t>(payload, usage.downloads);
+        appendValue<uint64_t>(payload, usage.sessions);
+        payload.append(name.data(), name_length);
+
+        changed.emplace_back(account.get(), usage);
+    }
+
+    if (changed.empty()) {
+        return true;
+    }
+
+    std::string block;
+    block.reserve(kHeaderSize + payload.size());
+    block.append(kMagic, sizeof(kMagic));
+    appendValue<uint16_t>(block, kFormatVersion);
+    appendValue<uint16_t>(block, 0);
+    appendValue<uint32_t>(block, static_cast<uint32_t>(changed.size()));
+    appendValue<uint32_t>(block, static_cast<uint32_t>(payload.size()));
+    appendValue<int64_t>(block, std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    appendValue<uint64_t>(block, fnv1a(payload.data(), payload.size()));
+    block += payload;
+
+    struct stat info;
+    if (fstat(fd_, &info) != 0) {
+        logger_->error("Failed to stat usage file " + path_ + ": " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // One write per block; a crash mid-write leaves a torn tail that the
+    // next start() cuts off. A write that fails while we are still running
+    // is cut off now, so later blocks do not land behind a torn one
+    if (!writeAll(fd_, block) || fdatasync(fd_) != 0) {
+        int error = errno;
+        if (ftruncate(fd_, info.st_size) != 0) {
+            logger_->error("Failed to truncate usage file " + path_ + ": " + std::string(strerror(errno)));
+        }
+        logger_->error("Failed to write usage checkpoint to " + path_ + ": " + std::string(strerror(error)));
+        return false;
+    }
+
+    for (const auto& entry : changed) {
+        entry.first->checkpointed_ = entry.second;
+    }
+    ++checkpoints_;
+    return true;
+}
+
+bool FTPUsageAccounting::openFile() {
+    fd_ = open(path_.c_str(), O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+    if (fd_ == -1) {
+        logger_->error("Failed to open usage file " + path_ + ": " + std::string(strerror(errno)));
+        return false;
+    }
+    return true;
+}
+
+bool FTPUsageAccounting::restore() {
+    std::string contents;
+    char buffer[65536];
+    off_t offset = 0;
+    while (true) {
+        ssize_t result = pread(fd_, buffer, sizeof(buffer), offset);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_->error("Failed to read usage file " + path_ + ": " + std::string(strerror(errno)));
+            return false;
+        }
+        if (result == 0) {
+            break;
+        }
+        contents.append(buffer, static_cast<size_t>(result));
+        offset += result;
+    }
+
+    // Replay every intact block; later records supersede earlier ones. A
+    // damaged block is skipped by resyncing on the next magic, so one bad
+    // write does not hide the checkpoints after it
+    std::map<AccountKey, Usage> totals;
+    const std::string magic(kMagic, sizeof(kMagic));
+    size_t position = 0;
+    size_t intact_end = 0;
+    size_t intact_bytes = 0;
+    size_t blocks = 0;
+    while (contents.size() - position >= kHeaderSize) {
+        size_t length = parseBlock(contents, position, totals);
+        if (length > 0) {
+            position += length;
+            intact_end = position;
+            intact_bytes += length;
+            ++blocks;
+            continue;
+        }
+
+        position = contents.find(magic, position + 1);
+        if (position == std::string::npos) {
+            break;
+        }
+    }
+
+    if (intact_bytes < intact_end) {
+        logger_->warn("Usage file " + path_ + " has " + std::to_string(intact_end - intact_bytes) +
+                      " damaged bytes between checkpoints; skipped");
+    }
+
+    if (intact_end < contents.size()) {
+        logger_->warn("Usage file " + path_ + " has " + std::to_string(contents.size() - intact_end) +
+                      " unreadable trailing bytes; truncating");
+        if (ftruncate(fd_, static_cast<off_t>(intact_end)) != 0) {
+            logger_->error("Failed to truncate usage file " + path_ + ": " + std::string(strerror(errno)));
+            return false;
+        }
+    }
+
+    // Counting continues from the restored totals
+    for (const auto& entry : totals) {
+        auto account = getAccount(entry.first.first, entry.first.second);
+        account->add(entry.second);
+        account->checkpointed_ = account->getUsage();
+    }
+
+    if (blocks > 0) {
+        logger_->info("Restored usage of " + std::to_string(totals.size()) + " accounts from " +
+                      std::to_string(blocks) + " checkpoints");
+    }
+    return true;
+}
+
+size_t FTPUsageAccounting::parseBlock(const std::string& contents, size_t position,
+                                      std::map<AccountKey, Usage>& totals) {
+    const char* header = contents.data() + position;
+    if (contents.size() - position < kHeaderSize ||
+        std::memcmp(header, kMagic, sizeof(kMagic)) != 0 ||
+        readValue<uint16_t>(header + 4) != kFormatVersion) {
+        return 0;
+    }
+
+    uint32_t record_count = readValue<uint32_t>(header + 8);
+    uint32_t payload_size = readValue<uint32_t>(header + 12);
+    uint64_t checksum = readValue<uint64_t>(header + 24);
+    if (contents.size() - position - kHeaderSize < payload_size) {
+        return 0;
+    }
+
+    const char* payload = header + kHeaderSize;
+    if (fnv1a(payload, payload_size) != checksum) {
+        return 0;
+    }
+
+    // Records apply only once the whole block has parsed
+    std::vector<std::pair<AccountKey, Usage>> records;
+    records.reserve(record_count);
+    size_t cursor = 0;
+    for (uint32_t i = 0; i < record_count; ++i) {
+        if (payload_size - cursor < kRecordPrefixSize) {
+            return 0;
+        }
+        const char* record = payload + cursor;
+        auto scope = static_cast<Scope>(readValue<uint8_t>(record));
+        uint16_t name_length = readValue<uint16_t>(record + 2);
+        if (payload_size - cursor - kRecordPrefixSize < name_length ||
+            (scope != Scope::USER && scope != Scope::VIRTUAL_HOST)) {
+            return 0;
+        }
+
+        Usage usage;
+        usage.bytes_uploaded = readValue<uint64_t>(record + 4);
+        usage.bytes_downloaded = readValue<uint64_t>(record + 12);
+        usage.uploads = readValue<uint64_t>(record + 20);
+        usage.downloads = readValue<uint64_t>(record + 28);
+        usage.sessions = readValue<uint64_t>(record + 36);
+        records.emplace_back(AccountKey(scope, std::string(record + kRecordPrefixSize, name_length)), usage);
+        cursor += kRecordPrefixSize + name_length;
+    }
+    if (cursor != payload_size) {
+        return 0;
+    }
+
+    for (auto& entry : records) {
+        totals[std::move(entry.first)] = entry.second;
+    }
+    return kHeaderSize + payload_size;
+}
+
+void FTPUsageAccounting::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(thread_mutex_);
+
+    while (running_) {
+        thread_condition_.wait_for(lock, interval_);
+        if (!running_) {
+            break;
+        }
+
+        lock.unlock();
+        checkpoint();
+        lock.lock();
+    }
+}
+
+} // namespace ssftpd
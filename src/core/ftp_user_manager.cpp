@@ -110,6 +110,12 @@ std::shared_ptr<FTPUser> FTPUserManager::getUser(const std::string& username) {
     return nullptr;
 }
 
+uint64_t FTPUserManager::getUserMaxTransferRate(const std::string& username) const {
+    // Read from the stored user; sessions ask on every login
+    auto it = users_.find(username);
+    return it != users_.end() ? it->second->getMaxTransferRate() : 0;
+}
+
 std::vector<std::shared_ptr<FTPUser>> FTPUserManager::getAllUsers() const {
     std::vector<std::shared_ptr<FTPUser>> result;
     result.reserve(users_.size());
@@ -121,6 +127,7 @@ std::vector<std::shared_ptr<FTPUser>> FTPUserManager::getAllUsers() const {
         user->setHomeDirectory(pair.second->getHomeDirectory());
         user->setShell(pair.second->getShell());
         user->setGroup(pair.second->getGroup());
+        user->setMaxTransferRate(pair.second->getMaxTransferRate());
 
         // Copy other properties that can be set
         // Note: We can't copy atomic statistics, so they'll start fresh
@@ -153,6 +160,7 @@ bool FTPUserManager::addUser(const FTPUser& user) {
     new_user->setHomeDirectory(user.getHomeDirectory());
     new_user->setShell(user.getShell());
     new_user->setGroup(user.getGroup());
+    new_user->setMaxTransferRate(user.getMaxTransferRate());
 
     // Add user
     users_[user.getUsername()] = std::move(new_user);
@@ -179,6 +187,7 @@ bool FTPUserManager::updateUser(const std::string& username, const FTPUser& upda
     new_user->setHomeDirectory(updated_user.getHomeDirectory());
     new_user->setShell(updated_user.getShell());
     new_user->setGroup(updated_user.getGroup());
+    new_user->setMaxTransferRate(updated_user.getMaxTransferRate());
 
     // Update user
     it->second = std::move(new_user);
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "ssftpd/flat_hash_map.hpp"
+#include <map>
+#include <random>
+#include <string>
+
+class FlatHashMapTest : public ::testing::Test {
+protected:
+    ssftpd::FlatHashMap<std::string, size_t> map;
+};
+
+TEST_F(FlatHashMapTest, InsertAndFind) {
+    map["192.168.1.1"] = 3;
+    map["10.0.0.1"]++;
+
+    ASSERT_NE(map.find("192.168.1.1"), nullptr);
+    EXPECT_EQ(*map.find("192.168.1.1"), 3u);
+    EXPECT_EQ(*map.find("10.0.0.1"), 1u);
+    EXPECT_EQ(map.find("127.0.0.1"), nullptr);
+    EXPECT_EQ(map.size(), 2u);
+}
+
+TEST_F(FlatHashMapTest, InsertOrAssign) {
+    EXPECT_TRUE(map.insertOrAssign("admin", 1));
+    EXPECT_FALSE(map.insertOrAssign("admin", 5));
+    EXPECT_EQ(*map.find("admin"), 5u);
+    EXPECT_EQ(map.size(), 1u);
+}
+
+TEST_F(FlatHashMapTest, EraseKeepsOtherKeysReachable) {
+    for (size_t i = 0; i < 1000; ++i) {
+        map["user" + std::to_string(i)] = i;
+    }
+
+    for (size_t i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(map.erase("user" + std::to_string(i)));
+    }
+    EXPECT_FALSE(map.erase("user0"));
+    EXPECT_EQ(map.size(), 500u);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        const size_t* value = map.find("user" + std::to_string(i));
+        if (i % 2 == 0) {
+            EXPECT_EQ(value, nullptr);
+        } else {
+            ASSERT_NE(value, nullptr);
+            EXPECT_EQ(*value, i);
+        }
+    }
+}
+
+TEST_F(FlatHashMapTest, MatchesStdMapUnderChurn) {
+    std::map<std::string, size_t> reference;
+    std::mt19937 rng(42);
+
+    for (int step = 0; step < 20000; ++step) {
+        std::string key = "k" + std::to_string(rng() % 300);
+        if (rng() % 3 == 0) {
+            EXPECT_EQ(map.erase(key), reference.erase(key) == 1);
+        } else {
+            map[key]++;
+            reference[key]++;
+        }
+    }
+
+    EXPECT_EQ(map.size(), reference.size());
+
+    std::map<std::string, size_t> contents;
+    map.forEach([&contents](const std::string& key, size_t value) {
+        contents.emplace(key, value);
+    });
+    EXPECT_EQ(contents, reference);
+}
+
+TEST_F(FlatHashMapTest, ClearKeepsCapacity) {
+    for (size_t i = 0; i < 100; ++i) {
+        map["key" + std::to_string(i)] = i;
+    }
+
+    size_t capacity = map.capacity();
+    map.clear();
+
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.capacity(), capacity);
+    EXPECT_EQ(map.find("key1"), nullptr);
+}
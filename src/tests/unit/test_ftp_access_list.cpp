@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_access_list.hpp"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+ssftpd::FTPIPKey key(const std::string& address) {
+    ssftpd::FTPIPKey result;
+    EXPECT_TRUE(ssftpd::FTPIPKey::parse(address, result));
+    return result;
+}
+
+std::string ipv4(uint32_t address) {
+    return std::to_string(address >> 24) + "." + std::to_string((address >> 16) & 0xFF) + "." +
+           std::to_string((address >> 8) & 0xFF) + "." + std::to_string(address & 0xFF);
+}
+
+} // namespace
+
+TEST(FTPAccessListTest, EmptyListAllowsEveryone) {
+    ssftpd::FTPAccessList list;
+    EXPECT_TRUE(list.isAllowed(key("192.0.2.1")));
+    EXPECT_TRUE(list.isAllowed(key("2001:db8::1")));
+}
+
+TEST(FTPAccessListTest, MostSpecificRuleWins) {
+    ssftpd::FTPAccessList list;
+    ASSERT_TRUE(list.addRule("10.0.0.0/8", true));
+    ASSERT_TRUE(list.addRule("10.1.0.0/16", false));
+    ASSERT_TRUE(list.addRule("10.1.2.3", true));
+    ASSERT_TRUE(list.addRule("2001:db8::/32", true));
+    ASSERT_TRUE(list.addRule("2001:db8:bad::/48", false));
+
+    // Enough unrelated rules that compile() builds the jump tables
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_TRUE(list.addRule("172.16." + std::to_string(i) + ".0/24", false));
+        ASSERT_TRUE(list.addRule("fd00:" + std::to_string(i) + "::/32", false));
+    }
+    list.compile();
+
+    EXPECT_TRUE(list.isAllowed(key("10.200.0.1")));
+    EXPECT_FALSE(list.isAllowed(key("10.1.9.9")));
+    EXPECT_TRUE(list.isAllowed(key("10.1.2.3")));
+    EXPECT_TRUE(list.isAllowed(key("2001:db8:1::1")));
+    EXPECT_FALSE(list.isAllowed(key("2001:db8:bad::1")));
+
+    // Allow rules exist, so anything unmatched is refused
+    EXPECT_FALSE(list.isAllowed(key("192.0.2.1")));
+    EXPECT_FALSE(list.isAllowed(key("2001:db9::1")));
+}
+
+TEST(FTPAccessListTest, DenyOnlyListIsABlacklist) {
+    ssftpd::FTPAccessList list;
+    ASSERT_TRUE(list.addRule("203.0.113.0/24", false));
+
+    EXPECT_FALSE(list.isAllowed(key("203.0.113.77")));
+    EXPECT_TRUE(list.isAllowed(key("203.0.114.1")));
+}
+
+TEST(FTPAccessListTest, RejectsInvalidNetworks) {
+    ssftpd::FTPAccessList list;
+    EXPECT_FALSE(list.addRule("10.0.0.0/33", true));
+    EXPECT_FALSE(list.addRule("2001:db8::/129", true));
+    EXPECT_FALSE(list.addRule("10.0.0.0/", true));
+    EXPECT_FALSE(list.addRule("not-an-address", true));
+    EXPECT_EQ(list.getRuleCount(), 0u);
+}
+
+TEST(FTPAccessListTest, MatchesLinearScanWithManyRules) {
+    std::mt19937 random(42);
+    ssftpd::FTPAccessList list;
+
+    struct Rule {
+        uint32_t network;
+        int length;
+        bool allow;
+    };
+    std::vector<Rule> rules;
+
+    for (int i = 0; i < 5000; ++i) {
+        int length = 8 + static_cast<int>(random() % 25);
+        uint32_t mask = length == 32 ? ~0u : ~(~0u >> length);
+        Rule rule{static_cast<uint32_t>(random()) & mask, length, (random() & 1) != 0};
+        rules.push_back(rule);
+        ASSERT_TRUE(list.addRule(ipv4(rule.network) + "/" + std::to_string(length), rule.allow));
+    }
+    list.compile();
+
+    // Reference: longest matching prefix, deny winning between duplicates
+    auto expected = [&rules](uint32_t address) {
+        int best = -1;
+        bool allow = false;
+        for (const auto& rule : rules) {
+            uint32_t mask = rule.length == 32 ? ~0u : ~(~0u >> rule.length);
+            if ((address & mask) != rule.network) {
+                continue;
+            }
+            if (rule.length > best) {
+                best = rule.length;
+                allow = rule.allow;
+            } else if (rule.length == best && !rule.allow) {
+                allow = false;
+            }
+        }
+        return best >= 0 ? allow : false;
+    };
+
+    for (int i = 0; i < 2000; ++i) {
+        // Half the probes land inside a rule, half anywhere
+        uint32_t address = static_cast<uint32_t>(random());
+        if (i % 2 == 0) {
+            const auto& rule = rules[random() % rules.size()];
+            uint32_t host = rule.length == 32 ? 0 : address & (~0u >> rule.length);
+            address = rule.network | host;
+        }
+        ASSERT_EQ(list.isAllowed(key(ipv4(address))), expected(address)) << ipv4(address);
+    }
+}
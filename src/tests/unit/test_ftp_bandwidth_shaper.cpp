@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_bandwidth_shaper.hpp"
+#include "ssftpd/logger.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+
+using ssftpd::FTPBandwidthShaper;
+using ssftpd::FTPTokenBucket;
+
+class FTPBandwidthShaperTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        config = std::make_shared<ssftpd::FTPServerConfig>();
+        config->transfer.max_transfer_rate = 0;
+        config->rate_limit.enabled = false;
+
+        logger = std::make_shared<ssftpd::Logger>();
+        logger->setConsoleOutput(false);
+    }
+
+    // Sends as fast as the stream allows for a stretch of simulated time,
+    // jumping the clock to ready_at whenever the stream has to wait
+    static uint64_t drain(FTPBandwidthShaper::Stream& stream,
+                          FTPBandwidthShaper::Clock::time_point start,
+                          std::chrono::milliseconds duration) {
+        auto now = start;
+        auto end = start + duration;
+        uint64_t sent = 0;
+        while (now < end) {
+            auto grant = stream.request(64 * 1024, now);
+            if (grant.bytes == 0) {
+                EXPECT_GT(grant.ready_at, now);
+                now = grant.ready_at;
+                continue;
+            }
+            sent += grant.bytes;
+        }
+        return sent;
+    }
+
+    std::shared_ptr<ssftpd::FTPServerConfig> config;
+    std::shared_ptr<ssftpd::Logger> logger;
+};
+
+TEST_F(FTPBandwidthShaperTest, TokenBucketHoldsRateAfterBurst) {
+    const int64_t kSecond = 1000000000;
+    FTPTokenBucket bucket(1000, 100);
+
+    // An idle bucket allows the burst, then nothing until time passes
+    EXPECT_EQ(bucket.available(kSecond), 100u);
+    bucket.consume(100, kSecond);
+    EXPECT_EQ(bucket.available(kSecond), 0u);
+    EXPECT_EQ(bucket.readyAt(50, kSecond), kSecond + kSecond / 20);
+
+    // Refunded bytes are available again at once
+    bucket.refund(40);
+    EXPECT_EQ(bucket.available(kSecond), 40u);
+}
+
+TEST_F(FTPBandwidthShaperTest, UnresolvedUserIsNotThrottled) {
+    auto shaper = std::make_shared<FTPBandwidthShaper>(config, logger);
+    shaper->setUserRateResolver([](const std::string&) -> uint64_t { return 0; });
+
+    auto stream = shaper->createStream("default", 0);
+    stream->setUser("bob");
+
+    auto now = FTPBandwidthShaper::Clock::now();
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(stream->request(64 * 1024, now).bytes, 64u * 1024);
+    }
+    EXPECT_EQ(shaper->getThrottledCount(), 0u);
+}
+
+TEST_F(FTPBandwidthShaperTest, ResolvedUserRateThrottlesStream) {
+    const uint64_t kUserRate = 1024 * 1024;
+    auto shaper = std::make_shared<FTPBandwidthShaper>(config, logger);
+    shaper->setUserRateResolver([kUserRate](const std::string& username) -> uint64_t {
+        return username == "alice" ? kUserRate : 0;
+    });
+
+    auto stream = shaper->createStream("default", 0);
+    stream->setUser("alice");
+
+    // Two seconds at the user's rate, plus at most one burst of 64 KiB
+    uint64_t sent = drain(*stream, FTPBandwidthShaper::Clock::now(), std::chrono::seconds(2));
+    EXPECT_GE(sent, 2 * kUserRate - 64 * 1024);
+    EXPECT_LE(sent, 2 * kUserRate + 64 * 1024);
+    EXPECT_GT(shaper->getThrottledCount(), 0u);
+}
+
+TEST_F(FTPBandwidthShaperTest, UserRateIsSharedAcrossSessions) {
+    const uint64_t kUserRate = 1024 * 1024;
+    auto shaper = std::make_shared<FTPBandwidthShaper>(config, logger);
+    shaper->setUserRateResolver([kUserRate](const std::string&) -> uint64_t { return kUserRate; });
+
+    auto first = shaper->createStream("default", 0);
+    auto second = shaper->createStream("default", 0);
+    first->setUser("alice");
+    second->setUser("alice");
+
+    // Both sessions draw from one user bucket, so together they get one rate
+    auto start = FTPBandwidthShaper::Clock::now();
+    uint64_t sent = drain(*first, start, std::chrono::seconds(1)) +
+                    drain(*second, start, std::chrono::seconds(1));
+    EXPECT_LE(sent, kUserRate + 2 * 64 * 1024);
+}
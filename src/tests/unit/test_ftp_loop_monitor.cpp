@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_loop_monitor.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using ssftpd::FTPLoopMonitor;
+
+class FTPLoopMonitorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        config = std::make_shared<ssftpd::FTPServerConfig>();
+        config->handler_budget = std::chrono::milliseconds(20);
+
+        logger = std::make_shared<ssftpd::Logger>();
+        logger->setConsoleOutput(false);
+    }
+
+    std::shared_ptr<ssftpd::FTPServerConfig> config;
+    std::shared_ptr<ssftpd::Logger> logger;
+};
+
+TEST_F(FTPLoopMonitorTest, RecordsIterationsAndHandlers) {
+    FTPLoopMonitor monitor(config, logger);
+    size_t reactor = monitor.addReactor("main");
+
+    // Scopes on an unattached thread are ignored
+    {
+        FTPLoopMonitor::HandlerScope handler("ignored");
+    }
+
+    std::thread([&monitor, reactor]() {
+        monitor.attachThread(reactor);
+        for (int i = 0; i < 10; ++i) {
+            FTPLoopMonitor::HandlerScope handler("dispatch");
+            FTPLoopMonitor::TagScope tag("command", "LIST");
+        }
+        monitor.recordIteration(reactor, std::chrono::microseconds(250), 10);
+        monitor.setQueueDepth(reactor, 3);
+        FTPLoopMonitor::detachThread();
+    }).join();
+
+    auto stats = monitor.getStats();
+    ASSERT_EQ(stats.size(), 1u);
+    EXPECT_EQ(stats[0].name, "main");
+    EXPECT_EQ(stats[0].handler_us.count, 10u);
+    EXPECT_EQ(stats[0].iteration_us.count, 1u);
+    EXPECT_EQ(stats[0].batch_size.count, 1u);
+    EXPECT_EQ(stats[0].queue_depth, 3u);
+    EXPECT_EQ(stats[0].stalls, 0u);
+}
+
+TEST_F(FTPLoopMonitorTest, WatchdogCountsHandlersOverBudget) {
+    FTPLoopMonitor monitor(config, logger);
+    size_t fast = monitor.addReactor("worker-0");
+    size_t slow = monitor.addReactor("worker-1");
+    ASSERT_TRUE(monitor.start());
+
+    std::thread fast_thread([&monitor, fast]() {
+        monitor.attachThread(fast);
+        for (int i = 0; i < 20; ++i) {
+            FTPLoopMonitor::HandlerScope handler("session_task");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    std::thread slow_thread([&monitor, slow]() {
+        monitor.attachThread(slow);
+        FTPLoopMonitor::HandlerScope handler("session_task");
+        FTPLoopMonitor::TagScope tag("command", "RETR");
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    });
+    fast_thread.join();
+    slow_thread.join();
+    monitor.stop();
+
+    // One stall however long the handler stayed stuck
+    auto stats = monitor.getStats();
+    EXPECT_EQ(stats[0].stalls, 0u);
+    EXPECT_EQ(stats[1].stalls, 1u);
+    EXPECT_EQ(monitor.getStallCount(), 1u);
+}
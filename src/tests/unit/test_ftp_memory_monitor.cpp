@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_memory_monitor.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <memory>
+#include <vector>
+
+using ssftpd::FTPMemoryMonitor;
+
+class FTPMemoryMonitorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        config = std::make_shared<ssftpd::FTPServerConfig>();
+
+        logger = std::make_shared<ssftpd::Logger>();
+        logger->setConsoleOutput(false);
+    }
+
+    std::shared_ptr<ssftpd::FTPServerConfig> config;
+    std::shared_ptr<ssftpd::Logger> logger;
+};
+
+TEST_F(FTPMemoryMonitorTest, ReadsProcessMemory) {
+    // Touch some heap so the resident size is clearly non-zero
+    std::vector<char> block(8 * 1024 * 1024, 1);
+
+    auto memory = FTPMemoryMonitor::readProcessMemory();
+    EXPECT_GT(memory.resident, block.size());
+    EXPECT_GE(memory.virtual_size, memory.resident);
+}
+
+TEST_F(FTPMemoryMonitorTest, ReclaimsAndRefusesNearTheLimit) {
+    // Any real process is far above a 1 MB limit
+    config->max_memory_usage = 1024 * 1024;
+    FTPMemoryMonitor monitor(config, logger);
+
+    size_t cache_bytes = 4096;
+    int reclaims = 0;
+    monitor.addSubsystem("cache", [&cache_bytes]() { return cache_bytes; },
+                         [&cache_bytes, &reclaims]() { cache_bytes /= 2; reclaims++; });
+    monitor.addSubsystem("sessions", []() { return static_cast<size_t>(128); });
+
+    EXPECT_TRUE(monitor.admit());
+    monitor.update();
+
+    EXPECT_EQ(monitor.getPressure(), FTPMemoryMonitor::Pressure::CRITICAL);
+    EXPECT_EQ(reclaims, 1);
+    EXPECT_FALSE(monitor.admit());
+
+    auto stats = monitor.getStats();
+    EXPECT_EQ(stats.reclaims, 1u);
+    EXPECT_EQ(stats.refused, 1u);
+    ASSERT_EQ(stats.subsystems.size(), 2u);
+    EXPECT_EQ(stats.subsystems[0].first, "cache");
+    EXPECT_EQ(stats.subsystems[0].second, 2048u);
+    EXPECT_EQ(stats.subsystems[1].second, 128u);
+}
+
+TEST_F(FTPMemoryMonitorTest, NoEnforcementWithoutLimit) {
+    config->max_memory_usage = 0;
+    FTPMemoryMonitor monitor(config, logger);
+
+    int reclaims = 0;
+    monitor.addSubsystem("cache", []() { return static_cast<size_t>(0); }, [&reclaims]() { reclaims++; });
+    monitor.update();
+
+    EXPECT_EQ(monitor.getPressure(), FTPMemoryMonitor::Pressure::NORMAL);
+    EXPECT_EQ(reclaims, 0);
+    EXPECT_TRUE(monitor.admit());
+    EXPECT_GT(monitor.getStats().process.resident, 0u);
+}
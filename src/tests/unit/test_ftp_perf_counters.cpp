@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_perf_counters.hpp"
+#include <chrono>
+#include <string>
+#include <thread>
+
+using ssftpd::FTPPerfCounters;
+using ssftpd::FTPPerfScope;
+
+class FTPPerfCountersTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        FTPPerfCounters::clear();
+    }
+
+    void TearDown() override {
+        FTPPerfCounters::setEnabled(false);
+        FTPPerfCounters::clear();
+    }
+};
+
+TEST_F(FTPPerfCountersTest, DisabledScopesRecordNothing) {
+    {
+        FTPPerfScope scope("RETR");
+    }
+    EXPECT_TRUE(FTPPerfCounters::getTotals().empty());
+}
+
+TEST_F(FTPPerfCountersTest, AttributesCountersToOperations) {
+    // Hardware counters depend on the host; context switches never do
+    FTPPerfCounters::Mode mode = FTPPerfCounters::setEnabled(true);
+    ASSERT_NE(mode, FTPPerfCounters::Mode::OFF);
+
+    std::thread([]() {
+        for (int i = 0; i < 10; ++i) {
+            FTPPerfScope scope("LIST");
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        FTPPerfScope scope("send_binary_stream");
+    }).join();
+
+    auto totals = FTPPerfCounters::getTotals();
+    ASSERT_EQ(totals.size(), 2u);
+    EXPECT_EQ(totals["LIST"].scopes, 10u);
+    EXPECT_EQ(totals["send_binary_stream"].scopes, 1u);
+
+    // Every sleep gives up the CPU at least once
+    EXPECT_GE(totals["LIST"].values[FTPPerfCounters::CONTEXT_SWITCHES], 10u);
+    if (mode == FTPPerfCounters::Mode::HARDWARE) {
+        EXPECT_GT(totals["LIST"].values[FTPPerfCounters::INSTRUCTIONS], 0u);
+    }
+
+    FTPPerfCounters::clear();
+    EXPECT_TRUE(FTPPerfCounters::getTotals().empty());
+}
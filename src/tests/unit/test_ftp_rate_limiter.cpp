@@ -0,0 +1,248 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_rate_limiter.hpp"
+#include "ssftpd/ftp_ban_table.hpp"
+#include "ssftpd/logger.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+class FTPRateLimiterTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        config = std::make_shared<ssftpd::FTPServerConfig>();
+        config->rate_limit.enabled = true;
+        config->rate_limit.max_connections_per_minute = 100;
+        config->rate_limit.max_requests_per_minute = 50;
+        config->rate_limit.window_size = std::chrono::seconds(60);
+
+        logger = std::make_shared<ssftpd::Logger>();
+        logger->setConsoleOutput(false);
+    }
+
+    std::shared_ptr<ssftpd::FTPServerConfig> config;
+    std::shared_ptr<ssftpd::Logger> logger;
+};
+
+TEST_F(FTPRateLimiterTest, RequestLimitPerIP) {
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_TRUE(limiter.allowRequest("192.168.1.10"));
+    }
+    EXPECT_FALSE(limiter.allowRequest("192.168.1.10"));
+
+    // Other addresses, including IPv6, have their own budget
+    EXPECT_TRUE(limiter.allowRequest("192.168.1.11"));
+    EXPECT_TRUE(limiter.allowRequest("2001:db8::1"));
+}
+
+TEST_F(FTPRateLimiterTest, ConcurrentRequestsNeverExceedLimit) {
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+
+    const int thread_count = 8;
+    const int ip_count = 32;
+    std::atomic<int> allowed[ip_count] = {};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&limiter, &allowed]() {
+            for (int round = 0; round < 100; ++round) {
+                for (int ip = 0; ip < ip_count; ++ip) {
+                    if (limiter.allowRequest("10.0.0." + std::to_string(ip))) {
+                        allowed[ip]++;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // Every address gets exactly its budget, no more and no less
+    for (int ip = 0; ip < ip_count; ++ip) {
+        EXPECT_EQ(allowed[ip].load(), 50);
+    }
+}
+
+TEST_F(FTPRateLimiterTest, ConcurrentConnectionsRespectGlobalLimit) {
+    config->rate_limit.max_connections_per_minute = 1000;
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+    limiter.setMaxConnectionsPerIP(5);
+
+    std::atomic<int> allowed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&limiter, &allowed, t]() {
+            for (int i = 0; i < 1000; ++i) {
+                std::string ip = "172.16." + std::to_string(t) + "." + std::to_string(i % 250);
+                if (limiter.allowConnection(ip)) {
+                    allowed++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_LE(allowed.load(), 1000);
+    EXPECT_GT(allowed.load(), 0);
+}
+
+TEST_F(FTPRateLimiterTest, ConnectionFloodIsBanned) {
+    config->rate_limit.block_duration = std::chrono::seconds(60);
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+    limiter.setMaxConnectionsPerIP(3);
+
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_TRUE(limiter.allowConnection("198.51.100.7"));
+    }
+    EXPECT_FALSE(limiter.allowConnection("198.51.100.7"));
+
+    ssftpd::FTPIPKey key;
+    ASSERT_TRUE(ssftpd::FTPIPKey::parse("198.51.100.7", key));
+    EXPECT_TRUE(limiter.isBanned(key));
+    EXPECT_EQ(limiter.getBans().count("198.51.100.7"), 1u);
+
+    EXPECT_TRUE(limiter.unban("198.51.100.7"));
+    EXPECT_FALSE(limiter.isBanned(key));
+}
+
+TEST_F(FTPRateLimiterTest, FailedLoginsAreBanned) {
+    config->security.max_login_attempts = 3;
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+
+    EXPECT_FALSE(limiter.recordFailedLogin("2001:db8::66"));
+    EXPECT_FALSE(limiter.recordFailedLogin("2001:db8::66"));
+    EXPECT_TRUE(limiter.recordFailedLogin("2001:db8::66"));
+    EXPECT_FALSE(limiter.allowConnection("2001:db8::66"));
+    EXPECT_TRUE(limiter.allowConnection("2001:db8::67"));
+}
+
+TEST(FTPBanTableTest, TimerWheelExpiresBans) {
+    auto logger = std::make_shared<ssftpd::Logger>();
+    logger->setConsoleOutput(false);
+    ssftpd::FTPBanTable table(logger);
+
+    auto now = std::chrono::steady_clock::now();
+    auto short_ban = ssftpd::FTPIPKey::fromIPv4(0x01020304);
+    auto long_ban = ssftpd::FTPIPKey::fromIPv4(0x05060708);
+
+    // The long ban spans more than one turn of the wheel
+    EXPECT_TRUE(table.ban(short_ban, std::chrono::seconds(30), now));
+    EXPECT_TRUE(table.ban(long_ban, std::chrono::seconds(600), now));
+    EXPECT_FALSE(table.ban(short_ban, std::chrono::seconds(10), now));
+    EXPECT_EQ(table.getBanCount(), 2u);
+
+    for (int second = 1; second <= 601; ++second) {
+        table.expire(now + std::chrono::seconds(second));
+        if (second == 31) {
+            EXPECT_FALSE(table.isBanned(short_ban, now + std::chrono::seconds(second)));
+            EXPECT_TRUE(table.isBanned(long_ban, now + std::chrono::seconds(second)));
+            EXPECT_EQ(table.getBanCount(), 1u);
+        }
+    }
+
+    EXPECT_FALSE(table.isBanned(long_ban, now + std::chrono::seconds(601)));
+    EXPECT_EQ(table.getBanCount(), 0u);
+}
+
+TEST_F(FTPRateLimiterTest, SharedTableIsOneBudgetAcrossProcesses) {
+    const std::string name = "/ssftpd-test-" + std::to_string(getpid());
+    config->rate_limit.shared_memory_name = name;
+    config->rate_limit.shared_memory_slots = 1024;
+    config->rate_limit.block_duration = std::chrono::seconds(60);
+
+    // Each limiter maps the table on its own, like separate processes would
+    ssftpd::FTPRateLimiter first(config, logger);
+    ssftpd::FTPRateLimiter second(config, logger);
+    ASSERT_TRUE(first.initialize());
+    ASSERT_TRUE(second.initialize());
+    first.setMaxConnectionsPerIP(4);
+    second.setMaxConnectionsPerIP(4);
+
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_TRUE(first.allowConnection("198.51.100.9"));
+        EXPECT_TRUE(second.allowConnection("198.51.100.9"));
+    }
+
+    // The fifth attempt is over the shared limit, and the ban reaches both
+    EXPECT_FALSE(first.allowConnection("198.51.100.9"));
+    ssftpd::FTPIPKey key;
+    ASSERT_TRUE(ssftpd::FTPIPKey::parse("198.51.100.9", key));
+    EXPECT_TRUE(second.isBanned(key));
+    EXPECT_FALSE(second.allowConnection("198.51.100.9"));
+    EXPECT_TRUE(second.allowConnection("198.51.100.10"));
+
+    EXPECT_TRUE(second.unban("198.51.100.9"));
+    EXPECT_TRUE(first.unban("198.51.100.9"));
+    EXPECT_FALSE(first.isBanned(key));
+
+    shm_unlink(name.c_str());
+}
+
+TEST_F(FTPRateLimiterTest, SharedGlobalLimitDoesNotSpendPerIPBudget) {
+    const std::string name = "/ssftpd-test-global-" + std::to_string(getpid());
+    config->rate_limit.shared_memory_name = name;
+    config->rate_limit.shared_memory_slots = 1024;
+    config->rate_limit.max_connections_per_minute = 2;
+
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+    limiter.setMaxConnectionsPerIP(3);
+
+    EXPECT_TRUE(limiter.allowConnection("198.51.100.20"));
+    EXPECT_TRUE(limiter.allowConnection("198.51.100.21"));
+
+    // Refused by the global limit only; the client must not be banned
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_FALSE(limiter.allowConnection("198.51.100.20"));
+    }
+    ssftpd::FTPIPKey key;
+    ASSERT_TRUE(ssftpd::FTPIPKey::parse("198.51.100.20", key));
+    EXPECT_FALSE(limiter.isBanned(key));
+
+    shm_unlink(name.c_str());
+}
+
+TEST_F(FTPRateLimiterTest, ManyAddressesAcrossThreads) {
+    config->rate_limit.max_requests_per_minute = 1000000000;
+    ssftpd::FTPRateLimiter limiter(config, logger);
+    ASSERT_TRUE(limiter.initialize());
+
+    const unsigned thread_count = 4;
+    const int checks_per_thread = 20000;
+
+    std::vector<ssftpd::FTPIPKey> keys(1024);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        keys[i] = ssftpd::FTPIPKey::fromIPv4(static_cast<uint32_t>(0x0A000000 + i));
+    }
+
+    // Every shard is hit from every thread; none of the checks may be lost
+    std::atomic<int> allowed{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&limiter, &keys, &allowed, t]() {
+            for (int i = 0; i < checks_per_thread; ++i) {
+                if (limiter.allowRequest(keys[(i * 7 + t * 131) % keys.size()])) {
+                    allowed++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(allowed.load(), static_cast<int>(thread_count) * checks_per_thread);
+}
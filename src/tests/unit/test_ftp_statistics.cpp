@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_statistics.hpp"
+#include "ssftpd/ftp_sharded_counters.hpp"
+#include "ssftpd/ftp_latency_histogram.hpp"
+#include "ssftpd/ftp_rate_series.hpp"
+#include "ssftpd/ftp_statistics_file.hpp"
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <cstdio>
+#include <sys/mman.h>
+#include <unistd.h>
+
+TEST(FTPStatisticsTest, CountersAggregateAcrossThreads) {
+    ssftpd::FTPStatistics statistics;
+    statistics.start();
+
+    const int thread_count = 8;
+    const int rounds = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&statistics]() {
+            for (int i = 0; i < rounds; ++i) {
+                statistics.incrementRequests();
+                statistics.addBytesTransferred(3);
+            }
+            statistics.incrementConnections();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto stats = statistics.getStatsMap();
+    EXPECT_EQ(stats["total_requests"], static_cast<size_t>(thread_count * rounds));
+    EXPECT_EQ(stats["total_bytes_transferred"], static_cast<size_t>(thread_count * rounds * 3));
+    EXPECT_EQ(stats["total_connections"], static_cast<size_t>(thread_count));
+    EXPECT_EQ(stats["current_connections"], static_cast<size_t>(thread_count));
+
+    statistics.reset();
+    EXPECT_EQ(statistics.getStatsMap()["total_requests"], 0u);
+}
+
+TEST(FTPStatisticsTest, ShardedCountersUnderContention) {
+    const unsigned thread_count = 4;
+    const uint64_t increments = 100000;
+
+    // Threads land on different shards; the total must still be exact
+    ssftpd::FTPShardedCounters<1> sharded;
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&sharded, increments]() {
+            for (uint64_t i = 0; i < increments; ++i) {
+                sharded.add(0);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(sharded.get(0), thread_count * increments);
+}
+
+TEST(FTPLatencyHistogramTest, BucketsKeepRelativePrecision) {
+    std::mt19937_64 random(7);
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t value = random() >> (random() % 64);
+        if (value > ssftpd::FTPLatencyHistogram::kMaxValue) {
+            continue;
+        }
+        size_t bucket = ssftpd::FTPLatencyHistogram::bucketFor(value);
+        ASSERT_LT(bucket, ssftpd::FTPLatencyHistogram::kBucketCount);
+        uint64_t upper = ssftpd::FTPLatencyHistogram::bucketUpperBound(bucket);
+        ASSERT_GE(upper, value);
+        ASSERT_LE(upper - value, value / 16) << value;
+    }
+}
+
+TEST(FTPLatencyHistogramTest, PercentilesFromConcurrentRecording) {
+    ssftpd::FTPLatencyHistogram histogram;
+
+    // Four threads record 1..10000 each
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram]() {
+            for (uint64_t value = 1; value <= 10000; ++value) {
+                histogram.record(value);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto snapshot = histogram.snapshot();
+    EXPECT_EQ(snapshot.count, 40000u);
+    EXPECT_EQ(snapshot.max, 10000u);
+    EXPECT_NEAR(snapshot.mean(), 5000.5, 0.01);
+    EXPECT_NEAR(static_cast<double>(snapshot.percentile(50)), 5000, 5000 / 16.0);
+    EXPECT_NEAR(static_cast<double>(snapshot.percentile(99)), 9900, 9900 / 16.0);
+    EXPECT_EQ(snapshot.percentile(100), 10000u);
+}
+
+TEST(FTPStatisticsTest, CommandLatenciesByVerb) {
+    ssftpd::FTPStatistics statistics;
+    statistics.recordCommand("LIST", std::chrono::milliseconds(20));
+    statistics.recordCommand("LIST", std::chrono::milliseconds(40));
+    statistics.recordCommand("XYZZY", std::chrono::microseconds(5));
+    statistics.recordThroughput(10 * 1024 * 1024, std::chrono::seconds(2));
+
+    auto commands = statistics.getCommandLatencies();
+    ASSERT_EQ(commands.size(), 2u);
+    EXPECT_EQ(commands["LIST"].count, 2u);
+    EXPECT_EQ(commands["LIST"].max, 40000u);
+    EXPECT_EQ(commands["OTHER"].count, 1u);
+
+    auto phases = statistics.getPhaseLatencies();
+    EXPECT_EQ(phases["throughput_kib"].max, 5120u);
+    EXPECT_EQ(phases["auth"].count, 0u);
+}
+
+TEST(FTPStatisticsTest, CommandLabelsAreBounded) {
+    EXPECT_STREQ(ssftpd::FTPStatistics::commandLabel("RETR"), "RETR");
+    EXPECT_STREQ(ssftpd::FTPStatistics::commandLabel("XYZZY"), "OTHER");
+    EXPECT_STREQ(ssftpd::FTPStatistics::commandLabel("RETX"), "OTHER");
+}
+
+TEST(FTPRateSeriesTest, RollsSecondsIntoMinutesAndHours) {
+    ssftpd::FTPRateSeries series;
+    uint64_t total = 0;
+
+    // Two hours at 10 events per second, then a 100 per second spike
+    int64_t second = 1;
+    for (; second <= 7200; ++second) {
+        total += 10;
+        series.advance(total, second);
+    }
+    for (int i = 0; i < 10; ++i, ++second) {
+        total += 100;
+        series.advance(total, second);
+    }
+
+    EXPECT_DOUBLE_EQ(series.getRate(std::chrono::seconds(10)), 100.0);
+    EXPECT_DOUBLE_EQ(series.getRate(std::chrono::seconds(60)), (50 * 10 + 10 * 100) / 60.0);
+    EXPECT_DOUBLE_EQ(series.getRate(std::chrono::hours(1)), 10.0);
+    EXPECT_DOUBLE_EQ(series.getRate(std::chrono::hours(24)), 10.0);
+
+    auto hours = series.getBuckets(ssftpd::FTPRateSeries::Resolution::HOUR);
+    ASSERT_EQ(hours.size(), 2u);
+    EXPECT_EQ(hours[0], 36000u);
+    EXPECT_EQ(series.getBuckets(ssftpd::FTPRateSeries::Resolution::MINUTE).size(), 60u);
+
+    // Seconds nobody reported are empty buckets
+    series.advance(total, second + 30);
+    EXPECT_DOUBLE_EQ(series.getRate(std::chrono::seconds(30)), 0.0);
+}
+
+TEST(FTPStatisticsFileTest, TotalsSurviveRestart) {
+    std::string path = "/tmp/ssftpd_stats_test_" + std::to_string(getpid()) + ".bin";
+    std::remove(path.c_str());
+
+    {
+        auto file = std::make_shared<ssftpd::FTPStatisticsFile>();
+        ASSERT_TRUE(file->open(path));
+        ssftpd::FTPStatistics statistics;
+        statistics.setSnapshotFile(file);
+        statistics.start();
+        statistics.incrementRequests();
+        statistics.addBytesTransferred(4096);
+        statistics.stop();
+    }
+
+    // A monitoring tool sees the totals without the server
+    ssftpd::FTPStatisticsFile reader;
+    ASSERT_TRUE(reader.open(path, true));
+    ssftpd::FTPStatisticsFile::Values values;
+    int64_t updated = 0;
+    ASSERT_TRUE(reader.load(values, &updated));
+    EXPECT_EQ(values[1], 1u);
+    EXPECT_EQ(values[2], 4096u);
+    EXPECT_GT(updated, 0);
+
+    auto file = std::make_shared<ssftpd::FTPStatisticsFile>();
+    ASSERT_TRUE(file->open(path));
+    ssftpd::FTPStatistics restarted;
+    restarted.setSnapshotFile(file);
+    restarted.start();
+    restarted.incrementRequests();
+    auto stats = restarted.getStatsMap();
+    EXPECT_EQ(stats["total_requests"], 2u);
+    EXPECT_EQ(stats["total_bytes_transferred"], 4096u);
+    restarted.stop();
+
+    std::remove(path.c_str());
+}
+
+TEST(FTPStatisticsFileTest, TornSlotFallsBackToPreviousSnapshot) {
+    std::string path = "/tmp/ssftpd_stats_torn_" + std::to_string(getpid()) + ".bin";
+    std::remove(path.c_str());
+
+    ssftpd::FTPStatisticsFile file;
+    ASSERT_TRUE(file.open(path));
+    ssftpd::FTPStatisticsFile::Values values{};
+    values[0] = 1;
+    file.publish(values);
+    values[0] = 2;
+    file.publish(values);
+
+    // Corrupt one value of the newest slot, as a lost page write would
+    FILE* raw = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(raw, nullptr);
+    std::vector<char> bytes(4096);
+    size_t size = std::fread(bytes.data(), 1, bytes.size(), raw);
+    size_t slot_size = (size - 64) / 2;
+    std::fseek(raw, static_cast<long>(64 + 0 * slot_size + 16), SEEK_SET);
+    uint64_t garbage = 12345;
+    std::fwrite(&garbage, sizeof(garbage), 1, raw);
+    std::fclose(raw);
+
+    ssftpd::FTPStatisticsFile reader;
+    ASSERT_TRUE(reader.open(path, true));
+    ssftpd::FTPStatisticsFile::Values loaded;
+    ASSERT_TRUE(reader.load(loaded));
+    EXPECT_EQ(loaded[0], 1u);
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_tracer.hpp"
+#include <string>
+#include <thread>
+#include <vector>
+
+using ssftpd::FTPTraceSpan;
+using ssftpd::FTPTracer;
+
+namespace {
+
+size_t countOccurrences(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+} // namespace
+
+class FTPTracerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        FTPTracer::clear();
+    }
+
+    void TearDown() override {
+        FTPTracer::setCategories(0);
+        FTPTracer::clear();
+    }
+};
+
+TEST_F(FTPTracerTest, DisabledCategoriesRecordNothing) {
+    FTPTracer::setCategories(FTPTracer::COMMAND);
+    {
+        FTPTraceSpan span(FTPTracer::TRANSFER, "send");
+    }
+    {
+        FTPTraceSpan span(FTPTracer::COMMAND, "command");
+        span.setLabel("RETR");
+    }
+
+    std::string json = FTPTracer::dump();
+    EXPECT_EQ(countOccurrences(json, "\"name\":\"send\""), 0u);
+    EXPECT_EQ(countOccurrences(json, "\"name\":\"command\""), 1u);
+    EXPECT_NE(json.find("\"detail\":\"RETR\""), std::string::npos);
+    EXPECT_NE(json.find("\"cat\":\"command\""), std::string::npos);
+}
+
+TEST_F(FTPTracerTest, SpansFromEveryThreadAreDumped) {
+    FTPTracer::setCategories(FTPTracer::ALL);
+
+    const int thread_count = 4;
+    const int spans_per_thread = 100;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < spans_per_thread; ++i) {
+                FTPTraceSpan span(FTPTracer::FILESYSTEM, "filesystem_task");
+                span.setValue(static_cast<uint64_t>(i));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::string json = FTPTracer::dump();
+    EXPECT_EQ(countOccurrences(json, "\"name\":\"filesystem_task\""),
+              static_cast<size_t>(thread_count * spans_per_thread));
+    EXPECT_EQ(json.compare(0, 16, "{\"displayTimeUni"), 0);
+
+    // The ring keeps only the most recent spans of a thread
+    std::thread([]() {
+        for (size_t i = 0; i < FTPTracer::kRingSize + 10; ++i) {
+            FTPTraceSpan span(FTPTracer::TLS, "handshake_step");
+        }
+    }).join();
+    // One slot may be mid-write while dumping, so it is never reported
+    size_t kept = countOccurrences(FTPTracer::dump(), "\"name\":\"handshake_step\"");
+    EXPECT_GE(kept, FTPTracer::kRingSize - 1);
+    EXPECT_LE(kept, FTPTracer::kRingSize);
+}
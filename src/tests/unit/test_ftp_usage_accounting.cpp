@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include "ssftpd/ftp_usage_accounting.hpp"
+#include "ssftpd/ftp_server_config.hpp"
+#include "ssftpd/logger.hpp"
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using ssftpd::FTPUsageAccounting;
+
+class FTPUsageAccountingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        path = "/tmp/ssftpd_usage_test_" + std::to_string(getpid()) + ".bin";
+        std::remove(path.c_str());
+
+        config = std::make_shared<ssftpd::FTPServerConfig>();
+        config->usage_log_file = path;
+        config->usage_checkpoint_interval = std::chrono::seconds(0);
+
+        logger = std::make_shared<ssftpd::Logger>();
+        logger->setConsoleOutput(false);
+    }
+
+    void TearDown() override {
+        std::remove(path.c_str());
+    }
+
+    off_t fileSize() const {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? info.st_size : -1;
+    }
+
+    std::string path;
+    std::shared_ptr<ssftpd::FTPServerConfig> config;
+    std::shared_ptr<ssftpd::Logger> logger;
+};
+
+TEST_F(FTPUsageAccountingTest, AccountsAggregateAcrossThreads) {
+    FTPUsageAccounting accounting(config, logger);
+    auto alice = accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice");
+    EXPECT_EQ(alice, accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice"));
+
+    const int thread_count = 4;
+    const int rounds = 10000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([alice]() {
+            for (int i = 0; i < rounds; ++i) {
+                alice->addBytesDownloaded(10);
+            }
+            alice->countDownload();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto usage = accounting.getUsage(FTPUsageAccounting::Scope::USER, "alice");
+    EXPECT_EQ(usage.bytes_downloaded, static_cast<uint64_t>(thread_count * rounds * 10));
+    EXPECT_EQ(usage.downloads, static_cast<uint64_t>(thread_count));
+
+    // Users and virtual hosts of the same name are separate accounts
+    EXPECT_EQ(accounting.getUsage(FTPUsageAccounting::Scope::VIRTUAL_HOST, "alice").bytes_downloaded, 0u);
+}
+
+TEST_F(FTPUsageAccountingTest, CheckpointsRestoreTotals) {
+    {
+        FTPUsageAccounting accounting(config, logger);
+        ASSERT_TRUE(accounting.start());
+        accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice")->addBytesUploaded(100);
+        accounting.getAccount(FTPUsageAccounting::Scope::VIRTUAL_HOST, "ftp.example.com")->countSession();
+        ASSERT_TRUE(accounting.checkpoint());
+        EXPECT_EQ(accounting.getCheckpointCount(), 1u);
+
+        // Nothing changed, so nothing is appended
+        off_t size = fileSize();
+        ASSERT_TRUE(accounting.checkpoint());
+        EXPECT_EQ(fileSize(), size);
+
+        // Only the changed account goes into the next block
+        accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice")->addBytesUploaded(50);
+        accounting.stop();
+        EXPECT_EQ(accounting.getCheckpointCount(), 2u);
+    }
+
+    FTPUsageAccounting restored(config, logger);
+    ASSERT_TRUE(restored.start());
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "alice").bytes_uploaded, 150u);
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::VIRTUAL_HOST, "ftp.example.com").sessions, 1u);
+
+    // Counting continues from the restored totals
+    restored.getAccount(FTPUsageAccounting::Scope::USER, "alice")->addBytesUploaded(1);
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "alice").bytes_uploaded, 151u);
+    EXPECT_EQ(restored.getAllUsage(FTPUsageAccounting::Scope::USER).size(), 1u);
+}
+
+TEST_F(FTPUsageAccountingTest, TornTailIsDiscarded) {
+    off_t intact_size;
+    {
+        FTPUsageAccounting accounting(config, logger);
+        ASSERT_TRUE(accounting.start());
+        auto bob = accounting.getAccount(FTPUsageAccounting::Scope::USER, "bob");
+        bob->addBytesDownloaded(7);
+        ASSERT_TRUE(accounting.checkpoint());
+        intact_size = fileSize();
+
+        bob->addBytesDownloaded(1000);
+        accounting.stop();
+    }
+
+    // Simulate a crash halfway through the second block
+    ASSERT_EQ(truncate(path.c_str(), intact_size + 20), 0);
+
+    FTPUsageAccounting restored(config, logger);
+    ASSERT_TRUE(restored.start());
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "bob").bytes_downloaded, 7u);
+    EXPECT_EQ(fileSize(), intact_size);
+}
+
+TEST_F(FTPUsageAccountingTest, DamagedMiddleBlockKeepsLaterCheckpoints) {
+    off_t first_size;
+    off_t second_size;
+    {
+        FTPUsageAccounting accounting(config, logger);
+        ASSERT_TRUE(accounting.start());
+        auto alice = accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice");
+        alice->addBytesUploaded(10);
+        ASSERT_TRUE(accounting.checkpoint());
+        first_size = fileSize();
+
+        accounting.getAccount(FTPUsageAccounting::Scope::USER, "bob")->addBytesUploaded(7);
+        ASSERT_TRUE(accounting.checkpoint());
+        second_size = fileSize();
+
+        alice->addBytesUploaded(5);
+        accounting.stop();
+    }
+    off_t full_size = fileSize();
+    ASSERT_GT(full_size, second_size);
+
+    // Flip a payload byte of the second block so its checksum fails
+    FILE* file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    ASSERT_EQ(std::fseek(file, static_cast<long>(first_size + 40), SEEK_SET), 0);
+    int byte = std::fgetc(file);
+    ASSERT_NE(byte, EOF);
+    ASSERT_EQ(std::fseek(file, static_cast<long>(first_size + 40), SEEK_SET), 0);
+    std::fputc(byte ^ 0xff, file);
+    std::fclose(file);
+
+    FTPUsageAccounting restored(config, logger);
+    ASSERT_TRUE(restored.start());
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "alice").bytes_uploaded, 15u);
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "bob").bytes_uploaded, 0u);
+
+    // The checkpoints after the damaged block stay in the file
+    EXPECT_EQ(fileSize(), full_size);
+}
+
+TEST_F(FTPUsageAccountingTest, FailedWriteLeavesNoTornBlock) {
+    FTPUsageAccounting accounting(config, logger);
+    ASSERT_TRUE(accounting.start());
+    auto alice = accounting.getAccount(FTPUsageAccounting::Scope::USER, "alice");
+    alice->addBytesUploaded(10);
+    ASSERT_TRUE(accounting.checkpoint());
+    off_t intact_size = fileSize();
+
+    // Let the next block only partly fit, as on a full disk
+    struct rlimit original;
+    ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &original), 0);
+    struct rlimit limited = original;
+    limited.rlim_cur = static_cast<rlim_t>(intact_size + 10);
+    auto previous_handler = std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limited), 0);
+
+    alice->addBytesUploaded(5);
+    bool written = accounting.checkpoint();
+
+    setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, previous_handler);
+    EXPECT_FALSE(written);
+    EXPECT_EQ(fileSize(), intact_size);
+
+    // The retry lands right after the last good block
+    alice->addBytesUploaded(1);
+    ASSERT_TRUE(accounting.checkpoint());
+    accounting.stop();
+
+    FTPUsageAccounting restored(config, logger);
+    ASSERT_TRUE(restored.start());
+    EXPECT_EQ(restored.getUsage(FTPUsageAccounting::Scope::USER, "alice").bytes_uploaded, 16u);
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "ssftpd/logger.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using ssftpd::LogLevel;
+using ssftpd::LogOverflowPolicy;
+using ssftpd::Logger;
+
+class LoggerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        log_path = (std::filesystem::temp_directory_path() /
+                    ("ssftpd_logger_test_" + std::to_string(getpid()) + ".log")).string();
+        std::filesystem::remove(log_path);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(log_path);
+    }
+
+    size_t countLines() {
+        std::ifstream file(log_path);
+        std::string line;
+        size_t lines = 0;
+        while (std::getline(file, line)) {
+            lines++;
+        }
+        return lines;
+    }
+
+    std::string log_path;
+};
+
+TEST_F(LoggerTest, AsyncFlushWritesEveryRecord) {
+    Logger logger(log_path, LogLevel::INFO, false, true);
+    logger.setAsyncLogging(true);
+
+    for (int i = 0; i < 1000; ++i) {
+        logger.info("record " + std::to_string(i));
+    }
+    logger.flush();
+
+    EXPECT_EQ(countLines(), 1000u);
+    EXPECT_EQ(logger.getMessagesDropped(), 0u);
+    EXPECT_EQ(logger.getMessagesLogged(), 1000u);
+}
+
+TEST_F(LoggerTest, BlockPolicyLosesNothing) {
+    const int kThreads = 4;
+    const int kPerThread = 2000;
+    {
+        Logger logger(log_path, LogLevel::INFO, false, true);
+        logger.setLogBufferSize(16);
+        logger.setOverflowPolicy(LogOverflowPolicy::BLOCK);
+        logger.setAsyncLogging(true);
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < kThreads; ++t) {
+            producers.emplace_back([&logger]() {
+                for (int i = 0; i < kPerThread; ++i) {
+                    logger.info("record " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+
+        EXPECT_EQ(logger.getMessagesDropped(), 0u);
+    }
+
+    // The destructor drains the queue
+    EXPECT_EQ(countLines(), static_cast<size_t>(kThreads * kPerThread));
+}
+
+TEST_F(LoggerTest, DropPolicyCountsAndReportsDrops) {
+    Logger logger(log_path, LogLevel::INFO, false, true);
+    logger.setLogBufferSize(4);
+    logger.setOverflowPolicy(LogOverflowPolicy::DROP);
+    logger.setAsyncLogging(true);
+
+    const size_t kRecords = 20000;
+    for (size_t i = 0; i < kRecords; ++i) {
+        logger.info("record " + std::to_string(i));
+    }
+    logger.flush();
+    logger.setAsyncLogging(false);
+
+    uint64_t dropped = logger.getMessagesDropped();
+    ASSERT_GT(dropped, 0u);
+    EXPECT_EQ(logger.getMessagesLogged() + dropped, kRecords);
+
+    // Every kept record, plus at least one line reporting the drops
+    EXPECT_GT(countLines(), logger.getMessagesLogged());
+}
+
+TEST_F(LoggerTest, StoppingWhileLoggingLosesNothing) {
+    Logger logger(log_path, LogLevel::INFO, false, true);
+    logger.setLogBufferSize(64);
+    logger.setOverflowPolicy(LogOverflowPolicy::BLOCK);
+    logger.setAsyncLogging(true);
+
+    // Producers race the stop; every record they log must reach the file,
+    // whether it went through the queue or was written directly
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&logger]() {
+            for (int i = 0; i < 2000; ++i) {
+                logger.info("record " + std::to_string(i));
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    logger.setAsyncLogging(false);
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    logger.flush();
+
+    EXPECT_EQ(logger.getMessagesDropped(), 0u);
+    EXPECT_EQ(countLines(), 8000u);
+}
+
+TEST_F(LoggerTest, QueueSizeChangeAppliesWhileRunning) {
+    Logger logger(log_path, LogLevel::INFO, false, true);
+    logger.setLogBufferSize(4);
+    logger.setAsyncLogging(true);
+
+    // Restarts the writer with the larger queue
+    logger.setLogBufferSize(1 << 16);
+    for (int i = 0; i < 1000; ++i) {
+        logger.info("record " + std::to_string(i));
+    }
+    logger.flush();
+
+    EXPECT_EQ(logger.getMessagesDropped(), 0u);
+    EXPECT_EQ(countLines(), 1000u);
+}
+
+TEST_F(LoggerTest, ParsesOverflowPolicy) {
+    EXPECT_EQ(Logger::parseOverflowPolicy("block"), LogOverflowPolicy::BLOCK);
+    EXPECT_EQ(Logger::parseOverflowPolicy("SAMPLE"), LogOverflowPolicy::SAMPLE);
+    EXPECT_EQ(Logger::parseOverflowPolicy("drop"), LogOverflowPolicy::DROP);
+    EXPECT_EQ(Logger::parseOverflowPolicy("bogus"), LogOverflowPolicy::DROP);
+}
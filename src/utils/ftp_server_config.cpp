@@ -147,6 +147,13 @@ void FTPServerConfig::setDefaults() {
     ssl.verify_peer = false;
     ssl.min_tls_version = 0x0301; // TLS 1.0
     ssl.max_tls_version = 0x0304; // TLS 1.3
+    ssl.session_cache_size = 20480;
+    ssl.session_timeout = std::chrono::seconds(3600);
+    ssl.session_ticket_rotation = std::chrono::seconds(3600);
+    ssl.require_session_reuse = true;
+    ssl.handshake_threads = 2;
+    ssl.handshake_queue_size = 256;
+    ssl.handshake_timeout = std::chrono::seconds(10);
 
     // Logging defaults
     logging.log_file = "/var/log/ssftpd/ssftpd.log";
@@ -159,6 +166,9 @@ void FTPServerConfig::setDefaults() {
     logging.log_format = "default";
     logging.max_log_size = 10 * 1024 * 1024; // 10MB
     logging.max_log_files = 5;
+    logging.async_logging = true;
+    logging.async_queue_size = 8192;
+    logging.overflow_policy = "drop";
 
     // Security defaults
     security.chroot_enabled = false;
@@ -172,6 +182,8 @@ void FTPServerConfig::setDefaults() {
     security.max_login_attempts = 3;
     security.login_timeout = std::chrono::seconds(30);
     security.session_timeout = std::chrono::seconds(3600);
+    security.allow_networks.clear(); // empty = every network
+    security.deny_networks.clear();
 
     // Transfer defaults
     transfer.max_file_size = 0; // 0 = unlimited
@@ -197,6 +209,11 @@ void FTPServerConfig::setDefaults() {
     connection.tcp_nodelay = true;
     connection.reuse_address = true;
     connection.backlog = 50;
+    connection.admission_control = true;
+    connection.overload_action = "reject";
+    connection.max_loop_lag = std::chrono::milliseconds(100);
+    connection.max_queue_depth = 1000;
+    connection.max_pending_disk_io = 256;
 
     // Passive mode defaults
     passive.enabled = true;
@@ -212,6 +229,9 @@ void FTPServerConfig::setDefaults() {
     rate_limit.max_transfer_rate = 1024 * 1024; // 1MB/s
     rate_limit.window_size = std::chrono::seconds(60);
     rate_limit.block_duration = std::chrono::seconds(300);
+    rate_limit.nftables_set = ""; // empty = bans stay in the server
+    rate_limit.shared_memory_name = ""; // empty = limits are per process
+    rate_limit.shared_memory_slots = 65536;
 
     // Virtual host defaults
     enable_virtual_hosts = false;
@@ -232,7 +252,10 @@ void FTPServerConfig::setDefaults() {
     enable_metrics = false;
     metrics_endpoint = "/metrics";
     metrics_port = 8080;
+    metrics_bind_address = ""; // empty = all interfaces
     metrics_interval = std::chrono::seconds(60);
+    statistics_file = ""; // empty = counters start from zero on every start
+    handler_budget = std::chrono::milliseconds(100); // 0 = no stall watchdog
 
     // Backup defaults
     enable_backup = false;
@@ -240,11 +263,16 @@ void FTPServerConfig::setDefaults() {
     backup_interval = std::chrono::seconds(86400); // 24 hours
     max_backups = 7;
 
+    // Usage accounting defaults
+    usage_log_file = ""; // empty = totals are kept in memory only
+    usage_checkpoint_interval = std::chrono::seconds(60);
+
     // Development defaults
     debug_mode = false;
     verbose_logging = false;
     trace_commands = false;
     profile_performance = false;
+    trace_file = "/tmp/ssftpd-trace.json";
     log_socket_events = "none";
 }
 
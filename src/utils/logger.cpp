@@ -10,6 +10,21 @@
 
 namespace ssftpd {
 
+namespace {
+
+// Records the writer joins into one write
+constexpr size_t kMaxBatchRecords = 512;
+
+// Under SAMPLE, once the queue is this full only one in kSampleRate
+// messages below WARN is kept
+constexpr size_t kSampleThresholdPercent = 75;
+constexpr uint64_t kSampleRate = 16;
+
+// Bounds a missed wake-up; producers never take the writer's lock
+const auto kWriterIdleWait = std::chrono::milliseconds(10);
+
+} // namespace
+
 Logger::Logger(const std::string& log_file, LogLevel level, bool log_to_console, bool log_to_file)
     : log_file_(log_file)
     , log_level_(level)
@@ -33,6 +48,13 @@ Logger::Logger(const std::string& log_file, LogLevel level, bool log_to_console,
     , min_log_time_(UINT64_MAX)
     , log_calls_(0)
     , async_running_(false)
+    , overflow_policy_(LogOverflowPolicy::DROP)
+    , messages_dropped_(0)
+    , messages_queued_(0)
+    , messages_written_(0)
+    , sample_counter_(0)
+    , writer_sleeping_(false)
+    , active_producers_(0)
 {
     if (log_to_file && !log_file_.empty()) {
         // Create log directory if it doesn't exist
@@ -46,19 +68,13 @@ Logger::Logger(const std::string& log_file, LogLevel level, bool log_to_console,
     }
 
     if (async_logging_) {
-        async_running_ = true;
-        async_thread_ = std::thread(&Logger::asyncLoggingThread, this);
+        startAsyncWriter();
     }
 }
 
 Logger::~Logger() {
-    if (async_logging_) {
-        async_running_ = false;
-        async_condition_.notify_all();
-        if (async_thread_.joinable()) {
-            async_thread_.join();
-        }
-    }
+    // The writer drains the queue before it exits
+    stopAsyncWriter();
 
     if (log_stream_.is_open()) {
         log_stream_.close();
@@ -78,17 +94,34 @@ void Logger::log(LogLevel level, const std::string& message,
     auto start_time = std::chrono::steady_clock::now();
 
     std::string formatted_message = formatMessage(level, message, file, line, function);
-
-    if (log_to_console_) {
-        writeToConsole(formatted_message);
+    size_t length = formatted_message.length();
+
+    // Registered before looking at async_running_, so stopAsyncWriter()
+    // can wait for every producer that saw the writer running
+    active_producers_.fetch_add(1);
+    bool queued = false;
+    if (async_running_.load()) {
+        // The writer thread does the I/O; a full queue follows the policy
+        if (!addToAsyncBuffer(level, formatted_message)) {
+            active_producers_.fetch_sub(1);
+            return;
+        }
+        queued = true;
     }
+    active_producers_.fetch_sub(1);
+
+    if (!queued) {
+        if (log_to_console_) {
+            writeToConsole(formatted_message);
+        }
 
-    if (log_to_file_ && log_stream_.is_open()) {
-        writeToFile(formatted_message);
+        if (log_to_file_ && log_stream_.is_open()) {
+            writeToFile(formatted_message);
+        }
     }
 
     messages_logged_++;
-    bytes_written_ += formatted_message.length();
+    bytes_written_ += length;
 
     if (performance_monitoring_) {
         updatePerformanceMetrics(start_time);
@@ -197,7 +230,7 @@ bool Logger::shouldRotateLog() const {
 }
 
 void Logger::rotateLog() {
-    std::lock_guard<std::mutex> lock(log_mutex_);
+    // Called with log_mutex_ held
 
     if (log_stream_.is_open()) {
         log_stream_.close();
@@ -275,32 +308,137 @@ std::string Logger::resetConsoleColor() const {
 }
 
 void Logger::asyncLoggingThread() {
-    while (async_running_) {
+    std::string batch;
+    uint64_t reported_drops = messages_dropped_.load(std::memory_order_relaxed);
+
+    for (;;) {
+        // Read before draining, so a stop request still sees every record
+        // queued before it
+        bool running = async_running_.load(std::memory_order_acquire);
+
+        batch.clear();
+        size_t records = processAsyncBuffer(batch);
+
+        uint64_t dropped = messages_dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported_drops) {
+            batch += formatMessage(LogLevel::WARN, std::to_string(dropped - reported_drops) +
+                                   " log messages dropped, log queue full", "", 0, "");
+            batch += '\n';
+            reported_drops = dropped;
+        }
+
+        if (!batch.empty()) {
+            writeBatch(batch);
+            messages_written_.fetch_add(records, std::memory_order_release);
+            continue;
+        }
+        if (!running) {
+            break;
+        }
+
         std::unique_lock<std::mutex> lock(async_mutex_);
-        async_condition_.wait_for(lock, std::chrono::milliseconds(100));
+        writer_sleeping_.store(true, std::memory_order_seq_cst);
+        if (async_ring_->size() == 0 && async_running_.load(std::memory_order_acquire)) {
+            async_condition_.wait_for(lock, kWriterIdleWait);
+        }
+        writer_sleeping_.store(false, std::memory_order_relaxed);
+    }
+}
 
-        processAsyncBuffer();
+size_t Logger::processAsyncBuffer(std::string& batch) {
+    std::string record;
+    size_t records = 0;
+    while (records < kMaxBatchRecords && async_ring_->tryPop(record)) {
+        batch += record;
+        batch += '\n';
+        records++;
     }
+    return records;
 }
 
-void Logger::processAsyncBuffer() {
-    std::vector<std::string> buffer_copy;
-    {
-        std::lock_guard<std::mutex> lock(async_mutex_);
-        buffer_copy.swap(async_buffer_);
+bool Logger::addToAsyncBuffer(LogLevel level, std::string& message) {
+    if (overflow_policy_ == LogOverflowPolicy::SAMPLE && level < LogLevel::WARN &&
+        async_ring_->size() * 100 >= async_ring_->capacity() * kSampleThresholdPercent &&
+        sample_counter_.fetch_add(1, std::memory_order_relaxed) % kSampleRate != 0) {
+        messages_dropped_++;
+        return false;
     }
 
-    for (const auto& message : buffer_copy) {
-        writeToFile(message);
+    while (!async_ring_->tryPush(message)) {
+        if (overflow_policy_ != LogOverflowPolicy::BLOCK) {
+            messages_dropped_++;
+            return false;
+        }
+        // Once the writer has exited, stopAsyncWriter() drains the queue
+        async_condition_.notify_one();
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
     }
-}
+    messages_queued_.fetch_add(1, std::memory_order_relaxed);
 
-void Logger::addToAsyncBuffer(const std::string& message) {
-    if (async_logging_) {
-        std::lock_guard<std::mutex> lock(async_mutex_);
-        async_buffer_.push_back(message);
+    if (writer_sleeping_.load(std::memory_order_seq_cst)) {
         async_condition_.notify_one();
     }
+    return true;
+}
+
+void Logger::writeBatch(const std::string& batch) {
+    if (log_to_console_) {
+        std::cout.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+        std::cout.flush();
+    }
+
+    if (!log_to_file_) {
+        return;
+    }
+
+    // One write for the whole batch instead of a flush per line
+    std::lock_guard<std::mutex> lock(log_mutex_);
+    if (log_stream_.is_open()) {
+        log_stream_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+        log_stream_.flush();
+
+        if (log_rotation_enabled_ && shouldRotateLog()) {
+            rotateLog();
+        }
+    }
+}
+
+void Logger::startAsyncWriter() {
+    // No producer touches the queue while the writer is stopped, so it can
+    // be rebuilt with the current log_buffer_size_
+    async_ring_ = std::make_unique<MPSCRingBuffer<std::string>>(log_buffer_size_);
+
+    async_running_.store(true);
+    async_thread_ = std::thread(&Logger::asyncLoggingThread, this);
+}
+
+void Logger::stopAsyncWriter() {
+    if (!async_thread_.joinable()) {
+        return;
+    }
+
+    async_running_.store(false);
+    async_condition_.notify_all();
+    async_thread_.join();
+
+    // Producers that saw the writer running may still be pushing; take over
+    // as the consumer until they are done and the queue is empty
+    std::string batch;
+    for (;;) {
+        bool idle = active_producers_.load() == 0;
+
+        batch.clear();
+        size_t records = processAsyncBuffer(batch);
+        if (records > 0) {
+            writeBatch(batch);
+            messages_written_.fetch_add(records, std::memory_order_release);
+            continue;
+        }
+        if (idle) {
+            break;
+        }
+        std::this_thread::yield();
+    }
 }
 
 bool Logger::messageMatchesFilter(const std::string& message) const {
@@ -335,6 +473,15 @@ void Logger::updatePerformanceMetrics(const std::chrono::steady_clock::time_poin
 }
 
 void Logger::flush() {
+    // Wait for the writer to catch up with everything queued so far
+    uint64_t queued = messages_queued_.load(std::memory_order_relaxed);
+    while (async_running_.load(std::memory_order_acquire) &&
+           messages_written_.load(std::memory_order_acquire) < queued) {
+        async_condition_.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::lock_guard<std::mutex> lock(log_mutex_);
     if (log_stream_.is_open()) {
         log_stream_.flush();
     }
@@ -353,6 +500,7 @@ bool Logger::isLogFileOpen() const {
 std::string Logger::getStatistics() const {
     std::ostringstream oss;
     oss << "Messages logged: " << messages_logged_.load() << "\n"
+        << "Messages dropped: " << messages_dropped_.load() << "\n"
         << "Bytes written: " << bytes_written_.load() << "\n"
         << "Files rotated: " << files_rotated_.load() << "\n"
         << "Log calls: " << log_calls_.load();
@@ -369,6 +517,7 @@ std::string Logger::getStatistics() const {
 
 void Logger::resetStatistics() {
     messages_logged_ = 0;
+    messages_dropped_ = 0;
     bytes_written_ = 0;
     files_rotated_ = 0;
     total_log_time_ = 0;
@@ -402,7 +551,16 @@ bool Logger::shouldLogMessage(const std::string& message) const {
 }
 
 void Logger::setLogBufferSize(size_t buffer_size) {
+    if (buffer_size == log_buffer_size_) {
+        return;
+    }
     log_buffer_size_ = buffer_size;
+
+    // The queue is sized when the writer starts; restart it to apply
+    if (async_thread_.joinable()) {
+        stopAsyncWriter();
+        startAsyncWriter();
+    }
 }
 
 void Logger::setLogFile(const std::string& log_file) {
@@ -431,18 +589,28 @@ void Logger::setAsyncLogging(bool enable) {
         async_logging_ = enable;
 
         if (enable) {
-            async_running_ = true;
-            async_thread_ = std::thread(&Logger::asyncLoggingThread, this);
+            startAsyncWriter();
         } else {
-            async_running_ = false;
-            async_condition_.notify_all();
-            if (async_thread_.joinable()) {
-                async_thread_.join();
-            }
+            stopAsyncWriter();
         }
     }
 }
 
+void Logger::setOverflowPolicy(LogOverflowPolicy policy) {
+    overflow_policy_ = policy;
+}
+
+LogOverflowPolicy Logger::parseOverflowPolicy(const std::string& policy) {
+    std::string lower_policy = policy;
+    std::transform(lower_policy.begin(), lower_policy.end(), lower_policy.begin(), ::tolower);
+
+    if (lower_policy == "block") return LogOverflowPolicy::BLOCK;
+    if (lower_policy == "sample") return LogOverflowPolicy::SAMPLE;
+
+    // Default to dropping, which never stalls a session
+    return LogOverflowPolicy::DROP;
+}
+
 std::string Logger::formatCustomMessage(LogLevel level, const std::string& message,
                                        const std::string& file, int line, const std::string& function) {
     // Simple custom format implementation